@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "../include/lightmodbus/core.h"
+
+/*
+CRC engine benchmark
+Build it once for each engine (see makefile-bench) and compare results
+On x86 throughput is given in bytes per TSC cycle, elsewhere in bytes per nanosecond
+*/
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#define TICKS( ) __rdtsc( )
+#define UNIT "B/cycle"
+#else
+static uint64_t ticks( )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#define TICKS( ) ticks( )
+#define UNIT "B/ns"
+#endif
+
+#define ITERATIONS 200000
+
+static uint16_t reference( uint8_t *data, uint16_t length )
+{
+	uint16_t crc = 0xFFFF;
+	uint16_t i;
+	uint8_t j;
+
+	for ( i = 0; i < length; i++ )
+	{
+		crc ^= data[i];
+		for ( j = 0; j < 8; j++ )
+			crc = ( crc & 1 ) ? ( crc >> 1 ) ^ 0xA001 : crc >> 1;
+	}
+	return crc;
+}
+
+int main( )
+{
+	static const uint16_t lengths[] = { 8, 16, 32, 64, 128, 256 };
+	static const char *engines[] = { "bitwise", "table", "slicing-by-8" };
+	uint8_t frame[256];
+	volatile uint16_t sink = 0;
+	uint64_t start, end;
+	unsigned int i, n;
+
+	for ( i = 0; i < sizeof( frame ); i++ )
+		frame[i] = rand( );
+
+	//Check engine before measuring it
+	for ( n = 0; n <= sizeof( frame ); n++ )
+		if ( modbusCRC( frame, n ) != reference( frame, n ) )
+		{
+			printf( "%s: CRC mismatch for %u bytes!\n", engines[LIGHTMODBUS_CRC], n );
+			return 1;
+		}
+
+	printf( "%s%s:\n", engines[LIGHTMODBUS_CRC], LIGHTMODBUS_CRC_PCLMUL ? " + PCLMUL" : "" );
+	for ( n = 0; n < sizeof( lengths ) / sizeof( lengths[0] ); n++ )
+	{
+		start = TICKS( );
+		for ( i = 0; i < ITERATIONS; i++ )
+		{
+			frame[0] = i;
+			sink ^= modbusCRC( frame, lengths[n] );
+		}
+		end = TICKS( );
+
+		printf( "\t%3d bytes - %.3f " UNIT "\n", lengths[n], \
+			(double) lengths[n] * ITERATIONS / (double) ( end - start ) );
+	}
+
+	return 0;
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../include/lightmodbus/core.h"
+#include "../include/lightmodbus/master.h"
+#include "../include/lightmodbus/slave.h"
+#include "../include/lightmodbus/server.h"
+
+/*
+Modbus TCP pipeline benchmark
+Single master connection reads 10 holding registers over and over, with given number of requests in flight
+Server runs in its own thread, and can be slowed down to emulate device with longer response time
+Transactions per second are reported for each window size
+*/
+
+#define DURATION 1000000000ull //Measurement time in ns
+
+static ModbusSlave slave;
+static ModbusServer server;
+static uint16_t registers[256];
+static volatile int stop;
+static unsigned int delay; //Server delay per loop iteration in us
+
+static uint64_t now( )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void *serve( void *arg )
+{
+	while ( !stop )
+	{
+		modbusServerRun( &server, 1 );
+		if ( delay ) usleep( delay );
+	}
+	return NULL;
+}
+
+static void run( uint16_t window )
+{
+	ModbusMaster master;
+	ModbusPipeline pipeline;
+	struct sockaddr_in sa;
+	uint8_t rx[4096];
+	uint16_t rxLength = 0, frameLength;
+	uint64_t start, count = 0, errors = 0;
+	int fd = socket( AF_INET, SOCK_STREAM, 0 ), one = 1;
+	ssize_t length;
+
+	memset( &sa, 0, sizeof( sa ) );
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons( server.port );
+	inet_pton( AF_INET, "127.0.0.1", &sa.sin_addr );
+	if ( connect( fd, (struct sockaddr *) &sa, sizeof( sa ) ) )
+	{
+		perror( "connect" );
+		exit( 1 );
+	}
+	setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+
+	memset( &master, 0, sizeof( master ) );
+	modbusMasterInit( &master );
+	master.tcp = 1;
+	pipeline.slots = NULL;
+	if ( modbusPipelineInit( &pipeline, &master, window ) )
+	{
+		printf( "modbusPipelineInit failed\n" );
+		exit( 1 );
+	}
+
+	start = now( );
+	while ( now( ) - start < DURATION )
+	{
+		//Keep the window full
+		while ( pipeline.pending < window )
+		{
+			modbusBuildRequest03( &master, 1, 0, 10 );
+			modbusPipelineAdd( &pipeline, NULL );
+			if ( write( fd, master.request.frame, master.request.length ) != master.request.length )
+			{
+				perror( "write" );
+				exit( 1 );
+			}
+		}
+
+		length = read( fd, rx + rxLength, sizeof( rx ) - rxLength );
+		if ( length <= 0 )
+		{
+			perror( "read" );
+			exit( 1 );
+		}
+		rxLength += length;
+
+		//Match all complete responses
+		while ( ( frameLength = modbusPipelineFrameLength( rx, rxLength ) ) != 0 )
+		{
+			if ( modbusPipelineParse( &pipeline, rx, frameLength, NULL ) ) errors++;
+			count++;
+			rxLength -= frameLength;
+			memmove( rx, rx + frameLength, rxLength );
+		}
+	}
+
+	printf( "\twindow %3d - %9.0f transactions/s, %lu errors\n", window, count * 1e9 / DURATION, (unsigned long) errors );
+	close( fd );
+	modbusPipelineEnd( &pipeline );
+	modbusMasterEnd( &master );
+	while ( server.connectionCount )
+		usleep( 1000 );
+}
+
+int main( )
+{
+	static const uint16_t windows[] = { 1, 2, 4, 16, 64 };
+	static const unsigned int delays[] = { 0, 100 };
+	pthread_t thread;
+	unsigned int i, j;
+
+	slave.address = 1;
+	slave.registers = registers;
+	slave.registerCount = 256;
+	if ( modbusSlaveInit( &slave ) || modbusServerInit( &server, &slave, "127.0.0.1", 0, 16 ) )
+	{
+		printf( "init failed\n" );
+		return 1;
+	}
+	pthread_create( &thread, NULL, serve, NULL );
+
+	for ( i = 0; i < sizeof( delays ) / sizeof( delays[0] ); i++ )
+	{
+		delay = delays[i];
+		printf( "server delay %u us:\n", delay );
+		for ( j = 0; j < sizeof( windows ) / sizeof( windows[0] ); j++ )
+			run( windows[j] );
+	}
+
+	stop = 1;
+	pthread_join( thread, NULL );
+	modbusServerEnd( &server );
+	modbusSlaveEnd( &slave );
+	return 0;
+}
@@ -0,0 +1,324 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../include/lightmodbus/core.h"
+#include "../include/lightmodbus/master.h"
+#include "../include/lightmodbus/slave.h"
+#include "../include/lightmodbus/server.h"
+
+/*
+Modbus server benchmark
+Server runs in its own thread, and clients are served by epoll loop in another one
+Each TCP connection keeps given number of requests (reading 10 holding registers) in flight
+Serial lines are emulated with pseudo terminals, and keep one request in flight each
+Throughput, round-trip latency percentiles and server CPU time per request are reported
+Build it once for each server backend (see makefile-bench) and compare results
+
+With number of threads given as an argument, server pool is used instead (TCP only)
+Clients are then split between the same number of threads, so give the machine twice as many cores
+*/
+
+#define DURATION 1000000000ull //Measurement time in ns
+#define WARMUP 100000000ull //Warmup time in ns
+#define MAX_SAMPLES ( 1 << 24 )
+#define MAX_DEPTH 8
+#define MAX_GROUPS 64
+
+typedef struct
+{
+	int fd;
+	uint16_t rxLength;
+	uint8_t rx[512];
+	uint64_t sent[MAX_DEPTH]; //Send times of requests in flight
+	uint8_t head, count;
+} Client;
+
+typedef struct
+{
+	Client *clients;
+	int count;
+	uint8_t depth, serial;
+	uint64_t start;
+	uint64_t *samples, sampleCount, maxSamples;
+} ClientGroup; //Connections handled by one client thread
+
+static ModbusSlave slave;
+static ModbusServer server;
+static ModbusServerPool pool;
+static uint16_t registers[256];
+static volatile int stop;
+static uint64_t *samples;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static clockid_t serverClock;
+static struct
+{
+	uint8_t frame[16], length, responseLength;
+} requests[2]; //Modbus TCP and RTU request
+
+static uint64_t now( clockid_t clock )
+{
+	struct timespec ts;
+	clock_gettime( clock, &ts );
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int compare( const void *a, const void *b )
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+	return x < y ? -1 : x > y;
+}
+
+static void *serve( void *arg )
+{
+	//Server is paused (with the lock) while serial lines are added
+	while ( !stop )
+	{
+		pthread_mutex_lock( &lock );
+		modbusServerRun( &server, 1 );
+		pthread_mutex_unlock( &lock );
+	}
+	return NULL;
+}
+
+static void send_requests( Client *c, uint8_t count, uint8_t serial )
+{
+	uint8_t buffer[MAX_DEPTH * sizeof( requests[0].frame )];
+	uint8_t length = requests[serial].length;
+	uint64_t t = now( CLOCK_MONOTONIC );
+	uint8_t i;
+
+	for ( i = 0; i < count; i++ )
+	{
+		memcpy( buffer + i * length, requests[serial].frame, length );
+		c->sent[( c->head + c->count++ ) % MAX_DEPTH] = t;
+	}
+	if ( write( c->fd, buffer, count * length ) != count * length )
+	{
+		perror( "write" );
+		exit( 1 );
+	}
+}
+
+static void *client_loop( void *arg )
+{
+	//Keep requests in flight on group's connections, and collect latency samples
+	ClientGroup *g = (ClientGroup *) arg;
+	struct epoll_event event, events[256];
+	uint8_t responseLength = requests[g->serial].responseLength;
+	uint64_t t;
+	int epfd = epoll_create1( 0 ), i, n;
+	ssize_t length;
+
+	for ( i = 0; i < g->count; i++ )
+	{
+		event.events = EPOLLIN;
+		event.data.ptr = g->clients + i;
+		epoll_ctl( epfd, EPOLL_CTL_ADD, g->clients[i].fd, &event );
+		send_requests( g->clients + i, g->depth, g->serial );
+	}
+
+	while ( ( t = now( CLOCK_MONOTONIC ) ) < g->start + WARMUP + DURATION )
+	{
+		n = epoll_wait( epfd, events, 256, 100 );
+		for ( i = 0; i < n; i++ )
+		{
+			Client *c = events[i].data.ptr;
+			uint8_t done = 0;
+
+			length = read( c->fd, c->rx + c->rxLength, sizeof( c->rx ) - c->rxLength );
+			if ( length <= 0 )
+			{
+				perror( "read" );
+				exit( 1 );
+			}
+			c->rxLength += length;
+
+			//Count complete responses and send the same number of new requests
+			t = now( CLOCK_MONOTONIC );
+			while ( c->rxLength >= responseLength )
+			{
+				if ( t - g->start >= WARMUP && g->sampleCount < g->maxSamples ) g->samples[g->sampleCount++] = t - c->sent[c->head];
+				c->head = ( c->head + 1 ) % MAX_DEPTH;
+				c->count--;
+				c->rxLength -= responseLength;
+				memmove( c->rx, c->rx + responseLength, c->rxLength );
+				done++;
+			}
+			if ( done ) send_requests( c, done, g->serial );
+		}
+	}
+
+	close( epfd );
+	return NULL;
+}
+
+static void run( uint16_t connections, uint8_t depth, uint8_t serial )
+{
+	struct sockaddr_in sa;
+	struct termios tio;
+	ClientGroup groups[MAX_GROUPS];
+	pthread_t threads[MAX_GROUPS];
+	Client *clients = calloc( connections, sizeof( Client ) );
+	uint16_t groupCount = pool.shardCount ? pool.shardCount : 1;
+	uint64_t start, cpu, count = 0;
+	int one = 1, i, j, fd;
+
+	memset( &sa, 0, sizeof( sa ) );
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons( pool.shardCount ? pool.port : server.port );
+	inet_pton( AF_INET, "127.0.0.1", &sa.sin_addr );
+
+	for ( i = 0; i < connections; i++ )
+	{
+		if ( serial )
+		{
+			//Terminal side of pseudo terminal is given to the server
+			clients[i].fd = posix_openpt( O_RDWR | O_NOCTTY );
+			grantpt( clients[i].fd );
+			unlockpt( clients[i].fd );
+			fd = open( ptsname( clients[i].fd ), O_RDWR | O_NOCTTY );
+			tcgetattr( fd, &tio );
+			cfmakeraw( &tio );
+			tcsetattr( fd, TCSANOW, &tio );
+
+			pthread_mutex_lock( &lock );
+			if ( modbusServerAddSerial( &server, fd, 115200 ) )
+			{
+				printf( "modbusServerAddSerial failed\n" );
+				exit( 1 );
+			}
+
+			//Pseudo terminals have no baudrate, so inter-frame delay is skipped (requests are written at once)
+			for ( j = 0; j < server.maxConnections; j++ )
+				if ( server.connections[j].fd == fd )
+					server.connections[j].receiver.t35 = 1;
+			pthread_mutex_unlock( &lock );
+		}
+		else
+		{
+			clients[i].fd = socket( AF_INET, SOCK_STREAM, 0 );
+			if ( connect( clients[i].fd, (struct sockaddr *) &sa, sizeof( sa ) ) )
+			{
+				perror( "connect" );
+				exit( 1 );
+			}
+			setsockopt( clients[i].fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+		}
+	}
+
+	//Let the server pick up new connections
+	usleep( 10000 );
+
+	//Connections are split between client threads (one per server thread)
+	start = now( CLOCK_MONOTONIC );
+	for ( i = 0; i < groupCount; i++ )
+	{
+		groups[i].clients = clients + connections * i / groupCount;
+		groups[i].count = connections * ( i + 1 ) / groupCount - connections * i / groupCount;
+		groups[i].depth = depth;
+		groups[i].serial = serial;
+		groups[i].start = start;
+		groups[i].samples = samples + MAX_SAMPLES / groupCount * i;
+		groups[i].maxSamples = MAX_SAMPLES / groupCount;
+		groups[i].sampleCount = 0;
+		pthread_create( threads + i, NULL, client_loop, groups + i );
+	}
+
+	//Server CPU time is measured after warmup
+	usleep( WARMUP / 1000 );
+	cpu = pool.shardCount ? 0 : now( serverClock );
+	for ( i = 0; i < groupCount; i++ )
+	{
+		pthread_join( threads[i], NULL );
+		memmove( samples + count, groups[i].samples, groups[i].sampleCount * sizeof( uint64_t ) );
+		count += groups[i].sampleCount;
+	}
+	cpu = pool.shardCount ? 0 : now( serverClock ) - cpu;
+
+	qsort( samples, count, sizeof( uint64_t ), compare );
+	printf( "\t%4d %s x %d - %9.0f req/s, p50 %7.1f us, p99 %7.1f us", connections, serial ? "ptys       " : "connections", depth, \
+		count * 1e9 / DURATION, count ? samples[count / 2] / 1e3 : 0, count ? samples[count * 99 / 100] / 1e3 : 0 );
+	if ( cpu ) printf( ", server CPU %5.2f us/req", count ? cpu / 1e3 / count : 0 );
+	printf( "\n" );
+
+	//Server closes serial lines when the other side is gone
+	for ( i = 0; i < connections; i++ )
+		close( clients[i].fd );
+	free( clients );
+	while ( server.connectionCount )
+		usleep( 1000 );
+}
+
+int main( int argc, char **argv )
+{
+	static const uint16_t connections[] = { 1, 16, 64, 256 };
+	static const uint16_t ptys[] = { 1, 4, 16 };
+	static const uint8_t depths[] = { 1, 4 };
+	ModbusMaster master;
+	pthread_t thread;
+	unsigned int i, j, threads = argc > 1 ? atoi( argv[1] ) : 0;
+
+	slave.address = 1;
+	slave.registers = registers;
+	slave.registerCount = 256;
+	if ( threads > MAX_GROUPS || modbusSlaveInit( &slave ) || ( threads ? \
+		modbusServerPoolInit( &pool, &slave, "127.0.0.1", 0, 1024, threads ) : modbusServerInit( &server, &slave, "127.0.0.1", 0, 1024 ) ) )
+	{
+		printf( "init failed\n" );
+		return 1;
+	}
+
+	//Requests are built once by master
+	memset( &master, 0, sizeof( master ) );
+	modbusMasterInit( &master );
+	for ( i = 0; i < 2; i++ )
+	{
+		master.tcp = !i;
+		modbusBuildRequest03( &master, 1, 0, 10 );
+		memcpy( requests[i].frame, master.request.frame, master.request.length );
+		requests[i].length = master.request.length;
+		requests[i].responseLength = master.predictedResponseLength;
+	}
+	modbusMasterEnd( &master );
+
+	samples = malloc( MAX_SAMPLES * sizeof( uint64_t ) );
+	if ( threads )
+		printf( "%s server pool (%d threads):\n", LIGHTMODBUS_SERVER_URING ? "io_uring" : "epoll", threads );
+	else
+	{
+		pthread_create( &thread, NULL, serve, NULL );
+		pthread_getcpuclockid( thread, &serverClock );
+		printf( "%s server:\n", LIGHTMODBUS_SERVER_URING ? "io_uring" : "epoll" );
+	}
+
+	for ( i = 0; i < sizeof( depths ); i++ )
+		for ( j = 0; j < sizeof( connections ) / sizeof( connections[0] ); j++ )
+			run( connections[j], depths[i], 0 );
+	for ( j = 0; !threads && j < sizeof( ptys ) / sizeof( ptys[0] ); j++ )
+		run( ptys[j], 1, 1 );
+
+	if ( threads ) modbusServerPoolEnd( &pool );
+	else
+	{
+		stop = 1;
+		pthread_join( thread, NULL );
+		modbusServerEnd( &server );
+	}
+	modbusSlaveEnd( &slave );
+	free( samples );
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTMODBUS_BANK_H
+#define LIGHTMODBUS_BANK_H
+
+#include <inttypes.h>
+
+#include "core.h"
+#include "slave.h"
+
+//Shared memory register bank (Linux only) - registers and coils kept in POSIX shared memory object
+//Producer processes write data straight into the bank, and slave serves it without copying
+//Needs slave registers module built with LIGHTMODBUS_SLAVE_SEQLOCK
+
+#define MODBUS_BANK_MAGIC 0x4B4E424D //"MBNK"
+#define MODBUS_BANK_VERSION 1
+
+//Bank segment types
+#define MODBUS_BANK_HOLDING_REGISTERS 1
+#define MODBUS_BANK_INPUT_REGISTERS 2
+#define MODBUS_BANK_COILS 4
+#define MODBUS_BANK_DISCRETE_INPUTS 8
+
+//Bank layout - header, segment table and data of all segments (each aligned to 8 bytes)
+//Only offsets are stored in the bank, because it's mapped at different addresses by each process
+typedef struct
+{
+	uint32_t magic; //MODBUS_BANK_MAGIC (set once bank is ready)
+	uint16_t version; //MODBUS_BANK_VERSION
+	uint16_t segmentCount; //Number of entries in segment table (following header)
+	uint32_t size; //Bank size in bytes
+	uint32_t reserved;
+	ModbusSeqlock registerLock; //Guards holding registers
+	ModbusSeqlock inputRegisterLock; //Guards input registers
+} ModbusBankHeader;
+
+typedef struct
+{
+	uint8_t type; //Segment type (MODBUS_BANK_HOLDING_REGISTERS etc.)
+	uint8_t reserved;
+	uint16_t base; //Address of the first register (or coil)
+	uint16_t count; //Register (or coil) count
+	uint16_t reserved2;
+	uint32_t offset; //Data offset from the beginning of bank (registers are in host byte order, coils are bits)
+} ModbusBankSegment;
+
+//Bank mapped by process - segment tables point into mapped memory, so they can be given to slave
+typedef struct
+{
+	ModbusBankHeader *header; //Mapped bank (NULL if not open)
+	uint32_t size; //Mapped size in bytes
+
+	ModbusRegisterSegment *registerSegments; //Holding register segments
+	uint16_t registerSegmentCount;
+	ModbusRegisterSegment *inputRegisterSegments; //Input register segments
+	uint16_t inputRegisterSegmentCount;
+	ModbusCoilSegment *coilSegments; //Coil segments
+	uint16_t coilSegmentCount;
+	ModbusCoilSegment *discreteInputSegments; //Discrete input segments
+	uint16_t discreteInputSegmentCount;
+} ModbusBank;
+
+//Function prototypes
+extern uint8_t modbusBankCreate( ModbusBank *bank, const char *name, const ModbusBankSegment *segments, uint16_t segmentCount ); //Create new bank and map it
+extern uint8_t modbusBankOpen( ModbusBank *bank, const char *name ); //Map existing bank
+extern uint8_t modbusBankAttach( ModbusBank *bank, ModbusSlave *status ); //Make slave serve bank data
+extern uint8_t modbusBankWrite( ModbusBank *bank, uint8_t type, uint16_t index, uint16_t count, const void *values ); //Update registers (or coils) as one change
+extern uint8_t modbusBankRead( ModbusBank *bank, uint8_t type, uint16_t index, uint16_t count, void *values ); //Read consistent copy of registers (or coils)
+extern uint8_t modbusBankClose( ModbusBank *bank ); //Unmap bank and free memory
+
+#endif
@@ -46,12 +46,43 @@
 #define MODBUS_EXCEP_ACK 5
 #define MODBUS_EXCEP_NACK 7
 
+//CRC calculation engines (use makefile to choose one)
+#define LIGHTMODBUS_CRC_BITWISE 0 //Bit by bit calculation - smallest and slowest, no lookup tables
+#define LIGHTMODBUS_CRC_TABLE 1 //Byte by byte calculation using 256-entry lookup table (512 bytes)
+#define LIGHTMODBUS_CRC_SLICING8 2 //8 bytes at once using eight lookup tables (4KiB) - fastest
+
+#ifndef LIGHTMODBUS_CRC
+#define LIGHTMODBUS_CRC LIGHTMODBUS_CRC_BITWISE
+#endif
+
+//Carry-less multiplication CRC kernel for x86 (picked at runtime if CPU supports it)
+#if !defined( LIGHTMODBUS_CRC_PCLMUL ) || !( defined( __x86_64__ ) || defined( __i386__ ) ) || !defined( __GNUC__ )
+#undef LIGHTMODBUS_CRC_PCLMUL
+#define LIGHTMODBUS_CRC_PCLMUL 0
+#endif
+
+//SIMD kernels for bulk byte swapping - SSSE3/AVX2 on x86 (picked at runtime), NEON on ARM
+#if !defined( LIGHTMODBUS_SWAP_SIMD ) || !( defined( __x86_64__ ) || defined( __i386__ ) || defined( __ARM_NEON ) ) || !defined( __GNUC__ )
+#undef LIGHTMODBUS_SWAP_SIMD
+#define LIGHTMODBUS_SWAP_SIMD 0
+#endif
+
 #define BITSTOBYTES( n ) ( n != 0 ? ( 1 + ( ( n - 1 ) >> 3 ) ) : 0 )
 
 //Function prototypes
 extern uint8_t modbusMaskRead( uint8_t *mask, uint16_t maskLength, uint16_t bit );
 extern uint8_t modbusMaskWrite( uint8_t *mask, uint16_t maskLength, uint16_t bit, uint8_t value );
+extern uint8_t modbusMaskAny( const uint8_t *mask, uint16_t maskLength, uint16_t bit, uint16_t count );
+extern uint8_t modbusMaskCopy( uint8_t *dest, uint16_t destLength, uint16_t destBit, const uint8_t *src, uint16_t srcLength, uint16_t srcBit, uint16_t count );
 extern uint16_t modbusSwapEndian( uint16_t data );
+extern uint8_t modbusSwapEndianBlock( void *dest, const void *src, uint16_t count );
 extern uint16_t modbusCRC( uint8_t *data, uint16_t length );
+extern uint16_t modbusCRCUpdate( uint16_t crc, uint8_t *data, uint16_t length );
+
+//Incremental CRC calculation (eg. while bytes are being received)
+//Modbus CRC has no final XOR, so modbusCRCFinal doesn't change the value
+//CRC of whole frame including its (valid) CRC field is always 0
+#define modbusCRCInit( ) ( (uint16_t) 0xFFFF )
+#define modbusCRCFinal( crc ) ( (uint16_t) ( crc ) )
 
 #endif
@@ -28,6 +28,10 @@
 #include "master/mtypes.h"
 #include "master/mbregs.h"
 #include "master/mbcoils.h"
+#include "master/mpipe.h"
+#include "master/mplan.h"
+#include "master/msched.h"
+#include "master/mcache.h"
 
 //Enabling modules in compilation process (use makefile to automate this process)
 #ifndef LIGHTMODBUS_MASTER_REGISTERS
@@ -37,7 +41,22 @@
 #define LIGHTMODBUS_MASTER_COILS 0
 #endif
 
+//Static memory mode - requests are built in buffer pointed by status->request.frame (at least 256 bytes long)
+//and received data is written to arrays pointed by status->data.coils (250 bytes) and status->data.regs (125 registers)
+//They have to be provided by user before modbusMasterInit is called
+#ifndef LIGHTMODBUS_STATIC_MEM_MASTER
+#define LIGHTMODBUS_STATIC_MEM_MASTER 0
+#endif
+
+//Built-in response handlers, indexed by function code
+//To add custom handlers, copy this table, modify it and set status->functions to point at the copy
+extern const ModbusMasterHandler modbusMasterDefaultFunctions[256];
+
+extern uint8_t modbusMasterAllocateRequest( ModbusMaster *status, uint8_t length ); //Prepare memory for request frame
+extern uint8_t modbusMasterFinishRequest( ModbusMaster *status, uint8_t length ); //Add CRC or MBAP header to built request
+extern uint8_t modbusMasterAllocateDataBuffer( ModbusMaster *status, uint16_t size ); //Prepare memory for received data
 extern uint8_t modbusParseResponse( ModbusMaster *status );
+extern uint8_t modbusParseResponseCRC( ModbusMaster *status, uint16_t crc ); //Parse response, which CRC has been already calculated
 extern uint8_t modbusMasterInit( ModbusMaster *status );
 extern uint8_t modbusMasterEnd( ModbusMaster *status ); //Free memory used by master
 
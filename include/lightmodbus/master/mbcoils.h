@@ -24,6 +24,10 @@
 #include <inttypes.h>
 #include "mtypes.h"
 
+//Functions needed from other modules
+extern uint8_t modbusMasterAllocateRequest( ModbusMaster *status, uint8_t length );
+extern uint8_t modbusMasterFinishRequest( ModbusMaster *status, uint8_t length );
+
 //Functions for building requests
 #define modbusBuildRequest01( status, address, index, count ) modbusBuildRequest0102( (status), 1, (address), (index), (count) )
 #define modbusBuildRequest02( status, address, index, count ) modbusBuildRequest0102( (status), 2, (address), (index), (count) )
@@ -24,6 +24,10 @@
 #include <inttypes.h>
 #include "mtypes.h"
 
+//Functions needed from other modules
+extern uint8_t modbusMasterAllocateRequest( ModbusMaster *status, uint8_t length );
+extern uint8_t modbusMasterFinishRequest( ModbusMaster *status, uint8_t length );
+
 //Functions for building requests
 #define modbusBuildRequest03( status, address, index, count ) modbusBuildRequest0304( (status), 3, (address), (index), (count) )
 #define modbusBuildRequest04( status, address, index, count ) modbusBuildRequest0304( (status), 4, (address), (index), (count) )
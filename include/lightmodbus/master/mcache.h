@@ -0,0 +1,89 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTMODBUS_MCACHE_H
+#define LIGHTMODBUS_MCACHE_H
+
+#include <inttypes.h>
+#include "../core.h"
+#include "mtypes.h"
+
+//Response cache - lets gateways answer repeated reads (functions 1 - 4) without asking slave again
+//All times are given in microseconds (and may wrap around)
+
+//Cache entry states
+#define MODBUS_CACHE_EMPTY 0
+#define MODBUS_CACHE_PENDING 1 //Request has been sent, response not stored yet
+#define MODBUS_CACHE_VALID 2
+
+//Lookup results
+#define MODBUS_CACHE_MISS 0 //Request has to be sent to slave (and entry has been reserved for its response)
+#define MODBUS_CACHE_HIT 1 //Data can be taken from entry
+#define MODBUS_CACHE_WAIT 2 //The same data has already been requested - wait until entry is valid
+
+typedef struct
+{
+	uint8_t state; //Entry state
+	uint8_t address; //Slave address
+	uint8_t function; //Function used to read data
+	uint16_t index; //Address of the first element
+	uint16_t count; //Number of elements
+	uint32_t time; //When request was sent (or response stored)
+	uint32_t ttl; //How long data stays valid
+	uint8_t length; //Length of data in bytes
+	union
+	{
+		uint8_t coils[250];
+		uint16_t regs[125];
+	} data; //Data, as parsed by master
+} ModbusCacheEntry;
+
+typedef struct
+{
+	uint8_t address; //Slave address (0 - any)
+	uint8_t function; //Function (0 - any)
+	uint16_t index; //Address of the first element
+	uint16_t count; //Number of elements
+	uint32_t ttl; //How long data read from this range stays valid
+} ModbusCacheRule;
+
+typedef struct
+{
+	ModbusCacheEntry *entries; //Cache entries
+	uint16_t entryCount;
+	const ModbusCacheRule *rules; //TTLs of address ranges - read overlapping many ranges gets the shortest TTL
+	uint16_t ruleCount;
+	uint32_t ttl; //TTL of data not covered by any rule
+
+	//Statistics
+	uint32_t hits; //Reads served from cache
+	uint32_t misses; //Reads that had to be sent to slave
+	uint32_t collapsed; //Reads that waited for the same request already in flight
+} ModbusCache;
+
+//Function prototypes
+extern uint8_t modbusCacheInit( ModbusCache *cache, uint16_t entryCount, const ModbusCacheRule *rules, uint16_t ruleCount, uint32_t ttl ); //Set up cache
+extern uint8_t modbusCacheLookup( ModbusCache *cache, uint8_t address, uint8_t function, uint16_t index, uint16_t count, uint32_t now, ModbusCacheEntry **entry, uint8_t *result ); //Find data in cache
+extern uint8_t modbusCacheStore( ModbusCache *cache, ModbusCacheEntry *entry, ModbusMaster *master, uint32_t now ); //Store data parsed by master
+extern uint8_t modbusCacheCancel( ModbusCache *cache, ModbusCacheEntry *entry ); //Free entry of failed request
+extern uint8_t modbusCacheInvalidate( ModbusCache *cache, uint8_t address, uint8_t function, uint16_t index, uint16_t count ); //Drop data overwritten on slave
+extern uint8_t modbusCacheEnd( ModbusCache *cache ); //Free memory used by cache
+
+#endif
@@ -24,6 +24,9 @@
 #include <inttypes.h>
 #include "mtypes.h"
 
+//Functions needed from other modules
+extern uint8_t modbusMasterAllocateDataBuffer( ModbusMaster *status, uint16_t size );
+
 //Functions for parsing responses
 #define modbusParseResponse01 modbusParseResponse0102
 #define modbusParseResponse02 modbusParseResponse0102
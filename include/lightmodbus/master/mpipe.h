@@ -0,0 +1,56 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTMODBUS_MPIPE_H
+#define LIGHTMODBUS_MPIPE_H
+
+#include <inttypes.h>
+#include "../core.h"
+#include "mtypes.h"
+
+//Modbus TCP request pipeline - many requests can be in flight, and responses are matched to them by transaction identifier
+
+typedef struct
+{
+	uint8_t used; //Is request waiting for response
+	uint16_t transaction; //Transaction identifier of the request
+	uint16_t length; //Request frame length
+	uint16_t predictedResponseLength; //Response length, if everything goes fine
+	void *context; //User data passed with request
+	uint8_t frame[MODBUS_TCP_MAX_LENGTH]; //Copy of request frame
+} ModbusPipelineSlot;
+
+typedef struct
+{
+	ModbusMaster *master; //Master building requests and parsing responses (in Modbus TCP mode)
+	ModbusPipelineSlot *slots; //Requests in flight, indexed by transaction identifier modulo window
+	uint16_t window; //Maximum number of requests in flight
+	uint16_t pending; //Number of requests in flight
+} ModbusPipeline;
+
+//Function prototypes
+extern uint8_t modbusPipelineInit( ModbusPipeline *pipeline, ModbusMaster *master, uint16_t window ); //Prepare pipeline with given window
+extern uint8_t modbusPipelineAdd( ModbusPipeline *pipeline, void *context ); //Put request built by master in flight
+extern uint16_t modbusPipelineFrameLength( const uint8_t *data, uint16_t length ); //Length of complete Modbus TCP frame at the beginning of data
+extern uint8_t modbusPipelineParse( ModbusPipeline *pipeline, uint8_t *frame, uint16_t length, void **context ); //Parse response to one of requests in flight
+extern uint8_t modbusPipelineCancel( ModbusPipeline *pipeline, uint16_t transaction ); //Forget request (eg. after timeout)
+extern uint8_t modbusPipelineEnd( ModbusPipeline *pipeline ); //Free memory used by pipeline
+
+#endif
@@ -0,0 +1,75 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTMODBUS_MPLAN_H
+#define LIGHTMODBUS_MPLAN_H
+
+#include <inttypes.h>
+#include "../core.h"
+#include "mtypes.h"
+
+//Read planner - merges reads of many small ranges (tags) into as few Modbus requests as possible
+
+//Limits of single read request
+#define MODBUS_PLAN_MAX_REGISTERS 125
+#define MODBUS_PLAN_MAX_COILS 2000
+
+typedef struct
+{
+	uint8_t address; //Slave address
+	uint8_t type; //Data type - MODBUS_HOLDING_REGISTER, MODBUS_INPUT_REGISTER, MODBUS_COIL or MODBUS_DISCRETE_INPUT
+	uint16_t index; //Address of the first element
+	uint16_t count; //Number of elements
+
+	//Filled in by modbusPlanScatter - point into master's received data, so they're valid until next response is parsed
+	uint16_t *regs; //Register values
+	uint8_t *coils; //Coil values (see coilOffset)
+	uint16_t coilOffset; //Bit number of the first coil in coils array
+	uint8_t valid; //Have values been received
+} ModbusTag;
+
+typedef struct
+{
+	uint8_t address; //Slave address
+	uint8_t type; //Data type
+	uint16_t index; //Address of the first element read
+	uint16_t count; //Number of elements read
+	uint16_t first; //Position of first tag covered by this read (in plan's order array)
+	uint16_t tagCount; //Number of tags covered by this read
+} ModbusPlanRead;
+
+typedef struct
+{
+	ModbusTag *tags; //Tags to be read
+	uint16_t tagCount;
+	uint16_t *order; //Tag numbers, sorted by slave address, type and index
+	ModbusPlanRead *reads; //Planned reads
+	uint16_t readCount;
+	uint16_t registerGap; //Maximum number of unneeded registers read to avoid another request
+	uint16_t coilGap; //Maximum number of unneeded coils (or discrete inputs) read to avoid another request
+} ModbusPlan;
+
+//Function prototypes
+extern uint8_t modbusPlanInit( ModbusPlan *plan, ModbusTag *tags, uint16_t tagCount, uint16_t registerGap, uint16_t coilGap ); //Plan reads of given tags
+extern uint8_t modbusPlanRequest( ModbusPlan *plan, ModbusMaster *master, uint16_t read ); //Build request for given read
+extern uint8_t modbusPlanScatter( ModbusPlan *plan, ModbusMaster *master, uint16_t read ); //Point tags at data received in response
+extern uint8_t modbusPlanEnd( ModbusPlan *plan ); //Free memory used by plan
+
+#endif
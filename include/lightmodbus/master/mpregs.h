@@ -24,6 +24,9 @@
 #include <inttypes.h>
 #include "mtypes.h"
 
+//Functions needed from other modules
+extern uint8_t modbusMasterAllocateDataBuffer( ModbusMaster *status, uint16_t size );
+
 //Functions for parsing responses
 #define modbusParseResponse03 modbusParseResponse0304
 #define modbusParseResponse04 modbusParseResponse0304
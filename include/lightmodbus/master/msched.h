@@ -0,0 +1,74 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTMODBUS_MSCHED_H
+#define LIGHTMODBUS_MSCHED_H
+
+#include <inttypes.h>
+#include "../core.h"
+#include "mtypes.h"
+
+//Poll scheduler - plans periodic reads on Modbus RTU line, so that bus time is never overcommitted
+//All times are given in microseconds (and may wrap around)
+
+//Bits sent per character (start bit, 8 data bits, parity and stop bit)
+#define MODBUS_SCHEDULE_CHAR_BITS 11
+
+typedef struct
+{
+	uint8_t address; //Slave address
+	uint8_t type; //Data type - MODBUS_HOLDING_REGISTER, MODBUS_INPUT_REGISTER, MODBUS_COIL or MODBUS_DISCRETE_INPUT
+	uint16_t index; //Address of the first element
+	uint16_t count; //Number of elements
+	uint32_t period; //Poll period - response should be received within it
+
+	//Filled in by modbusScheduleInit
+	uint16_t requestLength; //Request frame length in bytes
+	uint16_t responseLength; //Response frame length in bytes
+	uint32_t cost; //Bus time taken by single poll
+	uint32_t responseTime; //Worst-case time between poll becoming due and response being received
+	uint8_t schedulable; //Is responseTime within period
+
+	//Run-time state
+	uint32_t due; //When poll is due next
+	uint16_t missed; //Number of periods skipped, because poll was late
+} ModbusPoll;
+
+typedef struct
+{
+	ModbusPoll *polls; //Polls to be scheduled
+	uint16_t pollCount;
+	uint16_t *order; //Poll numbers sorted by period (shortest period - highest priority)
+	uint32_t baudRate; //Line speed
+	uint32_t turnaround; //Time between request and response (slave processing time and line turnaround)
+	uint32_t silence; //Inter-frame delay (3.5 character time, but at least 1750us)
+	uint16_t utilization; //Bus utilization in permille
+	uint16_t unschedulable; //Number of polls whose period can't be guaranteed
+} ModbusSchedule;
+
+//Function prototypes
+extern uint8_t modbusScheduleInit( ModbusSchedule *schedule, ModbusMaster *master, ModbusPoll *polls, uint16_t pollCount, uint32_t baudRate, uint32_t turnaround ); //Compute bus time and check schedulability of polls
+extern uint8_t modbusScheduleStart( ModbusSchedule *schedule, uint32_t now ); //Make all polls due at given time
+extern uint8_t modbusScheduleNext( ModbusSchedule *schedule, uint32_t now, uint16_t *poll, uint32_t *wait ); //Pick poll to be sent now
+extern uint8_t modbusScheduleRequest( ModbusSchedule *schedule, ModbusMaster *master, uint16_t poll ); //Build request for given poll
+extern uint8_t modbusScheduleDone( ModbusSchedule *schedule, uint16_t poll, uint32_t now ); //Mark poll as finished
+extern uint8_t modbusScheduleEnd( ModbusSchedule *schedule ); //Free memory used by schedule
+
+#endif
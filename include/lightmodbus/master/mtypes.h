@@ -30,20 +30,26 @@
 #define MODBUS_DISCRETE_INPUT 8
 
 
-typedef struct
+union ModbusParser;
+struct modbusMaster;
+
+//Response handler - parses response to given request and stores received data (see modbusParseResponse0304 etc.)
+typedef uint8_t ( *ModbusMasterHandler )( struct modbusMaster *status, union ModbusParser *parser, union ModbusParser *requestParser );
+
+typedef struct modbusMaster
 {
 	uint8_t predictedResponseLength; //If everything goes fine, slave will return this amout of data
 
 	struct //Formatted request for slave
 	{
 		uint8_t *frame;
-		uint8_t length;
+		uint16_t length;
 	} request;
 
 	struct //Response from slave should be put here
 	{
 		uint8_t *frame;
-		uint8_t length;
+		uint16_t length;
 	} response;
 
 	struct //Data read from slave
@@ -66,6 +72,11 @@ typedef struct
 		uint8_t code; //Exception code
 	} exception;
 
+	const ModbusMasterHandler *functions; //Response handlers indexed by function code (256 entries), NULL means built-in ones
+
+	uint8_t tcp; //Use Modbus TCP framing (MBAP header instead of address, no CRC)
+	uint16_t transaction; //Modbus TCP transaction identifier of the last built request
+
 } ModbusMaster; //Type containing master device configuration data
 
 #endif
@@ -23,6 +23,11 @@
 
 #include <inttypes.h>
 
+//Modbus TCP frame is MBAP header followed by PDU - unit identifier (last byte of the header) takes place of slave address
+//That's why RTU frame structures below can be used with TCP frames shifted by MODBUS_TCP_OFFSET bytes (CRC is simply not there)
+#define MODBUS_TCP_OFFSET 6
+#define MODBUS_TCP_MAX_LENGTH 260
+
 union ModbusParser
 {
 	uint8_t frame[256];
@@ -41,6 +46,15 @@ union ModbusParser
 		uint16_t crc;
 	} exception;
 
+	struct __attribute__( ( __packed__ ) )
+	{
+		uint16_t transaction;
+		uint16_t protocol;
+		uint16_t length;
+		uint8_t unit;
+		uint8_t function;
+	} mbap; //Modbus TCP header (all values are big-endian)
+
 	struct __attribute__( ( __packed__ ) )
 	{
 		uint8_t address;
@@ -0,0 +1,61 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTMODBUS_RTU_H
+#define LIGHTMODBUS_RTU_H
+
+#include <inttypes.h>
+
+#include "core.h"
+
+//Modbus RTU receiver states
+#define MODBUS_RTU_INIT 0 //Waiting for t3.5 of silence before accepting frames
+#define MODBUS_RTU_IDLE 1 //Waiting for first byte of frame
+#define MODBUS_RTU_RECEIVING 2 //Receiving frame
+#define MODBUS_RTU_DAMAGED 3 //Frame was broken (gap longer than t1.5 or overflow) - waiting for t3.5 to drop it
+#define MODBUS_RTU_FRAME 4 //Complete frame is available
+
+//Maximum length of Modbus RTU frame
+#define MODBUS_RTU_MAX_LENGTH 256
+
+//Frame assembler for byte-by-byte reception (eg. from UART interrupt)
+//All times are given in microseconds, and are allowed to wrap around
+typedef struct
+{
+	uint8_t *frame; //Receive buffer (at least MODBUS_RTU_MAX_LENGTH bytes long)
+	uint16_t length; //Number of bytes received
+	uint16_t crc; //CRC accumulated over received bytes (ready for modbusParseRequestCRC/modbusParseResponseCRC)
+	uint16_t expected; //Expected frame length - frame is finished as soon as it's complete (0 if unknown)
+	uint8_t requests; //Predict lengths of requests for built-in functions (slave side)
+	uint16_t dropped; //Number of frames dropped due to timing or length errors
+	uint32_t t15; //Maximum gap between bytes of a frame
+	uint32_t t35; //Minimum gap between frames
+	uint32_t last; //Time of last byte (or state change)
+	uint8_t state; //Receiver state
+	uint8_t pending; //Is first byte of next frame waiting in next
+	uint8_t next; //First byte of next frame, received while previous one was finished
+} ModbusRTUReceiver;
+
+//Function prototypes
+extern uint8_t modbusRTUInit( ModbusRTUReceiver *rx, uint8_t *frame, uint32_t baudrate, uint32_t now ); //Set up receiver for given baudrate
+extern uint8_t modbusRTUReceive( ModbusRTUReceiver *rx, uint8_t byte, uint32_t now ); //Feed received byte, returns receiver state
+extern uint8_t modbusRTUPoll( ModbusRTUReceiver *rx, uint32_t now ); //Check timeouts, returns receiver state
+
+#endif
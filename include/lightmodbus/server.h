@@ -0,0 +1,115 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTMODBUS_SERVER_H
+#define LIGHTMODBUS_SERVER_H
+
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "core.h"
+#include "rtu.h"
+#include "slave.h"
+
+//Modbus TCP and RTU slave server (Linux only) - single-threaded event loop serving many connections and serial lines with one ModbusSlave
+//Server pool runs several such event loops in threads pinned to CPUs, sharing one port (SO_REUSEPORT) and slave data
+
+//Event loop backend - epoll (default) or io_uring (use makefile to choose one)
+#ifndef LIGHTMODBUS_SERVER_URING
+#define LIGHTMODBUS_SERVER_URING 0
+#endif
+
+//Per-connection buffer sizes - receive buffer has to fit at least one whole frame (260 bytes)
+//Transmit buffer collects responses to all requests received in one read, so they're sent with a single write
+#ifndef LIGHTMODBUS_SERVER_RX_BUFFER
+#define LIGHTMODBUS_SERVER_RX_BUFFER 1024
+#endif
+#ifndef LIGHTMODBUS_SERVER_TX_BUFFER
+#define LIGHTMODBUS_SERVER_TX_BUFFER 4096
+#endif
+
+//Maximum number of events handled in one loop iteration
+#ifndef LIGHTMODBUS_SERVER_EVENTS
+#define LIGHTMODBUS_SERVER_EVENTS 64
+#endif
+
+typedef struct
+{
+	int fd; //Connection socket or serial line (-1 if slot is free)
+	uint8_t serial; //Is it serial line (Modbus RTU) rather than TCP connection
+	uint8_t writing; //Is connection waiting for socket to become writable (epoll) or paused until responses are sent (io_uring)
+	uint8_t receiving; //Is receive operation in flight (io_uring)
+	uint8_t closing; //Is connection waiting for pending operations to finish before it's closed (io_uring - 2 if they're not cancelled yet)
+	uint8_t pending; //Number of operations in flight (io_uring)
+	uint16_t parked; //Number of received buffers waiting until responses are sent (io_uring)
+	uint16_t parkedHead, parkedTail; //The first and the last of them (io_uring)
+	uint32_t sending; //Number of bytes being sent (io_uring)
+	uint32_t rxLength; //Number of bytes in receive buffer
+	uint32_t txOffset; //Number of bytes of transmit buffer already sent
+	uint32_t txLength; //Number of bytes in transmit buffer
+	ModbusRTUReceiver receiver; //Frame assembler for serial lines (uses receive buffer)
+	uint8_t rx[LIGHTMODBUS_SERVER_RX_BUFFER]; //Received (possibly incomplete) requests
+	uint8_t tx[LIGHTMODBUS_SERVER_TX_BUFFER]; //Responses waiting to be sent
+} ModbusServerConnection;
+
+typedef struct
+{
+	ModbusSlave *slave; //Slave serving requests
+	int listenFd; //Listening socket
+	int backendFd; //Event loop (epoll or io_uring instance)
+	void *backend; //Additional backend state
+	uint16_t port; //Port server is listening on (useful if 0 was given to modbusServerInit)
+	uint16_t maxConnections; //Maximum number of simultaneous connections (including serial lines)
+	uint16_t connectionCount; //Number of open connections
+	uint16_t serialCount; //Number of serial lines
+	ModbusServerConnection *connections; //Connection slots
+	uint16_t *freeSlots; //Stack of free connection slots
+	uint64_t requests; //Number of requests processed so far
+	pthread_mutex_t *lock; //Lock taken while requests other than reads (functions 1-4) are parsed (NULL if slave data isn't shared)
+} ModbusServer;
+
+typedef struct modbusServerShard
+{
+	ModbusServer server; //Event loop of the thread
+	ModbusSlave slave; //Copy of slave, sharing its data
+	pthread_t thread;
+	struct modbusServerPool *pool;
+	uint8_t started; //Is thread running
+} __attribute__( ( aligned( 64 ) ) ) ModbusServerShard; //Server running in its own thread (aligned, so shards don't share cache lines)
+
+typedef struct modbusServerPool
+{
+	ModbusServerShard *shards;
+	uint16_t shardCount; //Number of threads
+	uint16_t port; //Port servers are listening on
+	volatile uint8_t stop; //Set to make threads exit
+	pthread_mutex_t lock; //Serializes requests modifying slave data - take it when application modifies slave data too
+} ModbusServerPool;
+
+//Function prototypes
+extern uint8_t modbusServerInit( ModbusServer *server, ModbusSlave *slave, const char *address, uint16_t port, uint16_t maxConnections ); //Start listening
+extern uint8_t modbusServerAddSerial( ModbusServer *server, int fd, uint32_t baudrate ); //Serve Modbus RTU requests from serial line
+extern uint8_t modbusServerRun( ModbusServer *server, int timeout ); //Wait for events (up to timeout ms) and handle them
+extern uint8_t modbusServerEnd( ModbusServer *server ); //Close all connections and free memory
+extern uint8_t modbusServerPoolInit( ModbusServerPool *pool, ModbusSlave *slave, const char *address, uint16_t port, uint16_t maxConnections, uint16_t threads ); //Start serving with several threads
+extern uint64_t modbusServerPoolRequests( ModbusServerPool *pool ); //Number of requests processed by all threads so far
+extern uint8_t modbusServerPoolEnd( ModbusServerPool *pool ); //Stop threads, close all connections and free memory
+
+#endif
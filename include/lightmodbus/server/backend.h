@@ -0,0 +1,45 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTMODBUS_SERVER_BACKEND_H
+#define LIGHTMODBUS_SERVER_BACKEND_H
+
+#include <inttypes.h>
+#include "../server.h"
+
+//Event loop backend interface - implemented by src/server/epoll.c and src/server/uring.c
+extern uint8_t modbusServerBackendInit( ModbusServer *server ); //Set up event loop and start accepting connections
+extern uint8_t modbusServerBackendAdd( ModbusServer *server, ModbusServerConnection *conn ); //Start receiving from new connection
+extern uint8_t modbusServerBackendFlush( ModbusServer *server, ModbusServerConnection *conn ); //Send responses from transmit buffer
+extern void modbusServerBackendClose( ModbusServer *server, ModbusServerConnection *conn ); //Close connection
+extern uint8_t modbusServerBackendRun( ModbusServer *server, int timeout ); //Wait for events and handle them
+extern void modbusServerBackendEnd( ModbusServer *server ); //Free event loop resources
+
+//Functions needed from other modules
+extern uint8_t modbusServerListen( ModbusServer *server, ModbusSlave *slave, const char *address, uint16_t port, uint16_t maxConnections, uint8_t reusePort );
+extern ModbusServerConnection *modbusServerOpen( ModbusServer *server, int fd, uint8_t serial );
+extern void modbusServerRelease( ModbusServer *server, ModbusServerConnection *conn );
+extern uint8_t modbusServerProcess( ModbusServer *server, ModbusServerConnection *conn, const uint8_t *data, uint32_t length, uint32_t *used );
+extern uint8_t modbusServerProcessSerial( ModbusServer *server, ModbusServerConnection *conn, const uint8_t *data, uint32_t length, uint32_t now );
+extern uint8_t modbusServerReady( ModbusServerConnection *conn );
+extern int modbusServerPollSerial( ModbusServer *server, int timeout );
+extern uint32_t modbusServerTime( );
+
+#endif
@@ -25,6 +25,7 @@
 
 #include "core.h"
 #include "slave/stypes.h"
+#include "slave/srouter.h"
 
 //Enabling modules in compilation process (use makefile to automate this process)
 #ifndef LIGHTMODBUS_SLAVE_REGISTERS
@@ -34,10 +35,39 @@
 #define LIGHTMODBUS_SLAVE_COILS 0
 #endif
 
+//Static memory mode - response frame is built in buffer pointed by status->response.frame
+//It has to be provided by user before modbusSlaveInit is called, and be at least 256 bytes long
+#ifndef LIGHTMODBUS_STATIC_MEM_SLAVE
+#define LIGHTMODBUS_STATIC_MEM_SLAVE 0
+#endif
+
+//Register seqlocks - reads of registers return consistent snapshot, even if they're updated by another thread at the same time
+//Requires atomic operations (GCC builtins), so it's only available when enabled (slave registers module has to be rebuilt)
+#ifndef LIGHTMODBUS_SLAVE_SEQLOCK
+#define LIGHTMODBUS_SLAVE_SEQLOCK 0
+#endif
+
+//Built-in request handlers, indexed by function code
+//To add custom handlers, copy this table, modify it and set status->functions to point at the copy
+extern const ModbusSlaveHandler modbusSlaveDefaultFunctions[256];
+
 //Function prototypes
+extern uint8_t modbusSlaveAllocateResponse( ModbusSlave *status, uint8_t length ); //Prepare memory for response frame
 extern uint8_t modbusBuildException( ModbusSlave *status, uint8_t function, uint8_t exceptionCode ); //Build an exception
 extern uint8_t modbusParseRequest( ModbusSlave *status ); //Parse and interpret given modbus frame on slave-side
+extern uint8_t modbusParseRequestCRC( ModbusSlave *status, uint16_t crc ); //The same, but with CRC of whole frame already calculated
+extern uint8_t modbusParseRequestInPlace( ModbusSlave *status ); //Parse request and build response in the same buffer
+extern uint8_t modbusParseRequestInPlaceCRC( ModbusSlave *status, uint16_t crc ); //The same, but with CRC of whole frame already calculated
 extern uint8_t modbusSlaveInit( ModbusSlave *status ); //Very basic init of slave side
 extern uint8_t modbusSlaveEnd( ModbusSlave *status ); //Free memory used by slave
+extern uint8_t modbusDirtyRecord( ModbusDirtyLog *log, uint16_t index, uint16_t count ); //Mark range as changed
+extern uint8_t modbusDirtyClear( ModbusDirtyLog *log ); //Forget recorded changes (once they're consumed)
+
+//Register seqlocks (only with LIGHTMODBUS_SLAVE_SEQLOCK, in slave registers module)
+extern void modbusSeqlockBegin( ModbusSeqlock *lock ); //Start batch of register updates (waits for other writers)
+extern void modbusSeqlockEnd( ModbusSeqlock *lock ); //Publish batch of register updates
+extern uint32_t modbusSeqlockReadBegin( ModbusSeqlock *lock ); //Start reading registers (waits for update in progress)
+extern uint8_t modbusSeqlockReadRetry( ModbusSeqlock *lock, uint32_t sequence ); //Check if registers have been updated meanwhile
+extern void modbusPublishRegisters( ModbusSeqlock *lock, uint16_t *registers, uint16_t index, const uint16_t *values, uint16_t count ); //Copy values to registers as one update
 
 #endif
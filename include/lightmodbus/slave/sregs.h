@@ -25,7 +25,9 @@
 #include "stypes.h"
 
 //Functions needed from other modules
+extern uint8_t modbusSlaveAllocateResponse( ModbusSlave *status, uint8_t length );
 extern uint8_t modbusBuildException( ModbusSlave *status, uint8_t function, uint8_t exceptionCode );
+extern uint8_t modbusDirtyRecord( ModbusDirtyLog *log, uint16_t index, uint16_t count );
 
 //Functions for parsing requests
 #define modbusParseRequest03 modbusParseRequest0304
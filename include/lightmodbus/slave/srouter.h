@@ -0,0 +1,52 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTMODBUS_SROUTER_H
+#define LIGHTMODBUS_SROUTER_H
+
+#include <inttypes.h>
+#include "../core.h"
+#include "stypes.h"
+
+//Slave router - passes requests to one of many slaves, picked by address (unit identifier)
+
+typedef struct
+{
+	ModbusSlave *units[256]; //Slaves indexed by address (NULL - no such slave)
+	uint16_t unitCount; //Number of registered slaves
+	uint8_t tcp; //Use Modbus TCP framing (slaves have to use it too)
+
+	struct //Request from master should be put here
+	{
+		uint8_t *frame;
+		uint16_t length;
+	} request;
+
+	ModbusSlave *responder; //Slave whose response should be sent (NULL if there's none)
+} ModbusRouter;
+
+//Function prototypes
+extern uint8_t modbusRouterInit( ModbusRouter *router, uint8_t tcp ); //Set up router with no slaves
+extern uint8_t modbusRouterAdd( ModbusRouter *router, ModbusSlave *slave ); //Register slave under its address
+extern uint8_t modbusRouterRemove( ModbusRouter *router, uint8_t address ); //Unregister slave
+extern uint8_t modbusRouterParseRequest( ModbusRouter *router ); //Pass request to slave it's addressed to
+extern uint8_t modbusRouterParseRequestCRC( ModbusRouter *router, uint16_t crc ); //The same, but with CRC of whole frame already calculated
+
+#endif
@@ -26,7 +26,67 @@
 
 //Declarations for slave types
 
+union ModbusParser;
+struct modbusSlave;
+
+//Request handler - gets parsed request and builds response (see modbusParseRequest0304 etc.)
+typedef uint8_t ( *ModbusSlaveHandler )( struct modbusSlave *status, union ModbusParser *parser );
+
+//Sequence lock guarding register array shared between threads (see modbusSeqlockBegin)
+//Sequence is odd while update is in progress
+typedef struct
+{
+	volatile uint32_t sequence;
+} ModbusSeqlock;
+
+//Range of registers (or coils) changed by master
 typedef struct
+{
+	uint16_t index; //Address of the first changed element
+	uint32_t count; //Number of changed elements (merged ranges may cover all 65536 of them)
+} ModbusDirtyRange;
+
+//Log of changes made by master (see modbusDirtyRecord)
+//Ranges are kept sorted and merged - when there's no room left, the closest ones are merged, so changes are never lost
+typedef struct
+{
+	ModbusDirtyRange *ranges; //Changed ranges, sorted by address (array provided by user)
+	uint16_t capacity; //Length of ranges array
+	uint16_t count; //Number of ranges recorded
+	uint32_t generation; //Incremented with every recorded write
+} ModbusDirtyLog;
+
+struct modbusRegisterSegment;
+struct modbusCoilSegment;
+
+//Segment callbacks - read (write = 0) or write count values starting at index, all in one call
+//Register values are given in host byte order, coils are packed into bytes (starting from the least significant bit)
+//Return 0 on success, or Modbus exception code to be sent to master
+typedef uint8_t ( *ModbusRegisterCallback )( struct modbusSlave *status, const struct modbusRegisterSegment *segment, uint8_t write, uint16_t index, uint16_t count, uint16_t *values );
+typedef uint8_t ( *ModbusCoilCallback )( struct modbusSlave *status, const struct modbusCoilSegment *segment, uint8_t write, uint16_t index, uint16_t count, uint8_t *values );
+
+//Segment of register map - registers from base to base + count - 1 are stored in values array
+//If callback is set, it's used to access registers instead (and values may be NULL)
+typedef struct modbusRegisterSegment
+{
+	uint16_t base; //Address of the first register
+	uint16_t count; //Register count
+	uint16_t *values; //Register values
+	ModbusRegisterCallback callback; //Register access callback (NULL if not used)
+	void *context; //User data for callback
+} ModbusRegisterSegment;
+
+//Segment of coil (or discrete input) map - the same as above, but values are bits
+typedef struct modbusCoilSegment
+{
+	uint16_t base; //Address of the first coil
+	uint16_t count; //Coil count
+	uint8_t *values; //Coil values (each bit matches one coil)
+	ModbusCoilCallback callback; //Coil access callback (NULL if not used)
+	void *context; //User data for callback
+} ModbusCoilSegment;
+
+typedef struct modbusSlave
 {
 	uint8_t address; //Slave address
 
@@ -39,6 +99,12 @@ typedef struct
 	uint8_t *discreteInputs; //Slave discrete input
 	uint16_t discreteInputCount; //Slave discrete input count
 
+	//Sparse coil and discrete input maps - when set, they're used instead of coils and discreteInputs arrays
+	const ModbusCoilSegment *coilSegments; //Coil segments
+	uint16_t coilSegmentCount;
+	const ModbusCoilSegment *discreteInputSegments; //Discrete input segments
+	uint16_t discreteInputSegmentCount;
+
 	uint8_t *registerMask; //Masks for register write protection (bit of value 1 - write protection)
 	uint16_t registerMaskLength; //Masks length (each byte covers 8 registers)
 	uint8_t *coilMask; //Masks for coil write protection (bit of value 1 - write protection)
@@ -47,16 +113,33 @@ typedef struct
 	uint16_t *inputRegisters; //Slave input registers
 	uint16_t inputRegisterCount; //Slave input count
 
+	//Sparse register maps - when set, they're used instead of registers and inputRegisters arrays
+	//Segments have to be sorted by base address and can't overlap
+	const ModbusRegisterSegment *registerSegments; //Holding register segments
+	uint16_t registerSegmentCount;
+	const ModbusRegisterSegment *inputRegisterSegments; //Input register segments
+	uint16_t inputRegisterSegmentCount;
+
+	ModbusSeqlock *registerLock; //Seqlock of holding registers, so reads are consistent with concurrent updates (NULL if not used)
+	ModbusSeqlock *inputRegisterLock; //Seqlock of input registers (NULL if not used)
+
+	ModbusDirtyLog *registerChanges; //Holding registers written by master (NULL if not tracked)
+	ModbusDirtyLog *coilChanges; //Coils written by master (NULL if not tracked)
+
+	const ModbusSlaveHandler *functions; //Request handlers indexed by function code (256 entries), NULL means built-in ones
+
+	uint8_t tcp; //Use Modbus TCP framing (MBAP header instead of address, no CRC)
+
 	struct //Slave response formatting status
 	{
 		uint8_t *frame;
-		uint8_t length;
+		uint16_t length;
 	} response;
 
 	struct //Request from master should be put here
 	{
 		uint8_t *frame;
-		uint8_t length;
+		uint16_t length;
 	} request;
 
 } ModbusSlave; //Type containing slave device configuration data
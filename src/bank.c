@@ -0,0 +1,390 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <lightmodbus/core.h>
+#include <lightmodbus/slave.h>
+#include <lightmodbus/bank.h>
+
+#if !LIGHTMODBUS_SLAVE_SEQLOCK
+#error "Shared memory banks need LIGHTMODBUS_SLAVE_SEQLOCK"
+#endif
+
+//Shared memory register bank - one data plane for slave and any number of producer processes
+//
+//Holding and input registers are guarded with seqlocks kept in bank header - slave takes them
+//while serving requests (registerLock and inputRegisterLock point into the bank), and so does modbusBankWrite
+//Coils aren't guarded - each one is always read and written whole, but read of several coils may see another write half-done
+//Coils are set one by one with atomic operations, both by modbusBankWrite and by slave (bank coil segments have callback
+//doing that), so concurrent writers never lose each other's changes
+//
+//If process is killed while updating registers, sequence stays odd and the bank has to be created again
+
+static uint32_t modbusBankDataLength( uint8_t type, uint16_t count )
+{
+	//Length of segment data, rounded up to 8 bytes
+	uint32_t length;
+
+	if ( type == MODBUS_BANK_HOLDING_REGISTERS || type == MODBUS_BANK_INPUT_REGISTERS ) length = (uint32_t) count << 1;
+	else length = BITSTOBYTES( (uint32_t) count );
+
+	return ( length + 7 ) & ~7UL;
+}
+
+static void modbusBankSetCoils( const ModbusCoilSegment *segment, uint16_t index, uint16_t count, const uint8_t *values )
+{
+	//Set coils one by one with atomic operations, so bits of the same byte written by other process aren't lost
+	uint32_t bit;
+	uint16_t i;
+	uint8_t mask;
+
+	for ( i = 0; i < count; i++ )
+	{
+		bit = index - segment->base + i;
+		mask = 1 << ( bit & 7 );
+		if ( values[i >> 3] & ( 1 << ( i & 7 ) ) )
+			__atomic_fetch_or( segment->values + ( bit >> 3 ), mask, __ATOMIC_RELAXED );
+		else
+			__atomic_fetch_and( segment->values + ( bit >> 3 ), (uint8_t) ~mask, __ATOMIC_RELAXED );
+	}
+}
+
+static uint8_t modbusBankCoilCallback( ModbusSlave *status, const ModbusCoilSegment *segment, uint8_t write, uint16_t index, uint16_t count, uint8_t *values )
+{
+	//Coil access for slave - writes are done the same way as by modbusBankWrite
+	if ( write ) modbusBankSetCoils( segment, index, count, values );
+	else if ( modbusMaskCopy( values, BITSTOBYTES( count ), 0, segment->values, BITSTOBYTES( segment->count ), index - segment->base, count ) ) return MODBUS_EXCEP_SLAVE_FAIL;
+	return 0;
+}
+
+static uint8_t modbusBankMap( ModbusBank *bank )
+{
+	//Check bank layout and build segment tables pointing into mapped memory
+	ModbusBankHeader *header = bank->header;
+	const ModbusBankSegment *table = (const ModbusBankSegment *)( header + 1 );
+	ModbusRegisterSegment *registerSegment;
+	ModbusCoilSegment *coilSegment;
+	uint32_t tableEnd, end[4] = { 0 };
+	uint16_t registers, coils, i;
+	uint8_t kind;
+
+	if ( __atomic_load_n( &header->magic, __ATOMIC_ACQUIRE ) != MODBUS_BANK_MAGIC ) return MODBUS_ERROR_OTHER;
+	if ( header->version != MODBUS_BANK_VERSION || header->size != bank->size ) return MODBUS_ERROR_OTHER;
+
+	tableEnd = sizeof( ModbusBankHeader ) + (uint32_t) header->segmentCount * sizeof( ModbusBankSegment );
+	if ( tableEnd > bank->size ) return MODBUS_ERROR_OTHER;
+
+	for ( i = 0; i < header->segmentCount; i++ )
+	{
+		switch ( table[i].type )
+		{
+			case MODBUS_BANK_HOLDING_REGISTERS:
+				kind = 0;
+				bank->registerSegmentCount++;
+				break;
+
+			case MODBUS_BANK_INPUT_REGISTERS:
+				kind = 1;
+				bank->inputRegisterSegmentCount++;
+				break;
+
+			case MODBUS_BANK_COILS:
+				kind = 2;
+				bank->coilSegmentCount++;
+				break;
+
+			case MODBUS_BANK_DISCRETE_INPUTS:
+				kind = 3;
+				bank->discreteInputSegmentCount++;
+				break;
+
+			default:
+				return MODBUS_ERROR_OTHER;
+		}
+
+		//Segments of each type have to be sorted and can't overlap
+		if ( table[i].count == 0 || table[i].base < end[kind] ) return MODBUS_ERROR_OTHER;
+		end[kind] = (uint32_t) table[i].base + table[i].count;
+		if ( end[kind] > 65536 ) return MODBUS_ERROR_OTHER;
+
+		//Segment data has to be aligned and lie within the bank
+		if ( table[i].offset < tableEnd || ( table[i].offset & 7 ) ) return MODBUS_ERROR_OTHER;
+		if ( (uint64_t) table[i].offset + modbusBankDataLength( table[i].type, table[i].count ) > bank->size ) return MODBUS_ERROR_OTHER;
+	}
+
+	//Register and coil segments of both kinds share one allocation
+	registers = bank->registerSegmentCount + bank->inputRegisterSegmentCount;
+	coils = bank->coilSegmentCount + bank->discreteInputSegmentCount;
+	if ( registers && ( bank->registerSegments = (ModbusRegisterSegment *) calloc( registers, sizeof( ModbusRegisterSegment ) ) ) == NULL ) return MODBUS_ERROR_ALLOC;
+	if ( coils && ( bank->coilSegments = (ModbusCoilSegment *) calloc( coils, sizeof( ModbusCoilSegment ) ) ) == NULL ) return MODBUS_ERROR_ALLOC;
+	if ( bank->inputRegisterSegmentCount ) bank->inputRegisterSegments = bank->registerSegments + bank->registerSegmentCount;
+	if ( bank->discreteInputSegmentCount ) bank->discreteInputSegments = bank->coilSegments + bank->coilSegmentCount;
+
+	//Fill tables in bank order
+	registerSegment = bank->registerSegments;
+	coilSegment = bank->coilSegments;
+	for ( kind = 0; kind < 4; kind++ )
+	{
+		for ( i = 0; i < header->segmentCount; i++ )
+		{
+			if ( table[i].type != 1 << kind ) continue;
+
+			if ( kind < 2 )
+			{
+				registerSegment->base = table[i].base;
+				registerSegment->count = table[i].count;
+				registerSegment->values = (uint16_t *)( (uint8_t *) header + table[i].offset );
+				registerSegment++;
+			}
+			else
+			{
+				coilSegment->base = table[i].base;
+				coilSegment->count = table[i].count;
+				coilSegment->values = (uint8_t *) header + table[i].offset;
+				coilSegment->callback = modbusBankCoilCallback;
+				coilSegment++;
+			}
+		}
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+static ModbusRegisterSegment *modbusBankFindRegisters( ModbusBank *bank, uint8_t type, uint16_t index, uint16_t count )
+{
+	//Find register segment holding whole range
+	ModbusRegisterSegment *segments = type == MODBUS_BANK_HOLDING_REGISTERS ? bank->registerSegments : bank->inputRegisterSegments;
+	uint16_t segmentCount = type == MODBUS_BANK_HOLDING_REGISTERS ? bank->registerSegmentCount : bank->inputRegisterSegmentCount;
+	uint16_t i;
+
+	for ( i = 0; i < segmentCount; i++ )
+		if ( index >= segments[i].base && (uint32_t) index + count <= (uint32_t) segments[i].base + segments[i].count )
+			return segments + i;
+
+	return NULL;
+}
+
+static ModbusCoilSegment *modbusBankFindCoils( ModbusBank *bank, uint8_t type, uint16_t index, uint16_t count )
+{
+	//Find coil (or discrete input) segment holding whole range
+	ModbusCoilSegment *segments = type == MODBUS_BANK_COILS ? bank->coilSegments : bank->discreteInputSegments;
+	uint16_t segmentCount = type == MODBUS_BANK_COILS ? bank->coilSegmentCount : bank->discreteInputSegmentCount;
+	uint16_t i;
+
+	for ( i = 0; i < segmentCount; i++ )
+		if ( index >= segments[i].base && (uint32_t) index + count <= (uint32_t) segments[i].base + segments[i].count )
+			return segments + i;
+
+	return NULL;
+}
+
+uint8_t modbusBankCreate( ModbusBank *bank, const char *name, const ModbusBankSegment *segments, uint16_t segmentCount )
+{
+	//Create new shared memory object (it can't exist yet), lay segments out in it and map it
+	ModbusBankHeader *header;
+	ModbusBankSegment *table;
+	uint64_t size;
+	uint16_t i;
+	uint8_t err;
+	int fd;
+
+	if ( bank == NULL ) return MODBUS_ERROR_OTHER;
+	memset( bank, 0, sizeof( ModbusBank ) );
+	if ( name == NULL || ( segments == NULL && segmentCount != 0 ) ) return MODBUS_ERROR_OTHER;
+
+	//Data of segments follows segment table, in the same order
+	size = ( sizeof( ModbusBankHeader ) + (uint32_t) segmentCount * sizeof( ModbusBankSegment ) + 7 ) & ~7UL;
+	for ( i = 0; i < segmentCount; i++ )
+		size += modbusBankDataLength( segments[i].type, segments[i].count );
+	if ( size > UINT32_MAX ) return MODBUS_ERROR_OTHER;
+
+	//New object is filled with zeros
+	if ( ( fd = shm_open( name, O_RDWR | O_CREAT | O_EXCL, 0660 ) ) < 0 ) return MODBUS_ERROR_OTHER;
+	if ( ftruncate( fd, size ) )
+	{
+		close( fd );
+		shm_unlink( name );
+		return MODBUS_ERROR_OTHER;
+	}
+
+	header = (ModbusBankHeader *) mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( header == MAP_FAILED )
+	{
+		shm_unlink( name );
+		return MODBUS_ERROR_ALLOC;
+	}
+
+	bank->header = header;
+	bank->size = size;
+
+	//Fill header and segment table
+	header->version = MODBUS_BANK_VERSION;
+	header->segmentCount = segmentCount;
+	header->size = size;
+	table = (ModbusBankSegment *)( header + 1 );
+	size = ( sizeof( ModbusBankHeader ) + (uint32_t) segmentCount * sizeof( ModbusBankSegment ) + 7 ) & ~7UL;
+	for ( i = 0; i < segmentCount; i++ )
+	{
+		table[i].type = segments[i].type;
+		table[i].base = segments[i].base;
+		table[i].count = segments[i].count;
+		table[i].offset = size;
+		size += modbusBankDataLength( segments[i].type, segments[i].count );
+	}
+
+	//Magic is set last, so nobody opens bank before it's ready
+	__atomic_store_n( &header->magic, MODBUS_BANK_MAGIC, __ATOMIC_RELEASE );
+
+	if ( ( err = modbusBankMap( bank ) ) != MODBUS_ERROR_OK )
+	{
+		modbusBankClose( bank );
+		shm_unlink( name );
+	}
+
+	return err;
+}
+
+uint8_t modbusBankOpen( ModbusBank *bank, const char *name )
+{
+	//Map bank created by another process (or earlier by this one)
+	struct stat info;
+	void *memory;
+	uint8_t err;
+	int fd;
+
+	if ( bank == NULL ) return MODBUS_ERROR_OTHER;
+	memset( bank, 0, sizeof( ModbusBank ) );
+	if ( name == NULL ) return MODBUS_ERROR_OTHER;
+
+	if ( ( fd = shm_open( name, O_RDWR, 0 ) ) < 0 ) return MODBUS_ERROR_OTHER;
+	if ( fstat( fd, &info ) || info.st_size < (off_t) sizeof( ModbusBankHeader ) || (uint64_t) info.st_size > UINT32_MAX )
+	{
+		close( fd );
+		return MODBUS_ERROR_OTHER;
+	}
+
+	memory = mmap( NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( memory == MAP_FAILED ) return MODBUS_ERROR_ALLOC;
+
+	bank->header = (ModbusBankHeader *) memory;
+	bank->size = info.st_size;
+
+	if ( ( err = modbusBankMap( bank ) ) != MODBUS_ERROR_OK ) modbusBankClose( bank );
+	return err;
+}
+
+uint8_t modbusBankAttach( ModbusBank *bank, ModbusSlave *status )
+{
+	//Point slave's segment tables and register seqlocks at the bank
+	//It has to be done before modbusSlaveInit, which checks segments
+	if ( bank == NULL || bank->header == NULL || status == NULL ) return MODBUS_ERROR_OTHER;
+
+	status->registerSegments = bank->registerSegments;
+	status->registerSegmentCount = bank->registerSegmentCount;
+	status->inputRegisterSegments = bank->inputRegisterSegments;
+	status->inputRegisterSegmentCount = bank->inputRegisterSegmentCount;
+	status->coilSegments = bank->coilSegments;
+	status->coilSegmentCount = bank->coilSegmentCount;
+	status->discreteInputSegments = bank->discreteInputSegments;
+	status->discreteInputSegmentCount = bank->discreteInputSegmentCount;
+	status->registerLock = &bank->header->registerLock;
+	status->inputRegisterLock = &bank->header->inputRegisterLock;
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusBankWrite( ModbusBank *bank, uint8_t type, uint16_t index, uint16_t count, const void *values )
+{
+	//Write count registers (or coils) starting at index - range has to lie within one segment
+	//Registers are updated under seqlock, so readers see either all of them or none
+	//Coils are set one by one with atomic operations, so concurrent writers don't lose each other's changes
+	ModbusRegisterSegment *registerSegment;
+	ModbusCoilSegment *coilSegment;
+
+	if ( bank == NULL || bank->header == NULL || values == NULL || count == 0 ) return MODBUS_ERROR_OTHER;
+
+	if ( type == MODBUS_BANK_HOLDING_REGISTERS || type == MODBUS_BANK_INPUT_REGISTERS )
+	{
+		if ( ( registerSegment = modbusBankFindRegisters( bank, type, index, count ) ) == NULL ) return MODBUS_ERROR_OTHER;
+		modbusPublishRegisters( type == MODBUS_BANK_HOLDING_REGISTERS ? &bank->header->registerLock : &bank->header->inputRegisterLock, \
+			registerSegment->values, index - registerSegment->base, (const uint16_t *) values, count );
+		return MODBUS_ERROR_OK;
+	}
+
+	if ( type != MODBUS_BANK_COILS && type != MODBUS_BANK_DISCRETE_INPUTS ) return MODBUS_ERROR_OTHER;
+	if ( ( coilSegment = modbusBankFindCoils( bank, type, index, count ) ) == NULL ) return MODBUS_ERROR_OTHER;
+
+	modbusBankSetCoils( coilSegment, index, count, (const uint8_t *) values );
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusBankRead( ModbusBank *bank, uint8_t type, uint16_t index, uint16_t count, void *values )
+{
+	//Read count registers (or coils) starting at index - range has to lie within one segment
+	//Registers read are never a mix of two updates
+	ModbusRegisterSegment *registerSegment;
+	ModbusCoilSegment *coilSegment;
+	ModbusSeqlock *lock;
+	uint32_t sequence;
+
+	if ( bank == NULL || bank->header == NULL || values == NULL || count == 0 ) return MODBUS_ERROR_OTHER;
+
+	if ( type == MODBUS_BANK_HOLDING_REGISTERS || type == MODBUS_BANK_INPUT_REGISTERS )
+	{
+		if ( ( registerSegment = modbusBankFindRegisters( bank, type, index, count ) ) == NULL ) return MODBUS_ERROR_OTHER;
+		lock = type == MODBUS_BANK_HOLDING_REGISTERS ? &bank->header->registerLock : &bank->header->inputRegisterLock;
+
+		do
+		{
+			sequence = modbusSeqlockReadBegin( lock );
+			memcpy( values, registerSegment->values + ( index - registerSegment->base ), count << 1 );
+		}
+		while ( modbusSeqlockReadRetry( lock, sequence ) );
+
+		return MODBUS_ERROR_OK;
+	}
+
+	if ( type != MODBUS_BANK_COILS && type != MODBUS_BANK_DISCRETE_INPUTS ) return MODBUS_ERROR_OTHER;
+	if ( ( coilSegment = modbusBankFindCoils( bank, type, index, count ) ) == NULL ) return MODBUS_ERROR_OTHER;
+
+	memset( values, 0, BITSTOBYTES( count ) );
+	return modbusMaskCopy( (uint8_t *) values, BITSTOBYTES( count ), 0, coilSegment->values, BITSTOBYTES( coilSegment->count ), index - coilSegment->base, count );
+}
+
+uint8_t modbusBankClose( ModbusBank *bank )
+{
+	//Unmap bank - shared memory object stays until it's removed with shm_unlink
+	if ( bank == NULL ) return MODBUS_ERROR_OTHER;
+
+	free( bank->registerSegments );
+	free( bank->coilSegments );
+	if ( bank->header != NULL ) munmap( bank->header, bank->size );
+	memset( bank, 0, sizeof( ModbusBank ) );
+
+	return MODBUS_ERROR_OK;
+}
@@ -25,6 +25,93 @@
 #include <lightmodbus/master/mpregs.h>
 #include <lightmodbus/master/mpcoils.h>
 
+//Built-in response handlers - only enabled modules are linked in
+const ModbusMasterHandler modbusMasterDefaultFunctions[256] =
+{
+	#if LIGHTMODBUS_MASTER_COILS
+	[1] = modbusParseResponse0102, //Read multiple coils
+	[2] = modbusParseResponse0102, //Read multiple discrete inputs
+	[5] = modbusParseResponse05, //Write single coil
+	[15] = modbusParseResponse15, //Write multiple coils
+	#endif
+
+	#if LIGHTMODBUS_MASTER_REGISTERS
+	[3] = modbusParseResponse0304, //Read multiple holding registers
+	[4] = modbusParseResponse0304, //Read multiple input registers
+	[6] = modbusParseResponse06, //Write single holding reg
+	[16] = modbusParseResponse16, //Write multiple holding registers
+	[22] = modbusParseResponse22, //Mask write holding register
+	#endif
+};
+
+uint8_t modbusMasterAllocateRequest( ModbusMaster *status, uint8_t length )
+{
+	//Prepare request frame memory for RTU frame of given length (in Modbus TCP mode there's room for MBAP header instead of CRC)
+	//In static memory mode, buffer provided by user (at least 256 bytes long, 260 for Modbus TCP) is used instead
+
+	//Check if given pointer is valid
+	if ( status == NULL ) return MODBUS_ERROR_OTHER;
+
+	#if LIGHTMODBUS_STATIC_MEM_MASTER
+	if ( status->request.frame == NULL ) return MODBUS_ERROR_ALLOC;
+	#else
+	free( status->request.frame );
+	status->request.frame = (uint8_t *) calloc( status->tcp ? length - 2 + MODBUS_TCP_OFFSET : length, sizeof( uint8_t ) );
+	if ( status->request.frame == NULL ) return MODBUS_ERROR_ALLOC;
+	#endif
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusMasterFinishRequest( ModbusMaster *status, uint8_t length )
+{
+	//Finish request built by modbusBuildRequest functions - length is RTU frame length (including CRC)
+	//RTU frame gets CRC appended, and Modbus TCP frame gets MBAP header with next transaction identifier
+
+	uint16_t crc;
+
+	//Check if given pointer is valid
+	if ( status == NULL || status->request.frame == NULL || length < 4 ) return MODBUS_ERROR_OTHER;
+
+	if ( status->tcp )
+	{
+		union ModbusParser *builder = (union ModbusParser *) status->request.frame;
+		builder->mbap.transaction = modbusSwapEndian( ++status->transaction );
+		builder->mbap.protocol = 0;
+		builder->mbap.length = modbusSwapEndian( length - 2 );
+		if ( status->predictedResponseLength ) status->predictedResponseLength += MODBUS_TCP_OFFSET - 2;
+		status->request.length = length - 2 + MODBUS_TCP_OFFSET;
+	}
+	else
+	{
+		crc = modbusCRC( status->request.frame, length - 2 );
+		memcpy( status->request.frame + length - 2, &crc, 2 );
+		status->request.length = length;
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusMasterAllocateDataBuffer( ModbusMaster *status, uint16_t size )
+{
+	//Prepare memory for data read from slave (size in bytes)
+	//In static memory mode, arrays provided by user (250 bytes for coils, 125 registers) are used instead
+
+	//Check if given pointer is valid
+	if ( status == NULL ) return MODBUS_ERROR_OTHER;
+
+	#if LIGHTMODBUS_STATIC_MEM_MASTER
+	if ( status->data.coils == NULL || status->data.regs == NULL ) return MODBUS_ERROR_ALLOC;
+	#else
+	free( status->data.coils );
+	status->data.coils = (uint8_t *) calloc( size, sizeof( uint8_t ) );
+	status->data.regs = (uint16_t *) status->data.coils;
+	if ( status->data.coils == NULL ) return MODBUS_ERROR_ALLOC;
+	#endif
+
+	return MODBUS_ERROR_OK;
+}
+
 uint8_t modbusParseException( ModbusMaster *status, union ModbusParser *parser )
 {
 	//Parse exception frame and write data to MODBUSMaster structure
@@ -40,32 +127,43 @@ uint8_t modbusParseException( ModbusMaster *status, union ModbusParser *parser )
 	return MODBUS_ERROR_EXCEPTION;
 }
 
-uint8_t modbusParseResponse( ModbusMaster *status )
+static void modbusMasterResetData( ModbusMaster *status )
 {
-	//This function parses response from master
-	//Calling it will lead to losing all data and exceptions stored in MODBUSMaster (space will be reallocated)
-
-	//Note: crc is now checked here
-
-	//If non-zero some parser failed its job
-	uint8_t err = 0;
+	//Reset data and exception read from slave (before parsing another response)
 
-	//Check if given pointer is valid
-	if ( status == NULL ) return MODBUS_ERROR_OTHER;
-
-	//Reset output registers before parsing frame
 	status->exception.address = 0;
 	status->exception.function = 0;
 	status->exception.code = 0;
+	#if !LIGHTMODBUS_STATIC_MEM_MASTER
 	free( status->data.coils );
 	status->data.coils = NULL;
 	status->data.regs = NULL;
+	#endif
 	status->data.length = 0;
 	status->data.index = 0;
 	status->data.count = 0;
 	status->data.type = 0;
 	status->data.address = 0;
 	status->data.function = 0;
+}
+
+static uint8_t modbusParseResponseRTU( ModbusMaster *status, uint16_t crc )
+{
+	//This function parses response from master
+	//Calling it will lead to losing all data and exceptions stored in MODBUSMaster (space will be reallocated)
+
+	//CRC has been already calculated over whole response frame (including CRC field), eg. while it was being received
+	//Request frame is not checked here - it should be built using modbusBuildRequest functions
+
+	//If non-zero some parser failed its job
+	uint8_t err = 0;
+	ModbusMasterHandler handler;
+
+	//Check if given pointer is valid
+	if ( status == NULL ) return MODBUS_ERROR_OTHER;
+
+	//Reset output registers before parsing frame
+	modbusMasterResetData( status );
 
 	//Check if frames are not too short and return error (to avoid problems with memory allocation)
 	//That enables us to ommit the check in each parsing function
@@ -73,12 +171,8 @@ uint8_t modbusParseResponse( ModbusMaster *status )
 	 	status->request.length < 4u || status->request.frame == NULL )
 			return MODBUS_ERROR_OTHER;
 
-	//Check both response and request frames CRC
-	if ( *( (uint16_t*)( status->response.frame + status->response.length - 2 ) )\
-		!= modbusCRC( status->response.frame, status->response.length - 2 ) ||\
-		*( (uint16_t*)( status->request.frame + status->request.length - 2 ) ) \
-		!= modbusCRC( status->request.frame, status->request.length - 2 ) )
-			return MODBUS_ERROR_CRC;
+	//Check response CRC - remainder of frame with valid CRC is 0
+	if ( modbusCRCFinal( crc ) != 0 ) return MODBUS_ERROR_CRC;
 
 	union ModbusParser *parser = (union ModbusParser*) status->response.frame;
 	union ModbusParser *requestParser = (union ModbusParser*) status->request.frame;
@@ -90,65 +184,85 @@ uint8_t modbusParseResponse( ModbusMaster *status )
 	}
 	else
 	{
-		switch ( parser->base.function )
-		{
-			case 1: //Read multiple coils
-			case 2: //Read multiple discrete inputs
-				if ( LIGHTMODBUS_MASTER_COILS ) err = modbusParseResponse0102( status, parser, requestParser );
-				else err = MODBUS_ERROR_PARSE;
-				break;
-
-			case 3: //Read multiple holding registers
-			case 4: //Read multiple input registers
-				if ( LIGHTMODBUS_MASTER_REGISTERS ) err = modbusParseResponse0304( status, parser, requestParser );
-				else err = MODBUS_ERROR_PARSE;
-				break;
-
-			case 5: //Write single coil
-				if ( LIGHTMODBUS_MASTER_COILS ) err = modbusParseResponse05( status, parser, requestParser );
-				else err = MODBUS_ERROR_PARSE;
-				break;
-
-			case 6: //Write single holding reg
-				if ( LIGHTMODBUS_MASTER_REGISTERS ) err = modbusParseResponse06( status, parser, requestParser );
-				else err = MODBUS_ERROR_PARSE;
-				break;
-
-			case 15: //Write multiple coils
-				if ( LIGHTMODBUS_MASTER_COILS ) err = modbusParseResponse15( status, parser, requestParser );
-				else err = MODBUS_ERROR_PARSE;
-				break;
-
-			case 16: //Write multiple holding registers
-				if ( LIGHTMODBUS_MASTER_REGISTERS ) err = modbusParseResponse16( status, parser, requestParser );
-				else err = MODBUS_ERROR_PARSE;
-				break;
-
-			case 22: //Mask write holding register
-				if ( LIGHTMODBUS_MASTER_REGISTERS ) err = modbusParseResponse22( status, parser, requestParser );
-				else err = MODBUS_ERROR_PARSE;
-				break;
-
-			default: //function code not known by master
-				err = MODBUS_ERROR_PARSE;
-				break;
-		}
+		//Pick response handler - function codes without one are not known by master
+		handler = ( status->functions != NULL ? status->functions : modbusMasterDefaultFunctions )[parser->base.function];
+		err = handler != NULL ? handler( status, parser, requestParser ) : MODBUS_ERROR_PARSE;
 	}
 	return err;
 }
 
+static uint8_t modbusParseResponseTCP( ModbusMaster *status )
+{
+	//Parse Modbus TCP response - after MBAP headers are checked, PDU is parsed in place, just like RTU frame without CRC
+
+	union ModbusParser *parser = (union ModbusParser *) status->response.frame;
+	union ModbusParser *requestParser = (union ModbusParser *) status->request.frame;
+	uint16_t requestLength = status->request.length, responseLength = status->response.length;
+	uint8_t err;
+
+	modbusMasterResetData( status );
+
+	//Both frames have to contain at least MBAP header and function code
+	if ( responseLength < MODBUS_TCP_OFFSET + 2 || parser == NULL || \
+		requestLength < MODBUS_TCP_OFFSET + 2 || requestParser == NULL )
+			return MODBUS_ERROR_OTHER;
+
+	//Response has to belong to the same transaction and its length has to match
+	if ( parser->mbap.transaction != requestParser->mbap.transaction || parser->mbap.protocol != 0 || \
+		modbusSwapEndian( parser->mbap.length ) != responseLength - MODBUS_TCP_OFFSET )
+			return MODBUS_ERROR_FRAME;
+
+	//Skip MBAP headers (unit identifier becomes slave address) and pretend frames have CRC
+	status->request.frame += MODBUS_TCP_OFFSET;
+	status->request.length = requestLength - MODBUS_TCP_OFFSET + 2;
+	status->response.frame += MODBUS_TCP_OFFSET;
+	status->response.length = responseLength - MODBUS_TCP_OFFSET + 2;
+
+	err = modbusParseResponseRTU( status, 0 );
+
+	status->request.frame -= MODBUS_TCP_OFFSET;
+	status->request.length = requestLength;
+	status->response.frame -= MODBUS_TCP_OFFSET;
+	status->response.length = responseLength;
+	return err;
+}
+
+uint8_t modbusParseResponseCRC( ModbusMaster *status, uint16_t crc )
+{
+	//Parse response, with CRC of whole response frame already calculated (Modbus TCP frames have no CRC, so it's ignored)
+
+	//Check if given pointer is valid
+	if ( status == NULL ) return MODBUS_ERROR_OTHER;
+
+	if ( status->tcp ) return modbusParseResponseTCP( status );
+	return modbusParseResponseRTU( status, crc );
+}
+
+uint8_t modbusParseResponse( ModbusMaster *status )
+{
+	//This function parses response from master
+	//Note: crc is now checked here
+
+	//Check if given pointer is valid
+	if ( status == NULL ) return MODBUS_ERROR_OTHER;
+
+	//There's no CRC in Modbus TCP frames
+	if ( status->tcp ) return modbusParseResponseTCP( status );
+
+	//Check both response and request frames CRC - remainder is 0 only if both are valid
+	return modbusParseResponseCRC( status, modbusCRC( status->response.frame, status->response.length ) | \
+		modbusCRC( status->request.frame, status->request.length ) );
+}
+
 uint8_t modbusMasterInit( ModbusMaster *status )
 {
 	//Check if given pointer is valid
 	if ( status == NULL ) return MODBUS_ERROR_OTHER;
 
 	//Very basic init of master side
-	status->request.frame = NULL;
 	status->request.length = 0;
 	status->response.frame = NULL;
 	status->response.length = 0;
-	status->data.coils = NULL;
-	status->data.regs = NULL;
 	status->data.length = 0;
 	status->data.count = 0;
 	status->data.index = 0;
@@ -158,6 +272,18 @@ uint8_t modbusMasterInit( ModbusMaster *status )
 	status->exception.address = 0;
 	status->exception.function = 0;
 	status->exception.code = 0;
+	status->transaction = 0;
+	status->functions = NULL;
+	status->tcp = 0;
+
+	//In static memory mode request frame and data buffers have to be provided by user
+	#if LIGHTMODBUS_STATIC_MEM_MASTER
+	if ( status->request.frame == NULL || status->data.coils == NULL || status->data.regs == NULL ) return MODBUS_ERROR_ALLOC;
+	#else
+	status->request.frame = NULL;
+	status->data.coils = NULL;
+	status->data.regs = NULL;
+	#endif
 
 	return MODBUS_ERROR_OK;
 }
@@ -168,10 +294,13 @@ uint8_t modbusMasterEnd( ModbusMaster *status )
 	if ( status == NULL ) return MODBUS_ERROR_OTHER;
 
 	//Free memory
+	#if !LIGHTMODBUS_STATIC_MEM_MASTER
 	free( status->request.frame );
+	status->request.frame = NULL;
 	free( status->data.coils );
 	status->data.coils = NULL;
 	status->data.regs = NULL;
+	#endif
 
 	return MODBUS_ERROR_OK;
 }
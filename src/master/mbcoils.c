@@ -42,23 +42,18 @@ uint8_t modbusBuildRequest0102( ModbusMaster *status, uint8_t function, uint8_t
 	if ( count == 0 || count > 2000 || address == 0 ) return MODBUS_ERROR_OTHER;
 
 	//Reallocate memory for final frame
-	free( status->request.frame );
-	status->request.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) );
-	if ( status->request.frame == NULL ) return MODBUS_ERROR_ALLOC;
-	union ModbusParser *builder = (union ModbusParser *) status->request.frame;
+	if ( modbusMasterAllocateRequest( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
+	union ModbusParser *builder = (union ModbusParser *)( status->request.frame + ( status->tcp ? MODBUS_TCP_OFFSET : 0 ) );
 
 	builder->base.address = address;
 	builder->base.function = function;
 	builder->request0102.index = modbusSwapEndian( index );
 	builder->request0102.count = modbusSwapEndian( count );
 
-	//Calculate crc
-	builder->request0102.crc = modbusCRC( builder->frame, frameLength - 2 );
-
-	status->request.length = frameLength;
 	status->predictedResponseLength = 4 + 1 + BITSTOBYTES( count );
 
-	return MODBUS_ERROR_OK;
+	//Append CRC or prepend MBAP header - frame is ready
+	return modbusMasterFinishRequest( status, frameLength );
 }
 
 uint8_t modbusBuildRequest05( ModbusMaster *status, uint8_t address, uint16_t index, uint16_t value )
@@ -77,10 +72,8 @@ uint8_t modbusBuildRequest05( ModbusMaster *status, uint8_t address, uint16_t in
 	status->predictedResponseLength = 0;
 
 	//Reallocate memory for final frame
-	free( status->request.frame );
-	status->request.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) );
-	if ( status->request.frame == NULL ) return MODBUS_ERROR_ALLOC;
-	union ModbusParser *builder = (union ModbusParser *) status->request.frame;
+	if ( modbusMasterAllocateRequest( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
+	union ModbusParser *builder = (union ModbusParser *)( status->request.frame + ( status->tcp ? MODBUS_TCP_OFFSET : 0 ) );
 
 	value = ( value != 0 ) ? 0xFF00 : 0x0000;
 
@@ -89,13 +82,10 @@ uint8_t modbusBuildRequest05( ModbusMaster *status, uint8_t address, uint16_t in
 	builder->request05.index = modbusSwapEndian( index );
 	builder->request05.value = modbusSwapEndian( value );
 
-	//Calculate crc
-	builder->request05.crc = modbusCRC( builder->frame, frameLength - 2 );
-
-	status->request.length = frameLength;
 	if ( address ) status->predictedResponseLength = 8;
 
-	return MODBUS_ERROR_OK;
+	//Append CRC or prepend MBAP header - frame is ready
+	return modbusMasterFinishRequest( status, frameLength );
 }
 
 uint8_t modbusBuildRequest15( ModbusMaster *status, uint8_t address, uint16_t index, uint16_t count, uint8_t *values )
@@ -105,7 +95,6 @@ uint8_t modbusBuildRequest15( ModbusMaster *status, uint8_t address, uint16_t in
 
 	//Set frame length
 	uint8_t frameLength = 9 + BITSTOBYTES( count );
-	uint8_t i = 0;
 
 	//Check if given pointer is valid
 	if ( status == NULL ) return MODBUS_ERROR_OTHER;
@@ -118,10 +107,8 @@ uint8_t modbusBuildRequest15( ModbusMaster *status, uint8_t address, uint16_t in
 	if ( values == NULL || count == 0 || count > 1968 ) return MODBUS_ERROR_OTHER;
 
 	//Reallocate memory for final frame
-	free( status->request.frame );
-	status->request.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) );
-	if ( status->request.frame == NULL ) return MODBUS_ERROR_ALLOC;
-	union ModbusParser *builder = (union ModbusParser *) status->request.frame;
+	if ( modbusMasterAllocateRequest( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
+	union ModbusParser *builder = (union ModbusParser *)( status->request.frame + ( status->tcp ? MODBUS_TCP_OFFSET : 0 ) );
 
 	builder->base.address = address;
 	builder->base.function = 15;
@@ -129,17 +116,13 @@ uint8_t modbusBuildRequest15( ModbusMaster *status, uint8_t address, uint16_t in
 	builder->request15.count = modbusSwapEndian( count );
 	builder->request15.length = BITSTOBYTES( count );
 
-	for ( i = 0; i < builder->request15.length; i++ )
-		builder->request15.values[i] = values[i];
-
-
-	//That could be written as a single line, without the temporary variable, but avr-gcc doesn't like that
-	//warning: dereferencing type-punned pointer will break strict-aliasing rules
-	uint16_t *crc = (uint16_t*)( builder->frame + frameLength - 2 );
-	*crc = modbusCRC( builder->frame, frameLength - 2 );
+	//Copy coil values - unused bits of the last byte are cleared
+	builder->request15.values[builder->request15.length - 1] = 0;
+	if ( modbusMaskCopy( builder->request15.values, builder->request15.length, 0, values, builder->request15.length, 0, count ) )
+		return MODBUS_ERROR_OTHER;
 
-	status->request.length = frameLength;
 	if ( address ) status->predictedResponseLength = 4 + 4;
 
-	return MODBUS_ERROR_OK;
+	//Append CRC or prepend MBAP header - frame is ready
+	return modbusMasterFinishRequest( status, frameLength );
 }
@@ -42,22 +42,18 @@ uint8_t modbusBuildRequest0304( ModbusMaster *status, uint8_t function, uint8_t
 	if ( count == 0 || count > 125 || address == 0 ) return MODBUS_ERROR_OTHER;
 
 	//Reallocate memory for final frame
-	free( status->request.frame );
-	status->request.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) );
-	if ( status->request.frame == NULL ) return MODBUS_ERROR_ALLOC;
-	union ModbusParser *builder = (union ModbusParser *) status->request.frame;
+	if ( modbusMasterAllocateRequest( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
+	union ModbusParser *builder = (union ModbusParser *)( status->request.frame + ( status->tcp ? MODBUS_TCP_OFFSET : 0 ) );
 
 	builder->base.address = address;
 	builder->base.function = function;
 	builder->request0304.index = modbusSwapEndian( index );
 	builder->request0304.count = modbusSwapEndian( count );
 
-	//Calculate crc
-	builder->request0304.crc = modbusCRC( builder->frame, frameLength - 2 );
-
-	status->request.length = frameLength;
 	status->predictedResponseLength = 4 + 1 + ( count << 1 );
-	return MODBUS_ERROR_OK;
+
+	//Append CRC or prepend MBAP header - frame is ready
+	return modbusMasterFinishRequest( status, frameLength );
 }
 
 uint8_t modbusBuildRequest06( ModbusMaster *status, uint8_t address, uint16_t index, uint16_t value )
@@ -76,22 +72,18 @@ uint8_t modbusBuildRequest06( ModbusMaster *status, uint8_t address, uint16_t in
 	status->predictedResponseLength = 0;
 
 	//Reallocate memory for final frame
-	free( status->request.frame );
-	status->request.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) );
-	if ( status->request.frame == NULL ) return MODBUS_ERROR_ALLOC;
-	union ModbusParser *builder = (union ModbusParser *) status->request.frame;
+	if ( modbusMasterAllocateRequest( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
+	union ModbusParser *builder = (union ModbusParser *)( status->request.frame + ( status->tcp ? MODBUS_TCP_OFFSET : 0 ) );
 
 	builder->base.address = address;
 	builder->base.function = 6;
 	builder->request06.index = modbusSwapEndian( index );
 	builder->request06.value = modbusSwapEndian( value );
 
-	//Calculate crc
-	builder->request06.crc = modbusCRC( builder->frame, frameLength - 2 );
-
-	status->request.length = frameLength;
 	if ( address ) status->predictedResponseLength = 8;
-	return MODBUS_ERROR_OK;
+
+	//Append CRC or prepend MBAP header - frame is ready
+	return modbusMasterFinishRequest( status, frameLength );
 }
 
 uint8_t modbusBuildRequest16( ModbusMaster *status, uint8_t address, uint16_t index, uint16_t count, uint16_t *values )
@@ -101,7 +93,6 @@ uint8_t modbusBuildRequest16( ModbusMaster *status, uint8_t address, uint16_t in
 
 	//Set frame length
 	uint8_t frameLength = 9 + ( count << 1 );
-	uint8_t i = 0;
 
 	//Check if given pointer is valid
 	if ( status == NULL ) return MODBUS_ERROR_OTHER;
@@ -114,10 +105,8 @@ uint8_t modbusBuildRequest16( ModbusMaster *status, uint8_t address, uint16_t in
 	if ( values == NULL || count == 0 || count > 123 ) return MODBUS_ERROR_OTHER;
 
 	//Reallocate memory for final frame
-	free( status->request.frame );
-	status->request.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) );
-	if ( status->request.frame == NULL ) return MODBUS_ERROR_ALLOC;
-	union ModbusParser *builder = (union ModbusParser *) status->request.frame;
+	if ( modbusMasterAllocateRequest( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
+	union ModbusParser *builder = (union ModbusParser *)( status->request.frame + ( status->tcp ? MODBUS_TCP_OFFSET : 0 ) );
 
 	builder->base.address = address;
 	builder->base.function = 16;
@@ -125,15 +114,12 @@ uint8_t modbusBuildRequest16( ModbusMaster *status, uint8_t address, uint16_t in
 	builder->request16.count = modbusSwapEndian( count );
 	builder->request16.length = count << 1;
 
-	for ( i = 0; i < count; i++ )
-		builder->request16.values[i] = modbusSwapEndian( values[i] );
+	modbusSwapEndianBlock( builder->request16.values, values, count );
 
-	builder->request16.values[count] = modbusCRC( builder->frame, frameLength - 2 );
-
-	status->request.length = frameLength;
 	if ( address ) status->predictedResponseLength = 4 + 4;
 
-	return MODBUS_ERROR_OK;
+	//Append CRC or prepend MBAP header - frame is ready
+	return modbusMasterFinishRequest( status, frameLength );
 }
 
 uint8_t modbusBuildRequest22( ModbusMaster *status, uint8_t address, uint16_t index, uint16_t andmask, uint16_t ormask )
@@ -152,10 +138,8 @@ uint8_t modbusBuildRequest22( ModbusMaster *status, uint8_t address, uint16_t in
 	status->predictedResponseLength = 0;
 
 	//Reallocate memory for final frame
-	free( status->request.frame );
-	status->request.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) );
-	if ( status->request.frame == NULL ) return MODBUS_ERROR_ALLOC;
-	union ModbusParser *builder = (union ModbusParser *) status->request.frame;
+	if ( modbusMasterAllocateRequest( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
+	union ModbusParser *builder = (union ModbusParser *)( status->request.frame + ( status->tcp ? MODBUS_TCP_OFFSET : 0 ) );
 
 	builder->base.address = address;
 	builder->base.function = 22;
@@ -163,10 +147,8 @@ uint8_t modbusBuildRequest22( ModbusMaster *status, uint8_t address, uint16_t in
 	builder->request22.andmask = modbusSwapEndian( andmask );
 	builder->request22.ormask = modbusSwapEndian( ormask );
 
-	//Calculate crc
-	builder->request22.crc = modbusCRC( builder->frame, frameLength - 2 );
-
-	status->request.length = frameLength;
 	if ( address ) status->predictedResponseLength = 10;
-	return MODBUS_ERROR_OK;
+
+	//Append CRC or prepend MBAP header - frame is ready
+	return modbusMasterFinishRequest( status, frameLength );
 }
@@ -0,0 +1,219 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <lightmodbus/core.h>
+#include <lightmodbus/master.h>
+#include <lightmodbus/master/mtypes.h>
+#include <lightmodbus/master/mcache.h>
+
+static uint32_t modbusCacheTtl( ModbusCache *cache, uint8_t address, uint8_t function, uint16_t index, uint16_t count )
+{
+	//Get TTL of given read - the shortest one of all rules it overlaps, or the default one
+	const ModbusCacheRule *rule;
+	uint32_t ttl = cache->ttl;
+	uint8_t found = 0;
+	uint16_t i;
+
+	for ( i = 0; i < cache->ruleCount; i++ )
+	{
+		rule = cache->rules + i;
+		if ( ( rule->address == 0 || rule->address == address ) && ( rule->function == 0 || rule->function == function ) && \
+			(uint32_t) rule->index < (uint32_t) index + count && (uint32_t) index < (uint32_t) rule->index + rule->count )
+		{
+			if ( !found || rule->ttl < ttl ) ttl = rule->ttl;
+			found = 1;
+		}
+	}
+
+	return ttl;
+}
+
+uint8_t modbusCacheInit( ModbusCache *cache, uint16_t entryCount, const ModbusCacheRule *rules, uint16_t ruleCount, uint32_t ttl )
+{
+	//Set up cache with entryCount entries
+	//In static memory mode, entries array has to be provided by user
+	uint16_t i;
+
+	//Check if given pointers are valid
+	if ( cache == NULL || entryCount == 0 || ( rules == NULL && ruleCount != 0 ) ) return MODBUS_ERROR_OTHER;
+
+	cache->entryCount = entryCount;
+	cache->rules = rules;
+	cache->ruleCount = ruleCount;
+	cache->ttl = ttl;
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->collapsed = 0;
+
+	#if LIGHTMODBUS_STATIC_MEM_MASTER
+	if ( cache->entries == NULL ) return MODBUS_ERROR_ALLOC;
+	#else
+	cache->entries = (ModbusCacheEntry *) calloc( entryCount, sizeof( ModbusCacheEntry ) );
+	if ( cache->entries == NULL ) return MODBUS_ERROR_ALLOC;
+	#endif
+
+	for ( i = 0; i < entryCount; i++ )
+		cache->entries[i].state = MODBUS_CACHE_EMPTY;
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusCacheLookup( ModbusCache *cache, uint8_t address, uint8_t function, uint16_t index, uint16_t count, uint32_t now, ModbusCacheEntry **entry, uint8_t *result )
+{
+	//Look for data read with given function at time now
+	//Entries containing whole requested range are used, so overlapping reads can be served as well
+	//On MODBUS_CACHE_MISS entry for the response is reserved (entry is NULL if all of them are pending) - request
+	//has to be sent, and then response stored with modbusCacheStore or entry freed with modbusCacheCancel
+	ModbusCacheEntry *e, *pending = NULL, *victim = NULL;
+	uint32_t age, oldest = 0;
+	uint16_t i;
+
+	//Check if given pointers are valid
+	if ( cache == NULL || cache->entries == NULL || entry == NULL || result == NULL ) return MODBUS_ERROR_OTHER;
+
+	//Check request
+	if ( function < 1 || function > 4 || count == 0 || count > ( function <= 2 ? 2000 : 125 ) || \
+		(uint32_t) index + count > 65536 ) return MODBUS_ERROR_OTHER;
+
+	for ( i = 0; i < cache->entryCount; i++ )
+	{
+		e = cache->entries + i;
+		age = now - e->time;
+		if ( e->state != MODBUS_CACHE_EMPTY && e->address == address && e->function == function && \
+			e->index <= index && (uint32_t) index + count <= (uint32_t) e->index + e->count )
+		{
+			if ( e->state == MODBUS_CACHE_VALID && age < e->ttl )
+			{
+				*entry = e;
+				*result = MODBUS_CACHE_HIT;
+				cache->hits++;
+				return MODBUS_ERROR_OK;
+			}
+			if ( e->state == MODBUS_CACHE_PENDING ) pending = e;
+		}
+
+		//Pick entry to be reused - empty one, expired one or the oldest one
+		if ( e->state == MODBUS_CACHE_PENDING ) continue;
+		if ( e->state == MODBUS_CACHE_EMPTY ) age = UINT32_MAX;
+		else if ( age >= e->ttl ) age = UINT32_MAX - 1;
+		if ( victim == NULL || age > oldest )
+		{
+			victim = e;
+			oldest = age;
+		}
+	}
+
+	//Collapse with request in flight
+	if ( pending != NULL )
+	{
+		*entry = pending;
+		*result = MODBUS_CACHE_WAIT;
+		cache->collapsed++;
+		return MODBUS_ERROR_OK;
+	}
+
+	*entry = victim;
+	*result = MODBUS_CACHE_MISS;
+	cache->misses++;
+	if ( victim != NULL )
+	{
+		victim->state = MODBUS_CACHE_PENDING;
+		victim->address = address;
+		victim->function = function;
+		victim->index = index;
+		victim->count = count;
+		victim->time = now;
+		victim->ttl = modbusCacheTtl( cache, address, function, index, count );
+		victim->length = 0;
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusCacheStore( ModbusCache *cache, ModbusCacheEntry *entry, ModbusMaster *master, uint32_t now )
+{
+	//Copy data just parsed by master to pending entry
+	//Data has to match the entry - otherwise MODBUS_ERROR_FRAME is returned
+	//If entry is not pending anymore (it's been invalidated meanwhile), MODBUS_ERROR_OTHER is returned
+
+	//Check if given pointers are valid
+	if ( cache == NULL || cache->entries == NULL || entry == NULL || master == NULL || \
+		entry < cache->entries || entry >= cache->entries + cache->entryCount ) return MODBUS_ERROR_OTHER;
+	if ( entry->state != MODBUS_CACHE_PENDING ) return MODBUS_ERROR_OTHER;
+
+	if ( master->data.address != entry->address || master->data.function != entry->function || \
+		master->data.index != entry->index || master->data.count != entry->count || master->data.coils == NULL || \
+		master->data.length > sizeof( entry->data ) ) return MODBUS_ERROR_FRAME;
+
+	memcpy( entry->data.coils, master->data.coils, master->data.length );
+	entry->length = master->data.length;
+	entry->time = now;
+	entry->state = MODBUS_CACHE_VALID;
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusCacheCancel( ModbusCache *cache, ModbusCacheEntry *entry )
+{
+	//Free entry reserved for request that failed
+	//Check if given pointers are valid
+	if ( cache == NULL || cache->entries == NULL || entry == NULL || \
+		entry < cache->entries || entry >= cache->entries + cache->entryCount ) return MODBUS_ERROR_OTHER;
+
+	if ( entry->state == MODBUS_CACHE_PENDING ) entry->state = MODBUS_CACHE_EMPTY;
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusCacheInvalidate( ModbusCache *cache, uint8_t address, uint8_t function, uint16_t index, uint16_t count )
+{
+	//Drop all entries overlapping given range (function 0 matches all of them) - used when data is written to slave
+	//Pending entries are dropped too, as response may contain old data
+	ModbusCacheEntry *e;
+	uint16_t i;
+
+	//Check if given pointer is valid
+	if ( cache == NULL || cache->entries == NULL ) return MODBUS_ERROR_OTHER;
+
+	for ( i = 0; i < cache->entryCount; i++ )
+	{
+		e = cache->entries + i;
+		if ( e->state != MODBUS_CACHE_EMPTY && e->address == address && ( function == 0 || e->function == function ) && \
+			(uint32_t) e->index < (uint32_t) index + count && (uint32_t) index < (uint32_t) e->index + e->count )
+				e->state = MODBUS_CACHE_EMPTY;
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusCacheEnd( ModbusCache *cache )
+{
+	//Check if given pointer is valid
+	if ( cache == NULL ) return MODBUS_ERROR_OTHER;
+
+	//Free memory
+	#if !LIGHTMODBUS_STATIC_MEM_MASTER
+	free( cache->entries );
+	cache->entries = NULL;
+	#endif
+	cache->entryCount = 0;
+
+	return MODBUS_ERROR_OK;
+}
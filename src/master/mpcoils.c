@@ -51,16 +51,17 @@ uint8_t modbusParseResponse0102( ModbusMaster *status, union ModbusParser *parse
 	//If data is bad abort parsing, and set error flag
 	if ( !dataok ) return MODBUS_ERROR_FRAME;
 
-	status->data.coils = (uint8_t*) calloc( BITSTOBYTES( count ), sizeof( uint8_t ) );
-	status->data.regs = (uint16_t*) status->data.coils;
-	if ( status->data.coils == NULL ) return MODBUS_ERROR_ALLOC;
+	if ( modbusMasterAllocateDataBuffer( status, BITSTOBYTES( count ) ) ) return MODBUS_ERROR_ALLOC;
 
 	status->data.function = parser->base.function;
 	status->data.address = parser->base.address;
 	status->data.type = parser->base.function == 1 ? MODBUS_COIL : MODBUS_DISCRETE_INPUT;
 	status->data.index = modbusSwapEndian( requestParser->request0102.index );
 	status->data.count = count;
-	memcpy( status->data.coils, parser->response0102.values, parser->response0102.length );
+	//Copy only requested coils - remaining bits of the last byte are cleared
+	status->data.coils[parser->response0102.length - 1] = 0;
+	if ( modbusMaskCopy( status->data.coils, parser->response0102.length, 0, parser->response0102.values, parser->response0102.length, 0, count ) )
+		return MODBUS_ERROR_OTHER;
 	status->data.length = parser->response0102.length;
 	return MODBUS_ERROR_OK;
 }
@@ -84,9 +85,7 @@ uint8_t modbusParseResponse05( ModbusMaster *status, union ModbusParser *parser,
 	//If data is bad abort parsing, and set error flag
 	if ( !dataok ) return MODBUS_ERROR_FRAME;
 
-	status->data.coils = (uint8_t*) calloc( 1, sizeof( uint8_t ) );
-	status->data.regs = (uint16_t*) status->data.coils;
-	if ( status->data.coils == NULL ) return MODBUS_ERROR_ALLOC;
+	if ( modbusMasterAllocateDataBuffer( status, 1 ) ) return MODBUS_ERROR_ALLOC;
 	status->data.function = 5;
 	status->data.address = parser->base.address;
 	status->data.type = MODBUS_COIL;
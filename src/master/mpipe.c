@@ -0,0 +1,167 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <lightmodbus/core.h>
+#include <lightmodbus/parser.h>
+#include <lightmodbus/master.h>
+#include <lightmodbus/master/mtypes.h>
+#include <lightmodbus/master/mpipe.h>
+
+uint8_t modbusPipelineInit( ModbusPipeline *pipeline, ModbusMaster *master, uint16_t window )
+{
+	//Prepare pipeline for up to window requests in flight - master has to be initialized and in Modbus TCP mode
+	//In static memory mode, slots array (of window length) has to be provided by user
+	uint16_t i;
+
+	//Check if given pointers are valid
+	if ( pipeline == NULL || master == NULL || !master->tcp || window == 0 ) return MODBUS_ERROR_OTHER;
+
+	pipeline->master = master;
+	pipeline->window = window;
+	pipeline->pending = 0;
+
+	#if LIGHTMODBUS_STATIC_MEM_MASTER
+	if ( pipeline->slots == NULL ) return MODBUS_ERROR_ALLOC;
+	#else
+	pipeline->slots = (ModbusPipelineSlot *) calloc( window, sizeof( ModbusPipelineSlot ) );
+	if ( pipeline->slots == NULL ) return MODBUS_ERROR_ALLOC;
+	#endif
+
+	for ( i = 0; i < window; i++ )
+		pipeline->slots[i].used = 0;
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusPipelineAdd( ModbusPipeline *pipeline, void *context )
+{
+	//Put request just built by master (with modbusBuildRequest functions) in flight
+	//Transaction identifier is picked so that it maps to free slot - request frame is updated, and then it can be sent
+	//MODBUS_ERROR_OTHER is returned if window is full
+	ModbusMaster *master;
+	ModbusPipelineSlot *slot = NULL;
+	uint16_t transaction = 0, i;
+
+	//Check if given pointers are valid
+	if ( pipeline == NULL || pipeline->slots == NULL ) return MODBUS_ERROR_OTHER;
+	master = pipeline->master;
+	if ( master->request.frame == NULL || master->request.length < MODBUS_TCP_OFFSET + 2 || \
+		master->request.length > MODBUS_TCP_MAX_LENGTH ) return MODBUS_ERROR_OTHER;
+
+	//Skip transaction identifiers of slots still in use
+	if ( pipeline->pending == pipeline->window ) return MODBUS_ERROR_OTHER;
+	for ( i = 0; i < pipeline->window; i++ )
+	{
+		transaction = master->transaction + i;
+		slot = pipeline->slots + transaction % pipeline->window;
+		if ( !slot->used ) break;
+	}
+
+	( (union ModbusParser *) master->request.frame )->mbap.transaction = modbusSwapEndian( transaction );
+	master->transaction = transaction;
+
+	slot->used = 1;
+	slot->transaction = transaction;
+	slot->length = master->request.length;
+	slot->predictedResponseLength = master->predictedResponseLength;
+	slot->context = context;
+	memcpy( slot->frame, master->request.frame, master->request.length );
+	pipeline->pending++;
+
+	return MODBUS_ERROR_OK;
+}
+
+uint16_t modbusPipelineFrameLength( const uint8_t *data, uint16_t length )
+{
+	//Get length of Modbus TCP frame at the beginning of received data (0 if it's not complete yet)
+	uint32_t frameLength;
+
+	if ( data == NULL || length < MODBUS_TCP_OFFSET ) return 0;
+	frameLength = MODBUS_TCP_OFFSET + modbusSwapEndian( ( (const union ModbusParser *) data )->mbap.length );
+	return frameLength <= length ? frameLength : 0;
+}
+
+uint8_t modbusPipelineParse( ModbusPipeline *pipeline, uint8_t *frame, uint16_t length, void **context )
+{
+	//Parse response to one of requests in flight, and stop waiting for it
+	//Response is checked against stored request, just like with modbusParseResponse, and data is stored in master
+	//Context given with request is written to *context (if it's not NULL)
+	//MODBUS_ERROR_FRAME is returned if there's no request with response's transaction identifier
+	ModbusMaster *master;
+	ModbusPipelineSlot *slot;
+	uint16_t transaction, requestLength;
+	uint8_t *request, err;
+
+	//Check if given pointers are valid
+	if ( pipeline == NULL || pipeline->slots == NULL || frame == NULL || length < MODBUS_TCP_OFFSET + 2 ) return MODBUS_ERROR_OTHER;
+	master = pipeline->master;
+
+	//Find matching request
+	transaction = modbusSwapEndian( ( (union ModbusParser *) frame )->mbap.transaction );
+	slot = pipeline->slots + transaction % pipeline->window;
+	if ( !slot->used || slot->transaction != transaction ) return MODBUS_ERROR_FRAME;
+	if ( context != NULL ) *context = slot->context;
+
+	//Parse response against stored request
+	request = master->request.frame;
+	requestLength = master->request.length;
+	master->request.frame = slot->frame;
+	master->request.length = slot->length;
+	master->response.frame = frame;
+	master->response.length = length;
+	err = modbusParseResponse( master );
+	master->request.frame = request;
+	master->request.length = requestLength;
+
+	slot->used = 0;
+	pipeline->pending--;
+	return err;
+}
+
+uint8_t modbusPipelineCancel( ModbusPipeline *pipeline, uint16_t transaction )
+{
+	//Stop waiting for response to request with given transaction identifier
+	ModbusPipelineSlot *slot;
+
+	//Check if given pointer is valid
+	if ( pipeline == NULL || pipeline->slots == NULL ) return MODBUS_ERROR_OTHER;
+
+	slot = pipeline->slots + transaction % pipeline->window;
+	if ( !slot->used || slot->transaction != transaction ) return MODBUS_ERROR_OTHER;
+
+	slot->used = 0;
+	pipeline->pending--;
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusPipelineEnd( ModbusPipeline *pipeline )
+{
+	//Check if given pointer is valid
+	if ( pipeline == NULL ) return MODBUS_ERROR_OTHER;
+
+	//Free memory
+	#if !LIGHTMODBUS_STATIC_MEM_MASTER
+	free( pipeline->slots );
+	pipeline->slots = NULL;
+	#endif
+	pipeline->pending = 0;
+
+	return MODBUS_ERROR_OK;
+}
@@ -0,0 +1,198 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <lightmodbus/core.h>
+#include <lightmodbus/master.h>
+#include <lightmodbus/master/mtypes.h>
+#include <lightmodbus/master/mbregs.h>
+#include <lightmodbus/master/mbcoils.h>
+#include <lightmodbus/master/mplan.h>
+
+static int8_t modbusPlanCompare( const ModbusTag *a, const ModbusTag *b )
+{
+	//Order tags by slave address, data type and index
+	if ( a->address != b->address ) return a->address < b->address ? -1 : 1;
+	if ( a->type != b->type ) return a->type < b->type ? -1 : 1;
+	if ( a->index != b->index ) return a->index < b->index ? -1 : 1;
+	return 0;
+}
+
+uint8_t modbusPlanInit( ModbusPlan *plan, ModbusTag *tags, uint16_t tagCount, uint16_t registerGap, uint16_t coilGap )
+{
+	//Merge reads of given tags into as few requests as possible
+	//Neighbouring tags (of the same slave and type) are read with one request, if there are no more than gap
+	//unneeded elements between them, and request doesn't exceed 125 registers or 2000 coils
+	//In static memory mode, order and reads arrays (of tagCount length) have to be provided by user
+	ModbusTag *tag;
+	ModbusPlanRead *read = NULL;
+	uint32_t end = 0;
+	uint16_t i, j, limit, gap, number;
+
+	//Check if given pointers are valid
+	if ( plan == NULL || ( tags == NULL && tagCount != 0 ) ) return MODBUS_ERROR_OTHER;
+
+	plan->tags = tags;
+	plan->tagCount = tagCount;
+	plan->readCount = 0;
+	plan->registerGap = registerGap;
+	plan->coilGap = coilGap;
+	#if !LIGHTMODBUS_STATIC_MEM_MASTER
+	plan->order = NULL;
+	plan->reads = NULL;
+	#endif
+
+	//Check tags
+	for ( i = 0; i < tagCount; i++ )
+	{
+		tag = tags + i;
+		limit = ( tag->type == MODBUS_COIL || tag->type == MODBUS_DISCRETE_INPUT ) ? MODBUS_PLAN_MAX_COILS : MODBUS_PLAN_MAX_REGISTERS;
+		if ( ( tag->type != MODBUS_HOLDING_REGISTER && tag->type != MODBUS_INPUT_REGISTER && \
+			tag->type != MODBUS_COIL && tag->type != MODBUS_DISCRETE_INPUT ) || \
+			tag->count == 0 || tag->count > limit || (uint32_t) tag->index + tag->count > 65536 )
+				return MODBUS_ERROR_OTHER;
+		tag->regs = NULL;
+		tag->coils = NULL;
+		tag->coilOffset = 0;
+		tag->valid = 0;
+	}
+
+	#if LIGHTMODBUS_STATIC_MEM_MASTER
+	if ( plan->order == NULL || plan->reads == NULL ) return MODBUS_ERROR_ALLOC;
+	#else
+	plan->order = (uint16_t *) calloc( tagCount ? tagCount : 1, sizeof( uint16_t ) );
+	plan->reads = (ModbusPlanRead *) calloc( tagCount ? tagCount : 1, sizeof( ModbusPlanRead ) );
+	if ( plan->order == NULL || plan->reads == NULL )
+	{
+		modbusPlanEnd( plan );
+		return MODBUS_ERROR_ALLOC;
+	}
+	#endif
+
+	//Sort tags (insertion sort - tag lists are short, and often sorted already)
+	for ( i = 0; i < tagCount; i++ )
+	{
+		number = i;
+		for ( j = i; j > 0 && modbusPlanCompare( tags + plan->order[j - 1], tags + number ) > 0; j-- )
+			plan->order[j] = plan->order[j - 1];
+		plan->order[j] = number;
+	}
+
+	//Sweep sorted tags, extending current read as long as possible
+	for ( i = 0; i < tagCount; i++ )
+	{
+		tag = tags + plan->order[i];
+		if ( tag->type == MODBUS_COIL || tag->type == MODBUS_DISCRETE_INPUT )
+		{
+			limit = MODBUS_PLAN_MAX_COILS;
+			gap = coilGap;
+		}
+		else
+		{
+			limit = MODBUS_PLAN_MAX_REGISTERS;
+			gap = registerGap;
+		}
+
+		if ( read != NULL && read->address == tag->address && read->type == tag->type && \
+			tag->index <= end + gap && ( tag->index + tag->count > end ? tag->index + tag->count : end ) - read->index <= limit )
+		{
+			//Tag fits into current read
+			if ( tag->index + tag->count > end ) end = tag->index + tag->count;
+			read->count = end - read->index;
+			read->tagCount++;
+		}
+		else
+		{
+			//Start new read
+			read = plan->reads + plan->readCount++;
+			read->address = tag->address;
+			read->type = tag->type;
+			read->index = tag->index;
+			read->count = tag->count;
+			read->first = i;
+			read->tagCount = 1;
+			end = (uint32_t) tag->index + tag->count;
+		}
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusPlanRequest( ModbusPlan *plan, ModbusMaster *master, uint16_t read )
+{
+	//Build request for given read with master
+	static const uint8_t functions[9] = { [MODBUS_HOLDING_REGISTER] = 3, [MODBUS_INPUT_REGISTER] = 4, [MODBUS_COIL] = 1, [MODBUS_DISCRETE_INPUT] = 2 };
+	ModbusPlanRead *r;
+
+	//Check if given pointers are valid
+	if ( plan == NULL || master == NULL || plan->reads == NULL || read >= plan->readCount ) return MODBUS_ERROR_OTHER;
+
+	r = plan->reads + read;
+	if ( r->type == MODBUS_COIL || r->type == MODBUS_DISCRETE_INPUT )
+		return modbusBuildRequest0102( master, functions[r->type], r->address, r->index, r->count );
+	return modbusBuildRequest0304( master, functions[r->type], r->address, r->index, r->count );
+}
+
+uint8_t modbusPlanScatter( ModbusPlan *plan, ModbusMaster *master, uint16_t read )
+{
+	//Point tags covered by given read at their values in data just parsed by master (nothing is copied)
+	//Data has to match the read - otherwise tags are left untouched and MODBUS_ERROR_FRAME is returned
+	ModbusPlanRead *r;
+	ModbusTag *tag;
+	uint16_t i;
+
+	//Check if given pointers are valid
+	if ( plan == NULL || master == NULL || plan->reads == NULL || read >= plan->readCount ) return MODBUS_ERROR_OTHER;
+
+	r = plan->reads + read;
+	if ( master->data.address != r->address || master->data.type != r->type || \
+		master->data.index != r->index || master->data.count != r->count || master->data.coils == NULL )
+			return MODBUS_ERROR_FRAME;
+
+	for ( i = 0; i < r->tagCount; i++ )
+	{
+		tag = plan->tags + plan->order[r->first + i];
+		if ( r->type == MODBUS_COIL || r->type == MODBUS_DISCRETE_INPUT )
+		{
+			tag->coils = master->data.coils;
+			tag->coilOffset = tag->index - r->index;
+		}
+		else tag->regs = master->data.regs + ( tag->index - r->index );
+		tag->valid = 1;
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusPlanEnd( ModbusPlan *plan )
+{
+	//Check if given pointer is valid
+	if ( plan == NULL ) return MODBUS_ERROR_OTHER;
+
+	//Free memory
+	#if !LIGHTMODBUS_STATIC_MEM_MASTER
+	free( plan->order );
+	free( plan->reads );
+	plan->order = NULL;
+	plan->reads = NULL;
+	#endif
+	plan->readCount = 0;
+
+	return MODBUS_ERROR_OK;
+}
@@ -29,7 +29,6 @@ uint8_t modbusParseResponse0304( ModbusMaster *status, union ModbusParser *parse
 	//Read multiple holding registers
 
 	uint8_t dataok = 1;
-	uint8_t i = 0;
 
 	//Check if given pointers are valid
 	if ( status == NULL || parser == NULL || requestParser == NULL || ( parser->base.function != 3 && parser->base.function != 4 ) )
@@ -53,9 +52,7 @@ uint8_t modbusParseResponse0304( ModbusMaster *status, union ModbusParser *parse
 	if ( !dataok ) return MODBUS_ERROR_FRAME;
 
 	//Allocate memory for ModbusData structures array
-	status->data.coils = (uint8_t*) calloc( parser->response0304.length >> 1, sizeof( uint16_t ) );
-	status->data.regs = (uint16_t*) status->data.coils;
-	if ( status->data.coils == NULL ) return MODBUS_ERROR_ALLOC;
+	if ( modbusMasterAllocateDataBuffer( status, ( parser->response0304.length >> 1 ) * sizeof( uint16_t ) ) ) return MODBUS_ERROR_ALLOC;
 	status->data.address = parser->base.address;
 	status->data.function = parser->base.function;
 	status->data.type = parser->base.function == 3 ? MODBUS_HOLDING_REGISTER : MODBUS_INPUT_REGISTER;
@@ -63,8 +60,7 @@ uint8_t modbusParseResponse0304( ModbusMaster *status, union ModbusParser *parse
 	status->data.count = count;
 
 	//Copy received data (with swapping endianness)
-	for ( i = 0; i < count; i++ )
-		status->data.regs[i] = modbusSwapEndian( parser->response0304.values[i] );
+	modbusSwapEndianBlock( status->data.regs, parser->response0304.values, count );
 
 	status->data.length = parser->response0304.length;
 	return MODBUS_ERROR_OK;
@@ -93,9 +89,7 @@ uint8_t modbusParseResponse06( ModbusMaster *status, union ModbusParser *parser,
 	if ( !dataok ) return MODBUS_ERROR_FRAME;
 
 	//Set up new data table
-	status->data.coils = (uint8_t*) calloc( 1, sizeof( uint16_t ) );
-	status->data.regs = (uint16_t*) status->data.coils;
-	if ( status->data.coils == NULL ) return MODBUS_ERROR_ALLOC;
+	if ( modbusMasterAllocateDataBuffer( status, sizeof( uint16_t ) ) ) return MODBUS_ERROR_ALLOC;
 	status->data.function = 6;
 	status->data.address = parser->base.address;
 	status->data.type = MODBUS_HOLDING_REGISTER;
@@ -137,7 +131,6 @@ uint8_t modbusParseResponse16( ModbusMaster *status, union ModbusParser *parser,
 	status->data.type = MODBUS_HOLDING_REGISTER;
 	status->data.index = modbusSwapEndian( parser->response16.index );
 	status->data.count = count;
-	status->data.regs = NULL;
 	status->data.length = 0;
 	return MODBUS_ERROR_OK;
 }
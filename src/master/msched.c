@@ -0,0 +1,234 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <lightmodbus/core.h>
+#include <lightmodbus/master.h>
+#include <lightmodbus/master/mtypes.h>
+#include <lightmodbus/master/mbregs.h>
+#include <lightmodbus/master/mbcoils.h>
+#include <lightmodbus/master/msched.h>
+
+static uint8_t modbusScheduleBuild( ModbusMaster *master, ModbusPoll *poll )
+{
+	//Build read request for given poll
+	switch ( poll->type )
+	{
+		case MODBUS_HOLDING_REGISTER:
+			return modbusBuildRequest0304( master, 3, poll->address, poll->index, poll->count );
+
+		case MODBUS_INPUT_REGISTER:
+			return modbusBuildRequest0304( master, 4, poll->address, poll->index, poll->count );
+
+		case MODBUS_COIL:
+			return modbusBuildRequest0102( master, 1, poll->address, poll->index, poll->count );
+
+		case MODBUS_DISCRETE_INPUT:
+			return modbusBuildRequest0102( master, 2, poll->address, poll->index, poll->count );
+
+		default:
+			return MODBUS_ERROR_OTHER;
+	}
+}
+
+static uint32_t modbusScheduleCharTime( uint32_t baudRate, uint32_t chars )
+{
+	//Time needed to send given number of characters (rounded up)
+	return ( (uint64_t) chars * MODBUS_SCHEDULE_CHAR_BITS * 1000000 + baudRate - 1 ) / baudRate;
+}
+
+uint8_t modbusScheduleInit( ModbusSchedule *schedule, ModbusMaster *master, ModbusPoll *polls, uint16_t pollCount, uint32_t baudRate, uint32_t turnaround )
+{
+	//Compute bus time taken by each poll and check if all of them can be done within their periods
+	//Frame lengths are taken from requests built by master (so its request frame is overwritten)
+	//Polls are prioritized by period, and since frames can't be interrupted, each of them may
+	//also have to wait for one lower priority poll (non-preemptive rate-monotonic scheduling)
+	//In static memory mode, order array (of pollCount length) has to be provided by user
+	ModbusPoll *poll;
+	uint64_t w, next, utilization = 0;
+	uint32_t block;
+	uint16_t i, j, number;
+	uint8_t err;
+
+	//Check if given pointers are valid
+	if ( schedule == NULL || master == NULL || master->tcp || ( polls == NULL && pollCount != 0 ) || baudRate == 0 )
+		return MODBUS_ERROR_OTHER;
+
+	schedule->polls = polls;
+	schedule->pollCount = pollCount;
+	schedule->baudRate = baudRate;
+	schedule->turnaround = turnaround;
+	schedule->utilization = 0;
+	schedule->unschedulable = 0;
+	#if !LIGHTMODBUS_STATIC_MEM_MASTER
+	schedule->order = NULL;
+	#endif
+
+	//3.5 character silence marks end of frame - fixed at 1750us above 19200 baud
+	schedule->silence = baudRate > 19200 ? 1750 : ( 35 * MODBUS_SCHEDULE_CHAR_BITS * 100000 + baudRate - 1 ) / baudRate;
+
+	//Measure frames and compute bus time of each poll
+	for ( i = 0; i < pollCount; i++ )
+	{
+		poll = polls + i;
+		if ( poll->period == 0 ) return MODBUS_ERROR_OTHER;
+		if ( ( err = modbusScheduleBuild( master, poll ) ) ) return err;
+		poll->requestLength = master->request.length;
+		poll->responseLength = master->predictedResponseLength;
+		poll->cost = modbusScheduleCharTime( baudRate, poll->requestLength + poll->responseLength ) + \
+			schedule->silence * 2 + turnaround;
+		poll->responseTime = 0;
+		poll->schedulable = 0;
+		poll->due = 0;
+		poll->missed = 0;
+		utilization += ( (uint64_t) poll->cost * 1000 + poll->period - 1 ) / poll->period;
+	}
+	schedule->utilization = utilization > UINT16_MAX ? UINT16_MAX : utilization;
+
+	#if LIGHTMODBUS_STATIC_MEM_MASTER
+	if ( schedule->order == NULL ) return MODBUS_ERROR_ALLOC;
+	#else
+	schedule->order = (uint16_t *) calloc( pollCount ? pollCount : 1, sizeof( uint16_t ) );
+	if ( schedule->order == NULL ) return MODBUS_ERROR_ALLOC;
+	#endif
+
+	//Sort polls by period (insertion sort - stable, so polls of equal period keep their order)
+	for ( i = 0; i < pollCount; i++ )
+	{
+		number = i;
+		for ( j = i; j > 0 && polls[schedule->order[j - 1]].period > polls[number].period; j-- )
+			schedule->order[j] = schedule->order[j - 1];
+		schedule->order[j] = number;
+	}
+
+	//Response time analysis - poll can be delayed by one lower priority poll already on the bus (at most as long as
+	//the longest of them), and by every higher priority poll becoming due in the meantime
+	for ( i = 0; i < pollCount; i++ )
+	{
+		poll = polls + schedule->order[i];
+		block = 0;
+		for ( j = i + 1; j < pollCount; j++ )
+			if ( polls[schedule->order[j]].cost > block ) block = polls[schedule->order[j]].cost;
+
+		w = block;
+		while ( w + poll->cost <= poll->period )
+		{
+			next = block;
+			for ( j = 0; j < i; j++ )
+				next += ( w / polls[schedule->order[j]].period + 1 ) * polls[schedule->order[j]].cost;
+			if ( next == w ) break;
+			w = next;
+		}
+
+		w += poll->cost;
+		poll->responseTime = w > UINT32_MAX ? UINT32_MAX : w;
+		poll->schedulable = w <= poll->period;
+		if ( !poll->schedulable ) schedule->unschedulable++;
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusScheduleStart( ModbusSchedule *schedule, uint32_t now )
+{
+	//Make all polls due at given time
+	uint16_t i;
+
+	//Check if given pointer is valid
+	if ( schedule == NULL || ( schedule->polls == NULL && schedule->pollCount != 0 ) ) return MODBUS_ERROR_OTHER;
+
+	for ( i = 0; i < schedule->pollCount; i++ )
+	{
+		schedule->polls[i].due = now;
+		schedule->polls[i].missed = 0;
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusScheduleNext( ModbusSchedule *schedule, uint32_t now, uint16_t *poll, uint32_t *wait )
+{
+	//Pick highest priority poll that is due - if there's none, poll is set to pollCount and
+	//wait is set to time left until the next one becomes due
+	ModbusPoll *p;
+	uint32_t left = UINT32_MAX;
+	uint16_t i;
+
+	//Check if given pointers are valid
+	if ( schedule == NULL || schedule->order == NULL || poll == NULL ) return MODBUS_ERROR_OTHER;
+
+	for ( i = 0; i < schedule->pollCount; i++ )
+	{
+		p = schedule->polls + schedule->order[i];
+		if ( (int32_t)( now - p->due ) >= 0 )
+		{
+			*poll = schedule->order[i];
+			if ( wait != NULL ) *wait = 0;
+			return MODBUS_ERROR_OK;
+		}
+		if ( p->due - now < left ) left = p->due - now;
+	}
+
+	*poll = schedule->pollCount;
+	if ( wait != NULL ) *wait = left;
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusScheduleRequest( ModbusSchedule *schedule, ModbusMaster *master, uint16_t poll )
+{
+	//Build request for given poll with master
+	//Check if given pointers are valid
+	if ( schedule == NULL || master == NULL || schedule->polls == NULL || poll >= schedule->pollCount ) return MODBUS_ERROR_OTHER;
+
+	return modbusScheduleBuild( master, schedule->polls + poll );
+}
+
+uint8_t modbusScheduleDone( ModbusSchedule *schedule, uint16_t poll, uint32_t now )
+{
+	//Mark poll as finished (whether it succeeded or not) at given time
+	//If it's been late for whole periods, these are skipped - polling again immediately gives fresher data than catching up
+	ModbusPoll *p;
+
+	//Check if given pointer is valid
+	if ( schedule == NULL || schedule->polls == NULL || poll >= schedule->pollCount ) return MODBUS_ERROR_OTHER;
+
+	p = schedule->polls + poll;
+	p->due += p->period;
+	if ( (int32_t)( now - p->due ) > 0 )
+	{
+		p->missed += ( now - p->due ) / p->period + 1;
+		p->due += ( now - p->due ) / p->period * p->period;
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusScheduleEnd( ModbusSchedule *schedule )
+{
+	//Check if given pointer is valid
+	if ( schedule == NULL ) return MODBUS_ERROR_OTHER;
+
+	//Free memory
+	#if !LIGHTMODBUS_STATIC_MEM_MASTER
+	free( schedule->order );
+	schedule->order = NULL;
+	#endif
+
+	return MODBUS_ERROR_OK;
+}
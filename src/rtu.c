@@ -0,0 +1,174 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <lightmodbus/core.h>
+#include <lightmodbus/rtu.h>
+
+uint8_t modbusRTUInit( ModbusRTUReceiver *rx, uint8_t *frame, uint32_t baudrate, uint32_t now )
+{
+	//Set up RTU receiver - one character is 11 bits long (start, 8 data bits, parity or second stop bit, stop)
+	//Above 19200 baud, fixed timeouts of 750us and 1750us are used, as Modbus specification recommends
+
+	//Check if given pointers are valid
+	if ( rx == NULL || frame == NULL || baudrate == 0 ) return MODBUS_ERROR_OTHER;
+
+	rx->frame = frame;
+	rx->length = 0;
+	rx->crc = modbusCRCInit( );
+	rx->expected = 0;
+	rx->requests = 0;
+	rx->dropped = 0;
+	rx->t15 = baudrate > 19200 ? 750 : 16500000 / baudrate;
+	rx->t35 = baudrate > 19200 ? 1750 : 38500000 / baudrate;
+	rx->last = now;
+	rx->pending = 0;
+
+	//Bus state is unknown, so t3.5 of silence has to pass before first frame
+	rx->state = MODBUS_RTU_INIT;
+
+	return MODBUS_ERROR_OK;
+}
+
+static void modbusRTUAppend( ModbusRTUReceiver *rx, uint8_t byte )
+{
+	//Append byte to frame being received and update CRC
+	rx->frame[rx->length++] = byte;
+	rx->crc = modbusCRCUpdate( rx->crc, &byte, 1 );
+
+	//Exception responses are shorter than predicted
+	if ( rx->length == 2 && rx->expected && ( byte & 0x80 ) ) rx->expected = 5;
+
+	//Lengths of requests for built-in functions are known after function code (or byte count) is received
+	if ( rx->requests && !rx->expected )
+	{
+		if ( rx->length == 2 )
+		{
+			if ( byte >= 1 && byte <= 6 ) rx->expected = 8;
+			else if ( byte == 22 ) rx->expected = 10;
+		}
+		else if ( rx->length == 7 && ( rx->frame[1] == 15 || rx->frame[1] == 16 ) )
+			rx->expected = 9 + byte;
+	}
+
+	//Frame with known length is finished without waiting for silent interval
+	if ( rx->length == rx->expected )
+	{
+		rx->expected = 0;
+		rx->state = MODBUS_RTU_FRAME;
+	}
+}
+
+uint8_t modbusRTUPoll( ModbusRTUReceiver *rx, uint32_t now )
+{
+	//Check receiver timeouts - should be called periodically, so frames are finished after t3.5 of silence
+	//Frame returned previously (MODBUS_RTU_FRAME state) is discarded here, so it has to be parsed beforehand
+
+	//Check if given pointer is valid
+	if ( rx == NULL ) return MODBUS_RTU_INIT;
+
+	//Previous frame has been consumed - next one has to be separated with t3.5 of silence
+	if ( rx->state == MODBUS_RTU_FRAME )
+	{
+		rx->length = 0;
+		rx->crc = modbusCRCInit( );
+		rx->state = MODBUS_RTU_INIT;
+
+		//First byte of next frame arrived after silent interval already
+		if ( rx->pending )
+		{
+			rx->pending = 0;
+			rx->state = MODBUS_RTU_RECEIVING;
+			modbusRTUAppend( rx, rx->next );
+		}
+	}
+
+	//Nothing happens until t3.5 elapses
+	if ( now - rx->last < rx->t35 ) return rx->state;
+
+	switch ( rx->state )
+	{
+		case MODBUS_RTU_INIT:
+			rx->state = MODBUS_RTU_IDLE;
+			break;
+
+		case MODBUS_RTU_RECEIVING:
+			//Frames shorter than 4 bytes (address, function, CRC) are dropped
+			if ( rx->length >= 4 )
+			{
+				rx->expected = 0;
+				rx->state = MODBUS_RTU_FRAME;
+				break;
+			}
+			//Fall through
+
+		case MODBUS_RTU_DAMAGED:
+			rx->dropped++;
+			rx->length = 0;
+			rx->crc = modbusCRCInit( );
+			rx->state = MODBUS_RTU_IDLE;
+			break;
+	}
+
+	return rx->state;
+}
+
+uint8_t modbusRTUReceive( ModbusRTUReceiver *rx, uint8_t byte, uint32_t now )
+{
+	//Feed received byte to the receiver
+	//When MODBUS_RTU_FRAME is returned, frame and its CRC are available in rx->frame, rx->length and rx->crc
+	//(if that's the case, the byte may belong to the next frame - it's kept until the frame is consumed)
+
+	//Check if given pointer is valid
+	if ( rx == NULL ) return MODBUS_RTU_INIT;
+
+	//Handle timeouts first - that may finish frame being received
+	uint8_t state = rx->state;
+	if ( modbusRTUPoll( rx, now ) == MODBUS_RTU_FRAME && state == MODBUS_RTU_RECEIVING )
+	{
+		rx->next = byte;
+		rx->pending = 1;
+		rx->last = now;
+		return MODBUS_RTU_FRAME;
+	}
+
+	switch ( rx->state )
+	{
+		//Bytes received without preceding silent interval are ignored
+		case MODBUS_RTU_INIT:
+		case MODBUS_RTU_DAMAGED:
+			break;
+
+		case MODBUS_RTU_IDLE:
+			rx->state = MODBUS_RTU_RECEIVING;
+			modbusRTUAppend( rx, byte );
+			break;
+
+		case MODBUS_RTU_RECEIVING:
+			//Gap longer than t1.5 or too many bytes - frame is broken
+			if ( now - rx->last > rx->t15 || rx->length >= MODBUS_RTU_MAX_LENGTH )
+				rx->state = MODBUS_RTU_DAMAGED;
+			else
+				modbusRTUAppend( rx, byte );
+			break;
+	}
+
+	rx->last = now;
+	return rx->state;
+}
@@ -0,0 +1,388 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <lightmodbus/core.h>
+#include <lightmodbus/parser.h>
+#include <lightmodbus/rtu.h>
+#include <lightmodbus/slave.h>
+#include <lightmodbus/server.h>
+#include <lightmodbus/server/backend.h>
+
+uint32_t modbusServerTime( )
+{
+	//Current time in microseconds, for RTU receivers
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint32_t) ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+ModbusServerConnection *modbusServerOpen( ModbusServer *server, int fd, uint8_t serial )
+{
+	//Take free connection slot (NULL is returned if there's none)
+	ModbusServerConnection *conn;
+
+	if ( server->connectionCount == server->maxConnections ) return NULL;
+
+	conn = server->connections + server->freeSlots[server->maxConnections - ++server->connectionCount];
+	conn->fd = fd;
+	conn->serial = serial;
+	conn->writing = 0;
+	conn->receiving = 0;
+	conn->closing = 0;
+	conn->pending = 0;
+	conn->parked = 0;
+	conn->sending = 0;
+	conn->rxLength = 0;
+	conn->txOffset = 0;
+	conn->txLength = 0;
+	if ( serial ) server->serialCount++;
+	return conn;
+}
+
+void modbusServerRelease( ModbusServer *server, ModbusServerConnection *conn )
+{
+	//Close connection and return its slot to the pool
+	close( conn->fd );
+	conn->fd = -1;
+	if ( conn->serial ) server->serialCount--;
+	server->freeSlots[server->maxConnections - server->connectionCount--] = conn - server->connections;
+}
+
+uint8_t modbusServerReady( ModbusServerConnection *conn )
+{
+	//Check if there's complete Modbus TCP frame waiting in receive buffer
+	return !conn->serial && conn->rxLength >= MODBUS_TCP_OFFSET + 2 && \
+		conn->rxLength >= MODBUS_TCP_OFFSET + modbusSwapEndian( ( (union ModbusParser *) conn->rx )->mbap.length );
+}
+
+static void modbusServerParse( ModbusServer *server, uint8_t function, uint16_t crc )
+{
+	//Parse request placed in transmit buffer, building response in place of it
+	//When slave data is shared between threads, only reads (functions 1-4) are done without lock
+	if ( server->lock == NULL || ( function >= 1 && function <= 4 ) )
+	{
+		modbusParseRequestInPlaceCRC( server->slave, crc );
+		return;
+	}
+
+	pthread_mutex_lock( server->lock );
+	modbusParseRequestInPlaceCRC( server->slave, crc );
+	pthread_mutex_unlock( server->lock );
+}
+
+static uint32_t modbusServerMissing( ModbusServerConnection *conn )
+{
+	//Number of bytes missing from MBAP header, or from the first frame waiting in receive buffer
+	//Invalid frames are left to modbusServerParseFrames, which rejects them
+	union ModbusParser *parser = (union ModbusParser *) conn->rx;
+	uint32_t frameLength;
+
+	if ( conn->rxLength < MODBUS_TCP_OFFSET ) return MODBUS_TCP_OFFSET - conn->rxLength;
+
+	frameLength = modbusSwapEndian( parser->mbap.length );
+	if ( parser->mbap.protocol != 0 || frameLength < 2 || frameLength > MODBUS_TCP_MAX_LENGTH - MODBUS_TCP_OFFSET ) return 0;
+
+	frameLength += MODBUS_TCP_OFFSET;
+	return frameLength > conn->rxLength ? frameLength - conn->rxLength : 0;
+}
+
+static uint8_t modbusServerParseFrames( ModbusServer *server, ModbusServerConnection *conn, const uint8_t *data, uint32_t length, uint32_t *parsed )
+{
+	//Parse complete Modbus TCP requests found in data, and return number of bytes parsed
+	//Each request is copied to transmit buffer and response is built in place of it, so no extra memory is needed
+	union ModbusParser *parser;
+	uint32_t offset = 0, frameLength;
+
+	*parsed = 0;
+	server->slave->tcp = 1;
+	while ( length - offset >= MODBUS_TCP_OFFSET )
+	{
+		//Reject anything that's not Modbus TCP
+		parser = (union ModbusParser *) ( data + offset );
+		frameLength = modbusSwapEndian( parser->mbap.length );
+		if ( parser->mbap.protocol != 0 || frameLength < 2 || frameLength > MODBUS_TCP_MAX_LENGTH - MODBUS_TCP_OFFSET )
+			return MODBUS_ERROR_FRAME;
+
+		//Incomplete frame, or no room for response (it'll be processed once transmit buffer is flushed)
+		frameLength += MODBUS_TCP_OFFSET;
+		if ( length - offset < frameLength || LIGHTMODBUS_SERVER_TX_BUFFER - conn->txLength < MODBUS_TCP_MAX_LENGTH ) break;
+
+		memcpy( conn->tx + conn->txLength, data + offset, frameLength );
+		server->slave->request.frame = conn->tx + conn->txLength;
+		server->slave->request.length = frameLength;
+		modbusServerParse( server, server->slave->request.frame[MODBUS_TCP_OFFSET + 1], 0 );
+		conn->txLength += server->slave->response.length;
+		server->requests++;
+		offset += frameLength;
+		*parsed = offset;
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusServerProcess( ModbusServer *server, ModbusServerConnection *conn, const uint8_t *data, uint32_t length, uint32_t *used )
+{
+	//Parse all complete Modbus TCP requests, building responses in transmit buffer
+	//Given data is parsed where it is (NULL means receive buffer) - if there's incomplete frame in receive buffer already,
+	//only bytes missing from it are copied there, so data doesn't have to fit in receive buffer (io_uring buffers are as big as it)
+	//If requests wait for room in transmit buffer, and the rest of data doesn't fit in receive buffer behind them,
+	//it's left to the caller - number of bytes taken is stored in used (may be NULL if data is NULL)
+	uint32_t offset, missing;
+	uint8_t err;
+
+	if ( used != NULL ) *used = length;
+	while ( data != NULL && conn->rxLength != 0 )
+	{
+		missing = modbusServerMissing( conn );
+		if ( missing > length ) missing = length;
+		memcpy( conn->rx + conn->rxLength, data, missing );
+		conn->rxLength += missing;
+		data += missing;
+		length -= missing;
+
+		if ( ( err = modbusServerParseFrames( server, conn, conn->rx, conn->rxLength, &offset ) ) ) return err;
+		conn->rxLength -= offset;
+		if ( conn->rxLength ) memmove( conn->rx, conn->rx + offset, conn->rxLength );
+
+		//Data used up, or frame still incomplete (only header was missing)
+		if ( length == 0 ) return MODBUS_ERROR_OK;
+		if ( conn->rxLength == 0 || modbusServerMissing( conn ) != 0 ) continue;
+
+		//Requests are waiting for room in transmit buffer - new data has to wait behind them
+		if ( length > LIGHTMODBUS_SERVER_RX_BUFFER - conn->rxLength )
+		{
+			*used -= length;
+			return MODBUS_ERROR_OK;
+		}
+		memcpy( conn->rx + conn->rxLength, data, length );
+		conn->rxLength += length;
+		return MODBUS_ERROR_OK;
+	}
+
+	if ( data == NULL )
+	{
+		data = conn->rx;
+		length = conn->rxLength;
+	}
+
+	if ( ( err = modbusServerParseFrames( server, conn, data, length, &offset ) ) ) return err;
+
+	//Keep the rest for later
+	length -= offset;
+	if ( length > LIGHTMODBUS_SERVER_RX_BUFFER ) return MODBUS_ERROR_OTHER;
+	if ( length && ( offset || data != conn->rx ) ) memmove( conn->rx, data + offset, length );
+	conn->rxLength = length;
+	return MODBUS_ERROR_OK;
+}
+
+static void modbusServerRespond( ModbusServer *server, ModbusServerConnection *conn )
+{
+	//Parse complete Modbus RTU request from serial line receiver
+	//Request is dropped if there's no room for response - master will repeat it after timeout
+	ModbusRTUReceiver *rx = &conn->receiver;
+
+	if ( LIGHTMODBUS_SERVER_TX_BUFFER - conn->txLength < MODBUS_RTU_MAX_LENGTH ) return;
+
+	memcpy( conn->tx + conn->txLength, rx->frame, rx->length );
+	server->slave->tcp = 0;
+	server->slave->request.frame = conn->tx + conn->txLength;
+	server->slave->request.length = rx->length;
+	modbusServerParse( server, rx->frame[1], rx->crc );
+	conn->txLength += server->slave->response.length;
+	server->requests++;
+}
+
+uint8_t modbusServerProcessSerial( ModbusServer *server, ModbusServerConnection *conn, const uint8_t *data, uint32_t length, uint32_t now )
+{
+	//Feed bytes received from serial line to RTU receiver and parse complete requests
+	//Bytes of one read are assumed to be received at the same time
+	uint32_t i;
+
+	for ( i = 0; i < length; i++ )
+		if ( modbusRTUReceive( &conn->receiver, data[i], now ) == MODBUS_RTU_FRAME )
+			modbusServerRespond( server, conn );
+
+	return MODBUS_ERROR_OK;
+}
+
+int modbusServerPollSerial( ModbusServer *server, int timeout )
+{
+	//Finish frames received from serial lines after t3.5 of silence
+	//Returns timeout (in ms) to be used for next wait, so that no frame is kept waiting too long
+	ModbusServerConnection *conn;
+	uint32_t now, left;
+	uint16_t i;
+
+	if ( server->serialCount == 0 ) return timeout;
+
+	now = modbusServerTime( );
+	for ( i = 0; i < server->maxConnections; i++ )
+	{
+		conn = server->connections + i;
+		if ( conn->fd < 0 || !conn->serial || conn->closing ) continue;
+
+		switch ( modbusRTUPoll( &conn->receiver, now ) )
+		{
+			case MODBUS_RTU_FRAME:
+				modbusServerRespond( server, conn );
+				if ( modbusServerBackendFlush( server, conn ) ) modbusServerBackendClose( server, conn );
+				break;
+
+			//Wake up when t3.5 elapses
+			case MODBUS_RTU_RECEIVING:
+				left = conn->receiver.t35 - ( now - conn->receiver.last );
+				if ( timeout < 0 || ( left + 999 ) / 1000 < (uint32_t) timeout ) timeout = ( left + 999 ) / 1000;
+				break;
+		}
+	}
+
+	return timeout;
+}
+
+uint8_t modbusServerRun( ModbusServer *server, int timeout )
+{
+	//Wait for events for up to timeout milliseconds (-1 means forever) and handle all of them
+
+	//Check if given pointer is valid
+	if ( server == NULL || server->connections == NULL ) return MODBUS_ERROR_OTHER;
+
+	return modbusServerBackendRun( server, modbusServerPollSerial( server, timeout ) );
+}
+
+uint8_t modbusServerAddSerial( ModbusServer *server, int fd, uint32_t baudrate )
+{
+	//Serve Modbus RTU requests from serial line (already opened and configured, eg. in raw mode)
+	//From now on, the descriptor belongs to the server and is closed by it
+	ModbusServerConnection *conn;
+
+	//Check if given pointer is valid
+	if ( server == NULL || server->connections == NULL || fd < 0 ) return MODBUS_ERROR_OTHER;
+
+	if ( ( conn = modbusServerOpen( server, fd, 1 ) ) == NULL ) return MODBUS_ERROR_ALLOC;
+	if ( modbusRTUInit( &conn->receiver, conn->rx, baudrate, modbusServerTime( ) ) || modbusServerBackendAdd( server, conn ) )
+	{
+		conn->fd = -1;
+		modbusServerRelease( server, conn );
+		return MODBUS_ERROR_OTHER;
+	}
+	conn->receiver.requests = 1;
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusServerListen( ModbusServer *server, ModbusSlave *slave, const char *address, uint16_t port, uint16_t maxConnections, uint8_t reusePort )
+{
+	//Start listening on given IPv4 address (NULL means any) and port (0 means any free one)
+	//With reusePort, other servers can listen on the same port, and kernel spreads connections between them
+	struct sockaddr_in sa;
+	socklen_t length = sizeof( sa );
+	int one = 1;
+	uint16_t i;
+
+	//Check if given pointers are valid
+	if ( server == NULL || slave == NULL || maxConnections == 0 ) return MODBUS_ERROR_OTHER;
+
+	memset( server, 0, sizeof( ModbusServer ) );
+	server->slave = slave;
+	server->maxConnections = maxConnections;
+	server->listenFd = -1;
+	server->backendFd = -1;
+
+	//Prepare connection slots
+	server->connections = (ModbusServerConnection *) calloc( maxConnections, sizeof( ModbusServerConnection ) );
+	server->freeSlots = (uint16_t *) calloc( maxConnections, sizeof( uint16_t ) );
+	if ( server->connections == NULL || server->freeSlots == NULL )
+	{
+		modbusServerEnd( server );
+		return MODBUS_ERROR_ALLOC;
+	}
+	for ( i = 0; i < maxConnections; i++ )
+	{
+		server->connections[i].fd = -1;
+		server->freeSlots[i] = maxConnections - 1 - i;
+	}
+
+	memset( &sa, 0, sizeof( sa ) );
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons( port );
+	sa.sin_addr.s_addr = htonl( INADDR_ANY );
+	if ( address != NULL && inet_pton( AF_INET, address, &sa.sin_addr ) != 1 )
+	{
+		modbusServerEnd( server );
+		return MODBUS_ERROR_OTHER;
+	}
+
+	//Set up listening socket and event loop
+	if ( ( server->listenFd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 ) ) < 0 || \
+		setsockopt( server->listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) ) || \
+		( reusePort && setsockopt( server->listenFd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof( one ) ) ) || \
+		bind( server->listenFd, (struct sockaddr *) &sa, sizeof( sa ) ) || \
+		listen( server->listenFd, SOMAXCONN ) || \
+		getsockname( server->listenFd, (struct sockaddr *) &sa, &length ) || \
+		modbusServerBackendInit( server ) )
+	{
+		modbusServerEnd( server );
+		return MODBUS_ERROR_OTHER;
+	}
+
+	server->port = ntohs( sa.sin_port );
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusServerInit( ModbusServer *server, ModbusSlave *slave, const char *address, uint16_t port, uint16_t maxConnections )
+{
+	//Start listening on given IPv4 address (NULL means any) and port (0 means any free one)
+	//Slave has to be initialized with modbusSlaveInit beforehand
+	return modbusServerListen( server, slave, address, port, maxConnections, 0 );
+}
+
+uint8_t modbusServerEnd( ModbusServer *server )
+{
+	//Close all connections and sockets, and free memory
+	uint16_t i;
+
+	//Check if given pointer is valid
+	if ( server == NULL ) return MODBUS_ERROR_OTHER;
+
+	modbusServerBackendEnd( server );
+
+	if ( server->connections != NULL )
+		for ( i = 0; i < server->maxConnections; i++ )
+			if ( server->connections[i].fd >= 0 ) close( server->connections[i].fd );
+
+	if ( server->listenFd >= 0 ) close( server->listenFd );
+	free( server->connections );
+	free( server->freeSlots );
+	server->connections = NULL;
+	server->freeSlots = NULL;
+	server->listenFd = -1;
+	server->connectionCount = 0;
+	server->serialCount = 0;
+
+	return MODBUS_ERROR_OK;
+}
@@ -0,0 +1,177 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//accept4
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <lightmodbus/core.h>
+#include <lightmodbus/server.h>
+#include <lightmodbus/server/backend.h>
+
+//epoll backend - level-triggered readiness notifications, and plain read/write calls
+
+static uint8_t modbusServerWatch( ModbusServer *server, ModbusServerConnection *conn, int op, uint8_t writing )
+{
+	//Wait for socket to become readable, or writable if there are responses left to send
+	struct epoll_event event;
+
+	event.events = writing ? EPOLLOUT : EPOLLIN;
+	event.data.ptr = conn;
+	conn->writing = writing;
+	return epoll_ctl( server->backendFd, op, conn->fd, &event ) ? MODBUS_ERROR_OTHER : MODBUS_ERROR_OK;
+}
+
+uint8_t modbusServerBackendAdd( ModbusServer *server, ModbusServerConnection *conn )
+{
+	//Serial lines have to be non-blocking too
+	if ( conn->serial && fcntl( conn->fd, F_SETFL, fcntl( conn->fd, F_GETFL ) | O_NONBLOCK ) ) return MODBUS_ERROR_OTHER;
+	return modbusServerWatch( server, conn, EPOLL_CTL_ADD, 0 );
+}
+
+void modbusServerBackendClose( ModbusServer *server, ModbusServerConnection *conn )
+{
+	epoll_ctl( server->backendFd, EPOLL_CTL_DEL, conn->fd, NULL );
+	modbusServerRelease( server, conn );
+}
+
+uint8_t modbusServerBackendFlush( ModbusServer *server, ModbusServerConnection *conn )
+{
+	//Send collected responses - with one write call, unless socket buffer is full
+	ssize_t count;
+
+	while ( conn->txOffset < conn->txLength )
+	{
+		count = write( conn->fd, conn->tx + conn->txOffset, conn->txLength - conn->txOffset );
+		if ( count < 0 && errno == EINTR ) continue;
+		if ( count < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+			return conn->writing ? MODBUS_ERROR_OK : modbusServerWatch( server, conn, EPOLL_CTL_MOD, 1 );
+		if ( count <= 0 ) return MODBUS_ERROR_OTHER;
+		conn->txOffset += count;
+	}
+
+	conn->txOffset = 0;
+	conn->txLength = 0;
+	return conn->writing ? modbusServerWatch( server, conn, EPOLL_CTL_MOD, 0 ) : MODBUS_ERROR_OK;
+}
+
+static void modbusServerAccept( ModbusServer *server )
+{
+	//Accept all pending connections
+	ModbusServerConnection *conn;
+	int fd, one = 1;
+
+	while ( ( fd = accept4( server->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC ) ) >= 0 )
+	{
+		//No free slots
+		if ( ( conn = modbusServerOpen( server, fd, 0 ) ) == NULL )
+		{
+			close( fd );
+			continue;
+		}
+
+		//Responses are written in batches already, so Nagle's algorithm would only add latency
+		setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+		if ( modbusServerBackendAdd( server, conn ) ) modbusServerRelease( server, conn );
+	}
+}
+
+static uint8_t modbusServerHandle( ModbusServer *server, ModbusServerConnection *conn, uint32_t events )
+{
+	//Handle socket event - read requests, or continue sending responses
+	uint8_t buffer[LIGHTMODBUS_SERVER_RX_BUFFER];
+	ssize_t count;
+
+	if ( events & ( EPOLLERR | EPOLLHUP ) ) return MODBUS_ERROR_OTHER;
+
+	if ( events & EPOLLIN )
+	{
+		//Serial line bytes go to RTU receiver, and TCP data is read straight into receive buffer
+		if ( conn->serial ) count = read( conn->fd, buffer, sizeof( buffer ) );
+		else count = read( conn->fd, conn->rx + conn->rxLength, LIGHTMODBUS_SERVER_RX_BUFFER - conn->rxLength );
+		if ( count < 0 ) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? MODBUS_ERROR_OK : MODBUS_ERROR_OTHER;
+		if ( count == 0 ) return MODBUS_ERROR_OTHER;
+
+		if ( conn->serial ) modbusServerProcessSerial( server, conn, buffer, count, modbusServerTime( ) );
+		else conn->rxLength += count;
+	}
+
+	//Requests left in receive buffer (because transmit buffer was full) are processed once responses are sent
+	do
+	{
+		if ( !conn->serial && modbusServerProcess( server, conn, NULL, 0, NULL ) ) return MODBUS_ERROR_FRAME;
+		if ( modbusServerBackendFlush( server, conn ) ) return MODBUS_ERROR_OTHER;
+	}
+	while ( !conn->writing && conn->txLength == 0 && modbusServerReady( conn ) );
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusServerBackendRun( ModbusServer *server, int timeout )
+{
+	struct epoll_event events[LIGHTMODBUS_SERVER_EVENTS];
+	ModbusServerConnection *conn;
+	int i, count;
+
+	count = epoll_wait( server->backendFd, events, LIGHTMODBUS_SERVER_EVENTS, timeout );
+	if ( count < 0 ) return errno == EINTR ? MODBUS_ERROR_OK : MODBUS_ERROR_OTHER;
+
+	for ( i = 0; i < count; i++ )
+	{
+		//Listening socket is marked with NULL pointer
+		if ( events[i].data.ptr == NULL )
+		{
+			modbusServerAccept( server );
+			continue;
+		}
+
+		//Broken connections and clients sending garbage are dropped
+		conn = (ModbusServerConnection *) events[i].data.ptr;
+		if ( modbusServerHandle( server, conn, events[i].events ) ) modbusServerBackendClose( server, conn );
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusServerBackendInit( ModbusServer *server )
+{
+	struct epoll_event event;
+
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	if ( ( server->backendFd = epoll_create1( EPOLL_CLOEXEC ) ) < 0 || \
+		epoll_ctl( server->backendFd, EPOLL_CTL_ADD, server->listenFd, &event ) )
+			return MODBUS_ERROR_OTHER;
+
+	return MODBUS_ERROR_OK;
+}
+
+void modbusServerBackendEnd( ModbusServer *server )
+{
+	if ( server->backendFd >= 0 ) close( server->backendFd );
+	server->backendFd = -1;
+}
@@ -0,0 +1,163 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//pthread_attr_setaffinity_np, CPU_* macros
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <lightmodbus/core.h>
+#include <lightmodbus/slave.h>
+#include <lightmodbus/server.h>
+#include <lightmodbus/server/backend.h>
+
+//Server pool - one event loop per thread, each with its own listening socket on the same port (SO_REUSEPORT)
+//Kernel spreads incoming connections between threads, and each connection stays with one thread
+//
+//Slave data (registers, coils etc.) is shared by all threads:
+// - reads (functions 1-4) are done without any locking, so they scale with number of threads
+// - all other requests are serialized with pool's mutex, so writes of multiple registers aren't interleaved
+//Single register is always read or written whole, but read of several registers may see another write half-done
+//Application modifying slave data while pool is running should take pool->lock too
+
+static void *modbusServerPoolThread( void *arg )
+{
+	ModbusServerShard *shard = (ModbusServerShard *) arg;
+
+	while ( !shard->pool->stop )
+		if ( modbusServerRun( &shard->server, 100 ) ) break;
+
+	return NULL;
+}
+
+uint8_t modbusServerPoolInit( ModbusServerPool *pool, ModbusSlave *slave, const char *address, uint16_t port, uint16_t maxConnections, uint16_t threads )
+{
+	//Start threads (0 means one per CPU available), each serving up to maxConnections connections
+	//Threads are pinned to consecutive CPUs the process is allowed to run on
+	ModbusServerShard *shard;
+	pthread_attr_t attr;
+	cpu_set_t allowed, cpu;
+	uint16_t i;
+	int j, k;
+	uint8_t err;
+
+	//Check if given pointers are valid
+	if ( pool == NULL || slave == NULL ) return MODBUS_ERROR_OTHER;
+
+	memset( pool, 0, sizeof( ModbusServerPool ) );
+	CPU_ZERO( &allowed );
+	if ( sched_getaffinity( 0, sizeof( allowed ), &allowed ) || CPU_COUNT( &allowed ) == 0 ) return MODBUS_ERROR_OTHER;
+	if ( threads == 0 ) threads = CPU_COUNT( &allowed );
+
+	if ( posix_memalign( (void **) &pool->shards, 64, threads * sizeof( ModbusServerShard ) ) )
+	{
+		pool->shards = NULL;
+		return MODBUS_ERROR_ALLOC;
+	}
+	memset( pool->shards, 0, threads * sizeof( ModbusServerShard ) );
+	pthread_mutex_init( &pool->lock, NULL );
+
+	for ( i = 0, j = -1; i < threads; i++ )
+	{
+		shard = pool->shards + i;
+		shard->pool = pool;
+
+		//Each thread has its own copy of slave, as request and response are stored there
+		shard->slave = *slave;
+		shard->slave.request.frame = NULL;
+		shard->slave.request.length = 0;
+		#if !LIGHTMODBUS_STATIC_MEM_SLAVE
+		shard->slave.response.frame = NULL;
+		#endif
+
+		//First server picks the port (if 0 was given), and the rest join it
+		err = modbusServerListen( &shard->server, &shard->slave, address, i ? pool->port : port, maxConnections, 1 );
+		pool->shardCount++;
+		if ( err )
+		{
+			modbusServerPoolEnd( pool );
+			return err;
+		}
+		pool->port = shard->server.port;
+		shard->server.lock = &pool->lock;
+
+		//Find next allowed CPU
+		for ( k = 0; k < CPU_SETSIZE; k++ )
+			if ( CPU_ISSET( j = ( j + 1 ) % CPU_SETSIZE, &allowed ) ) break;
+		CPU_ZERO( &cpu );
+		CPU_SET( j, &cpu );
+
+		pthread_attr_init( &attr );
+		pthread_attr_setaffinity_np( &attr, sizeof( cpu ), &cpu );
+		err = pthread_create( &shard->thread, &attr, modbusServerPoolThread, shard );
+		pthread_attr_destroy( &attr );
+		if ( err )
+		{
+			modbusServerPoolEnd( pool );
+			return MODBUS_ERROR_OTHER;
+		}
+		shard->started = 1;
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+uint64_t modbusServerPoolRequests( ModbusServerPool *pool )
+{
+	//Sum of request counters of all threads (each of them may be a bit out of date)
+	uint64_t requests = 0;
+	uint16_t i;
+
+	if ( pool == NULL || pool->shards == NULL ) return 0;
+	for ( i = 0; i < pool->shardCount; i++ )
+		requests += *(volatile uint64_t *) &pool->shards[i].server.requests;
+
+	return requests;
+}
+
+uint8_t modbusServerPoolEnd( ModbusServerPool *pool )
+{
+	//Stop all threads (it takes up to 100ms), and free everything
+	uint16_t i;
+
+	//Check if given pointer is valid
+	if ( pool == NULL ) return MODBUS_ERROR_OTHER;
+	if ( pool->shards == NULL ) return MODBUS_ERROR_OK;
+
+	pool->stop = 1;
+	for ( i = 0; i < pool->shardCount; i++ )
+	{
+		if ( pool->shards[i].started ) pthread_join( pool->shards[i].thread, NULL );
+		modbusServerEnd( &pool->shards[i].server );
+		#if !LIGHTMODBUS_STATIC_MEM_SLAVE
+		free( pool->shards[i].slave.response.frame );
+		#endif
+	}
+
+	pthread_mutex_destroy( &pool->lock );
+	free( pool->shards );
+	pool->shards = NULL;
+	pool->shardCount = 0;
+
+	return MODBUS_ERROR_OK;
+}
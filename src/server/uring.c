@@ -0,0 +1,570 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/io_uring.h>
+
+#include <lightmodbus/core.h>
+#include <lightmodbus/server.h>
+#include <lightmodbus/server/backend.h>
+
+//io_uring backend - completion-based I/O using raw system calls (no liburing)
+//Multishot accept and receive operations stay armed, and take data buffers from ring of provided buffers
+//Responses are queued as send operations and submitted together with the next wait, so each loop iteration
+//costs one or two system calls, no matter how many requests are handled
+//Requires Linux 6.0 or newer (multishot receive) - deferred completion work is used on 6.1 and newer
+
+//Submission queue size
+#ifndef LIGHTMODBUS_SERVER_URING_ENTRIES
+#define LIGHTMODBUS_SERVER_URING_ENTRIES 1024
+#endif
+
+//Number of provided receive buffers (power of 2) and their size (not greater than receive buffer)
+#ifndef LIGHTMODBUS_SERVER_URING_BUFFERS
+#define LIGHTMODBUS_SERVER_URING_BUFFERS 1024
+#endif
+#ifndef LIGHTMODBUS_SERVER_URING_BUFFER_SIZE
+#define LIGHTMODBUS_SERVER_URING_BUFFER_SIZE LIGHTMODBUS_SERVER_RX_BUFFER
+#endif
+
+//Operations - slot number and operation type are encoded in user data
+#define MODBUS_URING_ACCEPT 0
+#define MODBUS_URING_RECV 1
+#define MODBUS_URING_SEND 2
+#define MODBUS_URING_READ 3
+#define MODBUS_URING_WRITE 4
+#define MODBUS_URING_CANCEL 5
+#define MODBUS_URING_DATA( slot, op ) ( ( (uint64_t) ( slot ) << 8 ) | ( op ) )
+
+//Received buffer kept until there's room for its data
+typedef struct
+{
+	uint16_t next; //Next buffer parked by the same connection
+	uint32_t offset; //Data not processed yet
+	uint32_t length;
+} ModbusServerParked;
+
+typedef struct
+{
+	//Submission and completion queues (single mapping)
+	void *ring;
+	size_t ringSize;
+	unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+	unsigned *cqHead, *cqTail, *cqMask;
+	struct io_uring_sqe *sqes;
+	size_t sqesSize;
+	struct io_uring_cqe *cqes;
+	unsigned sqEntries;
+	unsigned queued; //Number of operations not submitted yet
+	uint8_t disabled; //Ring is enabled by the thread calling modbusServerRun
+
+	//Provided buffers
+	struct io_uring_buf_ring *buffers;
+	uint8_t *bufferMemory;
+	size_t bufferRingSize;
+	uint16_t bufferTail;
+	ModbusServerParked *parked; //Indexed with buffer ID
+
+	uint16_t uncancelled; //Number of connections being closed, whose operations couldn't be cancelled yet (queue was full)
+} ModbusServerRing;
+
+static int modbusUringEnter( int fd, unsigned submit, unsigned wait, unsigned flags, void *arg, size_t argSize )
+{
+	return syscall( __NR_io_uring_enter, fd, submit, wait, flags, arg, argSize );
+}
+
+static uint8_t modbusUringSubmit( ModbusServer *server )
+{
+	//Submit queued operations without waiting
+	ModbusServerRing *ring = (ModbusServerRing *) server->backend;
+
+	if ( ring->queued == 0 ) return MODBUS_ERROR_OK;
+	if ( modbusUringEnter( server->backendFd, ring->queued, 0, 0, NULL, 0 ) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY )
+		return MODBUS_ERROR_OTHER;
+	ring->queued = *ring->sqTail - __atomic_load_n( ring->sqHead, __ATOMIC_ACQUIRE );
+
+	return MODBUS_ERROR_OK;
+}
+
+static struct io_uring_sqe *modbusUringQueue( ModbusServer *server, int fd, uint8_t opcode, uint16_t slot, uint8_t op )
+{
+	//Get next submission queue entry - if the queue is full, operations are submitted first
+	ModbusServerRing *ring = (ModbusServerRing *) server->backend;
+	struct io_uring_sqe *sqe;
+	unsigned tail = *ring->sqTail;
+
+	if ( tail - __atomic_load_n( ring->sqHead, __ATOMIC_ACQUIRE ) >= ring->sqEntries )
+	{
+		if ( ring->disabled || modbusUringSubmit( server ) ) return NULL;
+		if ( tail - __atomic_load_n( ring->sqHead, __ATOMIC_ACQUIRE ) >= ring->sqEntries ) return NULL;
+	}
+
+	sqe = ring->sqes + ( tail & *ring->sqMask );
+	memset( sqe, 0, sizeof( struct io_uring_sqe ) );
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->user_data = MODBUS_URING_DATA( slot, op );
+	ring->sqArray[tail & *ring->sqMask] = tail & *ring->sqMask;
+	__atomic_store_n( ring->sqTail, tail + 1, __ATOMIC_RELEASE );
+	ring->queued++;
+	return sqe;
+}
+
+static void modbusUringRecycle( ModbusServerRing *ring, uint16_t id )
+{
+	//Give buffer back to the kernel
+	struct io_uring_buf *buffer = ring->buffers->bufs + ( ring->bufferTail & ( LIGHTMODBUS_SERVER_URING_BUFFERS - 1 ) );
+
+	buffer->addr = (uint64_t) (uintptr_t) ( ring->bufferMemory + (size_t) id * LIGHTMODBUS_SERVER_URING_BUFFER_SIZE );
+	buffer->len = LIGHTMODBUS_SERVER_URING_BUFFER_SIZE;
+	buffer->bid = id;
+	__atomic_store_n( &ring->buffers->tail, ++ring->bufferTail, __ATOMIC_RELEASE );
+}
+
+static void modbusUringPark( ModbusServerRing *ring, ModbusServerConnection *conn, uint16_t id, uint32_t length )
+{
+	//Keep received buffer behind ones parked before, instead of giving it back to the kernel
+	ring->parked[id].offset = 0;
+	ring->parked[id].length = length;
+	if ( conn->parked++ ) ring->parked[conn->parkedTail].next = id;
+	else conn->parkedHead = id;
+	conn->parkedTail = id;
+}
+
+static uint8_t modbusUringUnpark( ModbusServer *server, ModbusServerConnection *conn )
+{
+	//Process parked buffers in order, until requests wait for room in transmit buffer again
+	ModbusServerRing *ring = (ModbusServerRing *) server->backend;
+	ModbusServerParked *parked;
+	uint32_t used;
+	uint16_t id;
+
+	while ( conn->parked && !modbusServerReady( conn ) )
+	{
+		id = conn->parkedHead;
+		parked = ring->parked + id;
+		if ( modbusServerProcess( server, conn, ring->bufferMemory + (size_t) id * LIGHTMODBUS_SERVER_URING_BUFFER_SIZE + parked->offset, parked->length, &used ) )
+			return MODBUS_ERROR_FRAME;
+
+		parked->offset += used;
+		parked->length -= used;
+		if ( parked->length ) break;
+
+		conn->parkedHead = parked->next;
+		conn->parked--;
+		modbusUringRecycle( ring, id );
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+static uint8_t modbusUringProbe( ModbusServer *server )
+{
+	//Check if all operations used are supported by the kernel
+	static const uint8_t opcodes[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_ASYNC_CANCEL };
+	struct io_uring_probe *probe;
+	uint8_t err = MODBUS_ERROR_OK;
+	uint8_t i;
+
+	probe = (struct io_uring_probe *) calloc( 1, sizeof( struct io_uring_probe ) + 256 * sizeof( struct io_uring_probe_op ) );
+	if ( probe == NULL ) return MODBUS_ERROR_ALLOC;
+
+	if ( syscall( __NR_io_uring_register, server->backendFd, IORING_REGISTER_PROBE, probe, 256 ) < 0 ) err = MODBUS_ERROR_OTHER;
+	for ( i = 0; i < sizeof( opcodes ) && err == MODBUS_ERROR_OK; i++ )
+		if ( opcodes[i] >= probe->ops_len || !( probe->ops[opcodes[i]].flags & IO_URING_OP_SUPPORTED ) ) err = MODBUS_ERROR_OTHER;
+
+	free( probe );
+	return err;
+}
+
+static uint8_t modbusUringAccept( ModbusServer *server )
+{
+	//Multishot accept - one operation accepts all incoming connections
+	struct io_uring_sqe *sqe = modbusUringQueue( server, server->listenFd, IORING_OP_ACCEPT, 0, MODBUS_URING_ACCEPT );
+
+	if ( sqe == NULL ) return MODBUS_ERROR_OTHER;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	return MODBUS_ERROR_OK;
+}
+
+static uint8_t modbusUringReceive( ModbusServer *server, ModbusServerConnection *conn, uint8_t flags )
+{
+	//Receive into provided buffer - TCP connections use multishot receive, and serial lines one-shot reads
+	uint16_t slot = conn - server->connections;
+	struct io_uring_sqe *sqe = conn->serial ? \
+		modbusUringQueue( server, conn->fd, IORING_OP_READ, slot, MODBUS_URING_READ ) : \
+		modbusUringQueue( server, conn->fd, IORING_OP_RECV, slot, MODBUS_URING_RECV );
+
+	if ( sqe == NULL ) return MODBUS_ERROR_OTHER;
+	if ( conn->serial ) sqe->off = (uint64_t) -1;
+	else sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->len = conn->serial ? LIGHTMODBUS_SERVER_URING_BUFFER_SIZE : 0;
+	sqe->flags = IOSQE_BUFFER_SELECT | flags;
+	sqe->buf_group = 0;
+	conn->receiving = 1;
+	conn->pending++;
+	return MODBUS_ERROR_OK;
+}
+
+static void modbusUringDone( ModbusServer *server, ModbusServerConnection *conn )
+{
+	//Operation finished - connection being closed is released after the last one
+	if ( --conn->pending == 0 && conn->closing )
+	{
+		if ( conn->closing == 2 ) ( (ModbusServerRing *) server->backend )->uncancelled--;
+		modbusServerRelease( server, conn );
+	}
+}
+
+static void modbusUringCancel( ModbusServer *server, ModbusServerConnection *conn )
+{
+	//Cancel all operations of connection being closed - if there's no room in submission queue, it's retried after next wait
+	ModbusServerRing *ring = (ModbusServerRing *) server->backend;
+	struct io_uring_sqe *sqe = modbusUringQueue( server, -1, IORING_OP_ASYNC_CANCEL, conn - server->connections, MODBUS_URING_CANCEL );
+
+	if ( sqe == NULL )
+	{
+		conn->closing = 2;
+		ring->uncancelled++;
+		return;
+	}
+
+	sqe->fd = conn->fd;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+	conn->pending++;
+}
+
+void modbusServerBackendClose( ModbusServer *server, ModbusServerConnection *conn )
+{
+	//Cancel all pending operations, and release the connection once they're finished
+	ModbusServerRing *ring = (ModbusServerRing *) server->backend;
+
+	if ( conn->closing ) return;
+	conn->closing = 1;
+
+	//Parked buffers won't be processed anymore
+	for ( ; conn->parked; conn->parked-- )
+	{
+		modbusUringRecycle( ring, conn->parkedHead );
+		conn->parkedHead = ring->parked[conn->parkedHead].next;
+	}
+
+	if ( conn->pending == 0 )
+	{
+		modbusServerRelease( server, conn );
+		return;
+	}
+
+	modbusUringCancel( server, conn );
+}
+
+uint8_t modbusServerBackendAdd( ModbusServer *server, ModbusServerConnection *conn )
+{
+	return modbusUringReceive( server, conn, 0 );
+}
+
+uint8_t modbusServerBackendFlush( ModbusServer *server, ModbusServerConnection *conn )
+{
+	//Queue send operation for collected responses - responses appended meanwhile are sent after it completes
+	//On serial lines, next read is linked to the write, so it's started as soon as the response is out
+	uint16_t slot = conn - server->connections;
+	struct io_uring_sqe *sqe;
+
+	if ( conn->closing || conn->sending || conn->txLength == 0 ) return MODBUS_ERROR_OK;
+
+	sqe = conn->serial ? \
+		modbusUringQueue( server, conn->fd, IORING_OP_WRITE, slot, MODBUS_URING_WRITE ) : \
+		modbusUringQueue( server, conn->fd, IORING_OP_SEND, slot, MODBUS_URING_SEND );
+	if ( sqe == NULL ) return MODBUS_ERROR_OTHER;
+
+	sqe->addr = (uint64_t) (uintptr_t) conn->tx;
+	sqe->len = conn->txLength;
+	if ( conn->serial ) sqe->off = (uint64_t) -1;
+	else sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+	conn->sending = conn->txLength;
+	conn->pending++;
+
+	if ( conn->serial && !conn->receiving )
+	{
+		sqe->flags = IOSQE_IO_LINK;
+		return modbusUringReceive( server, conn, 0 );
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+static uint8_t modbusUringReceived( ModbusServer *server, ModbusServerConnection *conn, int result, uint32_t flags )
+{
+	//Handle data received from TCP connection or serial line
+	ModbusServerRing *ring = (ModbusServerRing *) server->backend;
+	uint8_t err = MODBUS_ERROR_OK;
+	uint16_t id;
+
+	if ( !( flags & IORING_CQE_F_MORE ) ) conn->receiving = 0;
+
+	if ( result > 0 && ( flags & IORING_CQE_F_BUFFER ) )
+	{
+		id = flags >> IORING_CQE_BUFFER_SHIFT;
+		if ( conn->closing ) modbusUringRecycle( ring, id );
+		else if ( conn->serial )
+		{
+			err = modbusServerProcessSerial( server, conn, ring->bufferMemory + (size_t) id * LIGHTMODBUS_SERVER_URING_BUFFER_SIZE, result, modbusServerTime( ) );
+			modbusUringRecycle( ring, id );
+		}
+		else
+		{
+			//TCP data is parked first - it's processed right away, unless requests are waiting for room in transmit buffer
+			//(receive operation can still complete after it's cancelled)
+			modbusUringPark( ring, conn, id, result );
+			err = modbusUringUnpark( server, conn );
+		}
+		if ( err ) return err;
+	}
+	else if ( result == 0 || ( result < 0 && result != -ENOBUFS && !( result == -ECANCELED && conn->writing ) ) )
+		return MODBUS_ERROR_OTHER;
+
+	if ( conn->closing ) return MODBUS_ERROR_OK;
+	if ( modbusServerBackendFlush( server, conn ) ) return MODBUS_ERROR_OTHER;
+
+	//Requests are left in receive buffer, because transmit buffer is full - stop receiving until responses are sent
+	if ( ( modbusServerReady( conn ) || conn->parked ) && !conn->writing )
+	{
+		struct io_uring_sqe *sqe = modbusUringQueue( server, -1, IORING_OP_ASYNC_CANCEL, conn - server->connections, MODBUS_URING_CANCEL );
+		if ( sqe == NULL ) return MODBUS_ERROR_OTHER;
+		sqe->addr = MODBUS_URING_DATA( conn - server->connections, MODBUS_URING_RECV );
+		conn->writing = 1;
+		conn->pending++;
+	}
+
+	//Keep receiving (unless next read is already linked to write)
+	if ( !conn->receiving && !conn->writing && !( conn->serial && conn->sending ) )
+		return modbusUringReceive( server, conn, 0 );
+
+	return MODBUS_ERROR_OK;
+}
+
+static uint8_t modbusUringSent( ModbusServer *server, ModbusServerConnection *conn, int result )
+{
+	//Handle finished send operation - remove sent data and send the rest
+	if ( result < 0 ) return MODBUS_ERROR_OTHER;
+
+	conn->txLength -= result;
+	if ( conn->txLength ) memmove( conn->tx, conn->tx + result, conn->txLength );
+	conn->sending = 0;
+	if ( conn->closing ) return MODBUS_ERROR_OK;
+
+	//Process requests waiting for room in transmit buffer, and then data received meanwhile
+	if ( modbusServerReady( conn ) && modbusServerProcess( server, conn, NULL, 0, NULL ) ) return MODBUS_ERROR_FRAME;
+	if ( modbusUringUnpark( server, conn ) ) return MODBUS_ERROR_FRAME;
+	if ( modbusServerBackendFlush( server, conn ) ) return MODBUS_ERROR_OTHER;
+
+	//Resume receiving
+	if ( conn->writing && !modbusServerReady( conn ) && !conn->parked )
+	{
+		conn->writing = 0;
+		if ( !conn->receiving ) return modbusUringReceive( server, conn, 0 );
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
+static void modbusUringComplete( ModbusServer *server, struct io_uring_cqe *cqe )
+{
+	//Handle single completion
+	ModbusServerConnection *conn;
+	uint8_t op = cqe->user_data & 0xff;
+	uint8_t err = MODBUS_ERROR_OK;
+	int one = 1;
+
+	if ( op == MODBUS_URING_ACCEPT )
+	{
+		if ( cqe->res >= 0 )
+		{
+			//No free slots
+			if ( ( conn = modbusServerOpen( server, cqe->res, 0 ) ) == NULL ) close( cqe->res );
+			else
+			{
+				setsockopt( conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+				if ( modbusUringReceive( server, conn, 0 ) ) modbusServerRelease( server, conn );
+			}
+		}
+		if ( !( cqe->flags & IORING_CQE_F_MORE ) && cqe->res != -ECANCELED ) modbusUringAccept( server );
+		return;
+	}
+
+	conn = server->connections + ( cqe->user_data >> 8 );
+	switch ( op )
+	{
+		case MODBUS_URING_RECV:
+		case MODBUS_URING_READ:
+			err = modbusUringReceived( server, conn, cqe->res, cqe->flags );
+			break;
+
+		case MODBUS_URING_SEND:
+		case MODBUS_URING_WRITE:
+			err = modbusUringSent( server, conn, cqe->res );
+			break;
+	}
+
+	//Broken connections and clients sending garbage are dropped
+	if ( err ) modbusServerBackendClose( server, conn );
+	if ( !( cqe->flags & IORING_CQE_F_MORE ) ) modbusUringDone( server, conn );
+}
+
+uint8_t modbusServerBackendRun( ModbusServer *server, int timeout )
+{
+	//Submit queued operations and wait for at least one completion, then handle all of them
+	ModbusServerRing *ring = (ModbusServerRing *) server->backend;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned head, tail;
+	uint16_t i;
+	int count;
+
+	//Ring has been created disabled, so it can be used only by this thread
+	if ( ring->disabled )
+	{
+		if ( syscall( __NR_io_uring_register, server->backendFd, IORING_REGISTER_ENABLE_RINGS, NULL, 0 ) < 0 ) return MODBUS_ERROR_OTHER;
+		ring->disabled = 0;
+	}
+
+	memset( &arg, 0, sizeof( arg ) );
+	if ( timeout >= 0 )
+	{
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = ( timeout % 1000 ) * 1000000l;
+		arg.ts = (uint64_t) (uintptr_t) &ts;
+	}
+
+	count = modbusUringEnter( server->backendFd, ring->queued, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof( arg ) );
+	if ( count < 0 && errno != ETIME && errno != EINTR && errno != EBUSY ) return MODBUS_ERROR_OTHER;
+	ring->queued = *ring->sqTail - __atomic_load_n( ring->sqHead, __ATOMIC_ACQUIRE );
+
+	head = *ring->cqHead;
+	tail = __atomic_load_n( ring->cqTail, __ATOMIC_ACQUIRE );
+	while ( head != tail )
+	{
+		modbusUringComplete( server, ring->cqes + ( head & *ring->cqMask ) );
+		__atomic_store_n( ring->cqHead, ++head, __ATOMIC_RELEASE );
+	}
+
+	//Queued operations have been submitted, so there's room for cancellations that didn't fit before
+	for ( i = 0; i < server->maxConnections && ring->uncancelled; i++ )
+		if ( server->connections[i].fd >= 0 && server->connections[i].closing == 2 )
+		{
+			server->connections[i].closing = 1;
+			ring->uncancelled--;
+			modbusUringCancel( server, server->connections + i );
+		}
+
+	//Responses go out right away
+	return modbusUringSubmit( server );
+}
+
+uint8_t modbusServerBackendInit( ModbusServer *server )
+{
+	//Set up io_uring instance and provided buffers, and start accepting connections
+	ModbusServerRing *ring;
+	struct io_uring_params params;
+	struct io_uring_buf_reg reg;
+	uint16_t i;
+
+	if ( ( ring = (ModbusServerRing *) calloc( 1, sizeof( ModbusServerRing ) ) ) == NULL ) return MODBUS_ERROR_ALLOC;
+	server->backend = ring;
+
+	//Ring is only used by one thread, so kernel can defer completion work until it waits for events
+	//Linux 6.0 doesn't support that yet - and older kernels, which don't know single issuer rings either,
+	//have no multishot receive, so they're rejected
+	memset( &params, 0, sizeof( params ) );
+	params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+	server->backendFd = syscall( __NR_io_uring_setup, LIGHTMODBUS_SERVER_URING_ENTRIES, &params );
+	if ( server->backendFd < 0 && errno == EINVAL )
+	{
+		memset( &params, 0, sizeof( params ) );
+		params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_R_DISABLED;
+		server->backendFd = syscall( __NR_io_uring_setup, LIGHTMODBUS_SERVER_URING_ENTRIES, &params );
+	}
+	if ( server->backendFd < 0 ) return MODBUS_ERROR_OTHER;
+	if ( !( params.features & IORING_FEAT_SINGLE_MMAP ) || !( params.features & IORING_FEAT_EXT_ARG ) ) return MODBUS_ERROR_OTHER;
+	if ( modbusUringProbe( server ) ) return MODBUS_ERROR_OTHER;
+	ring->disabled = ( params.flags & IORING_SETUP_R_DISABLED ) != 0;
+
+	//Map submission and completion queues
+	ring->ringSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+	if ( params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe ) > ring->ringSize )
+		ring->ringSize = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+	ring->sqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+	ring->ring = mmap( NULL, ring->ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, server->backendFd, IORING_OFF_SQ_RING );
+	ring->sqes = mmap( NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, server->backendFd, IORING_OFF_SQES );
+	if ( ring->ring == MAP_FAILED || ring->sqes == MAP_FAILED ) return MODBUS_ERROR_OTHER;
+
+	ring->sqHead = (unsigned *) ( (uint8_t *) ring->ring + params.sq_off.head );
+	ring->sqTail = (unsigned *) ( (uint8_t *) ring->ring + params.sq_off.tail );
+	ring->sqMask = (unsigned *) ( (uint8_t *) ring->ring + params.sq_off.ring_mask );
+	ring->sqArray = (unsigned *) ( (uint8_t *) ring->ring + params.sq_off.array );
+	ring->cqHead = (unsigned *) ( (uint8_t *) ring->ring + params.cq_off.head );
+	ring->cqTail = (unsigned *) ( (uint8_t *) ring->ring + params.cq_off.tail );
+	ring->cqMask = (unsigned *) ( (uint8_t *) ring->ring + params.cq_off.ring_mask );
+	ring->cqes = (struct io_uring_cqe *) ( (uint8_t *) ring->ring + params.cq_off.cqes );
+	ring->sqEntries = params.sq_entries;
+
+	//Register ring of provided buffers, and fill it
+	ring->bufferRingSize = LIGHTMODBUS_SERVER_URING_BUFFERS * sizeof( struct io_uring_buf );
+	ring->buffers = mmap( NULL, ring->bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	ring->bufferMemory = (uint8_t *) malloc( (size_t) LIGHTMODBUS_SERVER_URING_BUFFERS * LIGHTMODBUS_SERVER_URING_BUFFER_SIZE );
+	ring->parked = (ModbusServerParked *) calloc( LIGHTMODBUS_SERVER_URING_BUFFERS, sizeof( ModbusServerParked ) );
+	if ( ring->buffers == MAP_FAILED || ring->bufferMemory == NULL || ring->parked == NULL ) return MODBUS_ERROR_ALLOC;
+
+	memset( &reg, 0, sizeof( reg ) );
+	reg.ring_addr = (uint64_t) (uintptr_t) ring->buffers;
+	reg.ring_entries = LIGHTMODBUS_SERVER_URING_BUFFERS;
+	reg.bgid = 0;
+	if ( syscall( __NR_io_uring_register, server->backendFd, IORING_REGISTER_PBUF_RING, &reg, 1 ) < 0 ) return MODBUS_ERROR_OTHER;
+	for ( i = 0; i < LIGHTMODBUS_SERVER_URING_BUFFERS; i++ )
+		modbusUringRecycle( ring, i );
+
+	return modbusUringAccept( server );
+}
+
+void modbusServerBackendEnd( ModbusServer *server )
+{
+	//Closing io_uring instance cancels all operations
+	ModbusServerRing *ring = (ModbusServerRing *) server->backend;
+
+	if ( server->backendFd >= 0 ) close( server->backendFd );
+	server->backendFd = -1;
+	if ( ring == NULL ) return;
+
+	if ( ring->ring != NULL && ring->ring != MAP_FAILED ) munmap( ring->ring, ring->ringSize );
+	if ( ring->sqes != NULL && ring->sqes != MAP_FAILED ) munmap( ring->sqes, ring->sqesSize );
+	if ( ring->buffers != NULL && ring->buffers != MAP_FAILED ) munmap( ring->buffers, ring->bufferRingSize );
+	free( ring->bufferMemory );
+	free( ring->parked );
+	free( ring );
+	server->backend = NULL;
+}
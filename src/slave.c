@@ -25,6 +25,50 @@
 #include <lightmodbus/slave/sregs.h>
 #include <lightmodbus/slave/scoils.h>
 
+//Built-in request handlers - only enabled modules are linked in
+const ModbusSlaveHandler modbusSlaveDefaultFunctions[256] =
+{
+	#if LIGHTMODBUS_SLAVE_COILS
+	[1] = modbusParseRequest0102, //Read multiple coils
+	[2] = modbusParseRequest0102, //Read multiple discrete inputs
+	[5] = modbusParseRequest05, //Write single coil
+	[15] = modbusParseRequest15, //Write multiple coils
+	#endif
+
+	#if LIGHTMODBUS_SLAVE_REGISTERS
+	[3] = modbusParseRequest0304, //Read multiple holding registers
+	[4] = modbusParseRequest0304, //Read multiple input registers
+	[6] = modbusParseRequest06, //Write single holding reg
+	[16] = modbusParseRequest16, //Write multiple holding registers
+	[22] = modbusParseRequest22, //Mask write single register
+	#endif
+};
+
+uint8_t modbusSlaveAllocateResponse( ModbusSlave *status, uint8_t length )
+{
+	//Prepare response frame memory for frame of given length
+	//In static memory mode, buffer provided by user (at least 256 bytes long, 260 for Modbus TCP) is used instead
+
+	//Check if given pointer is valid
+	if ( status == NULL ) return MODBUS_ERROR_OTHER;
+
+	//Response is built in place of request - nothing to do
+	if ( status->response.frame != NULL && status->response.frame == status->request.frame ) return MODBUS_ERROR_OK;
+
+	//Modbus TCP response buffer (of maximum length) is allocated before parsing
+	if ( status->tcp ) return status->response.frame == NULL ? MODBUS_ERROR_ALLOC : MODBUS_ERROR_OK;
+
+	#if LIGHTMODBUS_STATIC_MEM_SLAVE
+	if ( status->response.frame == NULL ) return MODBUS_ERROR_ALLOC;
+	#else
+	free( status->response.frame );
+	status->response.frame = (uint8_t *) calloc( length, sizeof( uint8_t ) );
+	if ( status->response.frame == NULL ) return MODBUS_ERROR_ALLOC;
+	#endif
+
+	return MODBUS_ERROR_OK;
+}
+
 uint8_t modbusBuildException( ModbusSlave *status, uint8_t function, uint8_t code )
 {
 	//Generates modbus exception frame in allocated memory frame
@@ -34,15 +78,14 @@ uint8_t modbusBuildException( ModbusSlave *status, uint8_t function, uint8_t cod
 	if ( status == NULL || code == 0 ) return MODBUS_ERROR_OTHER;
 
 	//Reallocate frame memory
-	status->response.frame = (uint8_t *) calloc( 5, sizeof( uint8_t ) );
-	if ( status->response.frame == NULL ) return MODBUS_ERROR_ALLOC;
+	if ( modbusSlaveAllocateResponse( status, 5 ) ) return MODBUS_ERROR_ALLOC;
 	union ModbusParser *exception = (union ModbusParser *) status->response.frame;
 
 	//Setup exception frame
 	exception->exception.address = status->address;
 	exception->exception.function = ( 1 << 7 ) | function;
 	exception->exception.code = code;
-	exception->exception.crc = modbusCRC( exception->frame, 3 );
+	if ( !status->tcp ) exception->exception.crc = modbusCRC( exception->frame, 3 );
 
 	//Set frame length - frame is ready
 	status->response.length = 5;
@@ -52,87 +95,208 @@ uint8_t modbusBuildException( ModbusSlave *status, uint8_t function, uint8_t cod
 	return MODBUS_ERROR_EXCEPTION;
 }
 
-uint8_t modbusParseRequest( ModbusSlave *status )
+static uint8_t modbusParseRequestRTU( ModbusSlave *status, uint16_t crc )
 {
 	//Parse and interpret given modbus frame on slave-side
+	//CRC has been already calculated over whole frame (including CRC field), eg. while it was being received
 	uint8_t err = 0;
-
-	//Check if given pointer is valid
-	if ( status == NULL ) return MODBUS_ERROR_OTHER;
+	ModbusSlaveHandler handler;
 
 	//Reset response frame status
 	status->response.length = 0;
 
-	//If there is memory allocated for response frame - free it
-	free( status->response.frame );
-	status->response.frame = NULL;
+	//If there is memory allocated for response frame - free it (unless response is built in place of request)
+	//Modbus TCP response buffer is already prepared at this point
+	#if !LIGHTMODBUS_STATIC_MEM_SLAVE
+	if ( status->response.frame != status->request.frame && !status->tcp )
+	{
+		free( status->response.frame );
+		status->response.frame = NULL;
+	}
+	#endif
 
 	//If user tries to parse an empty frame return error
 	//That enables us to ommit the check in each parsing function
 	if ( status->request.length < 4u || status->request.frame == NULL ) return MODBUS_ERROR_OTHER;
 
-	//Check CRC
-	if ( *( (uint16_t*)( status->request.frame + status->request.length - 2 ) )\
-		!= modbusCRC( status->request.frame, status->request.length - 2 ) )
-			return MODBUS_ERROR_CRC;
-
+	//Check CRC - remainder of frame with valid CRC is 0
+	if ( modbusCRCFinal( crc ) != 0 ) return MODBUS_ERROR_CRC;
 
 	union ModbusParser *parser = (union ModbusParser *) status->request.frame;
 
 	//If frame is not broadcasted and address doesn't match skip parsing
-	if ( parser->base.address != status->address && parser->base.address != 0 )
-		return MODBUS_ERROR_OK;
+	//Modbus TCP devices shall also respond to unit identifier 0xFF
+	//There are no broadcasts in Modbus TCP - unit identifier 0 addresses the device directly, so it's answered like own address
+	if ( parser->base.address != status->address && parser->base.address != 0 && \
+		!( status->tcp && parser->base.address == 0xFF ) )
+			return MODBUS_ERROR_OK;
 
-	switch ( parser->base.function )
-	{
-		case 1: //Read multiple coils
-		case 2: //Read multiple discrete inputs
-			if ( LIGHTMODBUS_SLAVE_COILS ) err = modbusParseRequest0102( status, parser );
-			else err = MODBUS_ERROR_PARSE;
-			break;
+	//Pick request handler - function codes without one are not supported
+	handler = ( status->functions != NULL ? status->functions : modbusSlaveDefaultFunctions )[parser->base.function];
+	err = handler != NULL ? handler( status, parser ) : MODBUS_ERROR_PARSE;
+
+	if ( err == MODBUS_ERROR_PARSE )
+		if ( parser->base.address != 0 || status->tcp ) err = modbusBuildException( status, parser->base.function, MODBUS_EXCEP_ILLEGAL_FUNC );
+
+	return err;
+}
+
+static uint8_t modbusParseRequestTCP( ModbusSlave *status )
+{
+	//Parse Modbus TCP request - after MBAP header is checked, PDU is parsed in place, just like RTU frame without CRC
+	//Response gets the same MBAP header, with length updated
+	union ModbusParser *parser = (union ModbusParser *) status->request.frame;
+	union ModbusParser *builder;
+	uint16_t requestLength = status->request.length;
+	uint8_t unit, err;
 
-		case 3: //Read multiple holding registers
-		case 4: //Read multiple input registers
-			if ( LIGHTMODBUS_SLAVE_REGISTERS ) err = modbusParseRequest0304( status, parser );
-			else err = MODBUS_ERROR_PARSE;
-			break;
+	//Reset response frame status
+	status->response.length = 0;
 
-		case 5: //Write single coil
-			if ( LIGHTMODBUS_SLAVE_COILS ) err = modbusParseRequest05( status, parser );
-			else err = MODBUS_ERROR_PARSE;
-			break;
+	//Frame has to contain at least MBAP header and function code
+	if ( requestLength < MODBUS_TCP_OFFSET + 2 || parser == NULL ) return MODBUS_ERROR_OTHER;
+	if ( parser->mbap.protocol != 0 || modbusSwapEndian( parser->mbap.length ) != requestLength - MODBUS_TCP_OFFSET )
+		return MODBUS_ERROR_FRAME;
 
-		case 6: //Write single holding reg
-			if ( LIGHTMODBUS_SLAVE_REGISTERS ) err = modbusParseRequest06( status, parser );
-			else err = MODBUS_ERROR_PARSE;
-			break;
+	//Response frame can't be reallocated while it's shifted, so frame of maximum length is allocated up front
+	#if !LIGHTMODBUS_STATIC_MEM_SLAVE
+	if ( status->response.frame != status->request.frame )
+	{
+		free( status->response.frame );
+		status->response.frame = (uint8_t *) calloc( MODBUS_TCP_MAX_LENGTH, sizeof( uint8_t ) );
+		if ( status->response.frame == NULL ) return MODBUS_ERROR_ALLOC;
+	}
+	#else
+	if ( status->response.frame == NULL ) return MODBUS_ERROR_ALLOC;
+	#endif
 
-		case 15: //Write multiple coils
-			if ( LIGHTMODBUS_SLAVE_COILS ) err = modbusParseRequest15( status, parser );
-			else err = MODBUS_ERROR_PARSE;
-			break;
+	//Unit identifier is echoed (response may be built in place of request, so it has to be saved)
+	unit = parser->mbap.unit;
 
-		case 16: //Write multiple holding registers
-			if ( LIGHTMODBUS_SLAVE_REGISTERS ) err = modbusParseRequest16( status, parser );
-			else err = MODBUS_ERROR_PARSE;
-			break;
+	//Skip MBAP headers (unit identifier becomes slave address) and pretend request has CRC
+	status->request.frame += MODBUS_TCP_OFFSET;
+	status->request.length = requestLength - MODBUS_TCP_OFFSET + 2;
+	status->response.frame += MODBUS_TCP_OFFSET;
 
-		case 22: //Mask write single register
-			if ( LIGHTMODBUS_SLAVE_REGISTERS ) err = modbusParseRequest22( status, parser );
-			else err = MODBUS_ERROR_PARSE;
-			break;
+	err = modbusParseRequestRTU( status, 0 );
 
-		default:
-			err = MODBUS_ERROR_PARSE;
-			break;
+	status->request.frame -= MODBUS_TCP_OFFSET;
+	status->request.length = requestLength;
+	status->response.frame -= MODBUS_TCP_OFFSET;
+
+	//Prepend MBAP header to response (RTU length includes CRC)
+	if ( status->response.length != 0 )
+	{
+		builder = (union ModbusParser *) status->response.frame;
+		builder->mbap.transaction = parser->mbap.transaction;
+		builder->mbap.protocol = 0;
+		builder->mbap.length = modbusSwapEndian( status->response.length - 2 );
+		builder->mbap.unit = unit;
+		status->response.length += MODBUS_TCP_OFFSET - 2;
 	}
 
-	if ( err == MODBUS_ERROR_PARSE )
-		if ( parser->base.address != 0 ) err = modbusBuildException( status, parser->base.function, MODBUS_EXCEP_ILLEGAL_FUNC );
+	return err;
+}
+
+uint8_t modbusParseRequestCRC( ModbusSlave *status, uint16_t crc )
+{
+	//Parse and interpret given modbus frame on slave-side
+	//CRC has been already calculated over whole frame (including CRC field), eg. while it was being received
+	//(Modbus TCP frames have no CRC, so it's ignored)
+
+	//Check if given pointer is valid
+	if ( status == NULL ) return MODBUS_ERROR_OTHER;
+
+	if ( status->tcp ) return modbusParseRequestTCP( status );
+	return modbusParseRequestRTU( status, crc );
+}
+
+uint8_t modbusParseRequest( ModbusSlave *status )
+{
+	//Parse and interpret given modbus frame on slave-side
+
+	//Check if given pointer is valid
+	if ( status == NULL ) return MODBUS_ERROR_OTHER;
+
+	//There's no CRC in Modbus TCP frames
+	if ( status->tcp ) return modbusParseRequestTCP( status );
+
+	return modbusParseRequestCRC( status, modbusCRC( status->request.frame, status->request.length ) );
+}
+
+uint8_t modbusParseRequestInPlaceCRC( ModbusSlave *status, uint16_t crc )
+{
+	//Parse and interpret given modbus frame on slave-side, building response in place of request
+	//Request frame buffer has to be at least 256 bytes long (260 for Modbus TCP)
+	//Response length is written to status->response.length, status->response.frame is left untouched
+	//(in dynamic memory mode it's freed, so it's NULL afterwards)
+	uint8_t err = 0;
+	uint8_t *response;
+
+	//Check if given pointer is valid
+	if ( status == NULL ) return MODBUS_ERROR_OTHER;
+	if ( status->request.frame == NULL ) return MODBUS_ERROR_OTHER;
+
+	//Previous response is not needed anymore
+	#if !LIGHTMODBUS_STATIC_MEM_SLAVE
+	if ( status->response.frame != status->request.frame ) free( status->response.frame );
+	status->response.frame = NULL;
+	#endif
+
+	//Temporarily point response frame at request frame
+	response = status->response.frame;
+	status->response.frame = status->request.frame;
+	err = modbusParseRequestCRC( status, crc );
+	status->response.frame = response;
 
 	return err;
 }
 
+uint8_t modbusParseRequestInPlace( ModbusSlave *status )
+{
+	//Parse and interpret given modbus frame on slave-side, building response in place of request
+
+	//Check if given pointer is valid
+	if ( status == NULL ) return MODBUS_ERROR_OTHER;
+
+	//There's no CRC in Modbus TCP frames
+	if ( status->tcp ) return modbusParseRequestInPlaceCRC( status, 0 );
+
+	return modbusParseRequestInPlaceCRC( status, modbusCRC( status->request.frame, status->request.length ) );
+}
+
+static uint8_t modbusSlaveCheckSegments( const ModbusRegisterSegment *segments, uint16_t segmentCount )
+{
+	//Check if register map segments are sorted, don't overlap, and have storage (or callback)
+	uint32_t end = 0;
+	uint16_t i;
+
+	for ( i = 0; i < segmentCount; i++ )
+	{
+		if ( segments[i].count == 0 || ( segments[i].values == NULL && segments[i].callback == NULL ) || segments[i].base < end ) return 0;
+		end = (uint32_t) segments[i].base + segments[i].count;
+		if ( end > 65536 ) return 0;
+	}
+
+	return 1;
+}
+
+static uint8_t modbusSlaveCheckCoilSegments( const ModbusCoilSegment *segments, uint16_t segmentCount )
+{
+	//The same for coil map segments
+	uint32_t end = 0;
+	uint16_t i;
+
+	for ( i = 0; i < segmentCount; i++ )
+	{
+		if ( segments[i].count == 0 || ( segments[i].values == NULL && segments[i].callback == NULL ) || segments[i].base < end ) return 0;
+		end = (uint32_t) segments[i].base + segments[i].count;
+		if ( end > 65536 ) return 0;
+	}
+
+	return 1;
+}
+
 uint8_t modbusSlaveInit( ModbusSlave *status )
 {
 	//Very basic init of slave side
@@ -145,7 +309,13 @@ uint8_t modbusSlaveInit( ModbusSlave *status )
 	status->request.length = 0;
 	status->request.frame = NULL;
 	status->response.length = 0;
+
+	//In static memory mode response frame buffer has to be provided by user
+	#if LIGHTMODBUS_STATIC_MEM_SLAVE
+	if ( status->response.frame == NULL ) return MODBUS_ERROR_ALLOC;
+	#else
 	status->response.frame = NULL;
+	#endif
 
 	if ( status->address == 0 )
 	{
@@ -178,6 +348,46 @@ uint8_t modbusSlaveInit( ModbusSlave *status )
 		status->inputRegisters = NULL;
 	}
 
+	if ( status->registerSegmentCount == 0 || status->registerSegments == NULL )
+	{
+		status->registerSegmentCount = 0;
+		status->registerSegments = NULL;
+	}
+
+	if ( status->inputRegisterSegmentCount == 0 || status->inputRegisterSegments == NULL )
+	{
+		status->inputRegisterSegmentCount = 0;
+		status->inputRegisterSegments = NULL;
+	}
+
+	if ( status->coilSegmentCount == 0 || status->coilSegments == NULL )
+	{
+		status->coilSegmentCount = 0;
+		status->coilSegments = NULL;
+	}
+
+	if ( status->discreteInputSegmentCount == 0 || status->discreteInputSegments == NULL )
+	{
+		status->discreteInputSegmentCount = 0;
+		status->discreteInputSegments = NULL;
+	}
+
+	if ( !modbusSlaveCheckSegments( status->registerSegments, status->registerSegmentCount ) || \
+		!modbusSlaveCheckSegments( status->inputRegisterSegments, status->inputRegisterSegmentCount ) || \
+		!modbusSlaveCheckCoilSegments( status->coilSegments, status->coilSegmentCount ) || \
+		!modbusSlaveCheckCoilSegments( status->discreteInputSegments, status->discreteInputSegmentCount ) )
+	{
+		status->registerSegmentCount = 0;
+		status->registerSegments = NULL;
+		status->inputRegisterSegmentCount = 0;
+		status->inputRegisterSegments = NULL;
+		status->coilSegmentCount = 0;
+		status->coilSegments = NULL;
+		status->discreteInputSegmentCount = 0;
+		status->discreteInputSegments = NULL;
+		return MODBUS_ERROR_OTHER;
+	}
+
 	return MODBUS_ERROR_OK;
 }
 
@@ -187,7 +397,98 @@ uint8_t modbusSlaveEnd( ModbusSlave *status )
 	if ( status == NULL ) return MODBUS_ERROR_OTHER;
 
 	//Free memory
+	#if !LIGHTMODBUS_STATIC_MEM_SLAVE
 	free( status->response.frame );
+	status->response.frame = NULL;
+	#endif
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusDirtyRecord( ModbusDirtyLog *log, uint16_t index, uint16_t count )
+{
+	//Mark count elements starting at index as changed - called by write request handlers
+	//Range is merged with recorded ones it overlaps or touches. If it can't be stored separately, the two
+	//closest ranges (including the new one) are merged, so some unchanged elements may be reported too
+	ModbusDirtyRange *r;
+	uint32_t start = index, end = (uint32_t) index + count, gap, best = UINT32_MAX;
+	uint16_t i, j, k, pair = 0;
+
+	//Check if given pointer is valid
+	if ( log == NULL || log->ranges == NULL || log->capacity == 0 ) return MODBUS_ERROR_OTHER;
+	if ( count == 0 ) return MODBUS_ERROR_OK;
+
+	r = log->ranges;
+	log->generation++;
+
+	//Find ranges overlapping or touching the new one
+	for ( i = 0; i < log->count && r[i].index + r[i].count < start; i++ );
+	for ( j = i; j < log->count && r[j].index <= end; j++ )
+	{
+		if ( r[j].index < start ) start = r[j].index;
+		if ( r[j].index + r[j].count > end ) end = r[j].index + r[j].count;
+	}
+
+	//Replace them with one range
+	if ( j > i )
+	{
+		r[i].index = start;
+		r[i].count = end - start;
+		memmove( r + i + 1, r + j, ( log->count - j ) * sizeof( ModbusDirtyRange ) );
+		log->count -= j - i - 1;
+		return MODBUS_ERROR_OK;
+	}
+
+	//No room for new range - merge the closest ones
+	if ( log->count == log->capacity )
+	{
+		for ( k = 0; k + 1 < log->count; k++ )
+		{
+			gap = r[k + 1].index - ( r[k].index + r[k].count );
+			if ( gap < best )
+			{
+				best = gap;
+				pair = k;
+			}
+		}
+
+		//New range is closer to one of its neighbours - extend the neighbour
+		if ( i > 0 && start - ( r[i - 1].index + r[i - 1].count ) <= best && \
+			( i == log->count || start - ( r[i - 1].index + r[i - 1].count ) <= r[i].index - end ) )
+		{
+			r[i - 1].count = end - r[i - 1].index;
+			return MODBUS_ERROR_OK;
+		}
+		if ( i < log->count && r[i].index - end <= best )
+		{
+			r[i].count = r[i].index + r[i].count - start;
+			r[i].index = start;
+			return MODBUS_ERROR_OK;
+		}
+
+		//Otherwise merge the closest pair of recorded ranges
+		r[pair].count = r[pair + 1].index + r[pair + 1].count - r[pair].index;
+		memmove( r + pair + 1, r + pair + 2, ( log->count - pair - 2 ) * sizeof( ModbusDirtyRange ) );
+		log->count--;
+		if ( pair < i ) i--;
+	}
+
+	//Insert new range
+	memmove( r + i + 1, r + i, ( log->count - i ) * sizeof( ModbusDirtyRange ) );
+	r[i].index = start;
+	r[i].count = end - start;
+	log->count++;
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusDirtyClear( ModbusDirtyLog *log )
+{
+	//Forget recorded ranges - generation is left untouched, so it can be used to tell if anything changed meanwhile
+
+	//Check if given pointer is valid
+	if ( log == NULL ) return MODBUS_ERROR_OTHER;
 
+	log->count = 0;
 	return MODBUS_ERROR_OK;
 }
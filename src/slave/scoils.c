@@ -23,6 +23,85 @@
 #include <lightmodbus/slave/stypes.h>
 #include <lightmodbus/slave/scoils.h>
 
+static const ModbusCoilSegment *modbusCoilMap( ModbusSlave *status, uint8_t input, ModbusCoilSegment *dense, uint16_t *segmentCount )
+{
+	//Get coil (or discrete input) map - segment table, or single segment made of dense array
+	if ( ( input ? status->discreteInputSegments : status->coilSegments ) != NULL )
+	{
+		*segmentCount = input ? status->discreteInputSegmentCount : status->coilSegmentCount;
+		return input ? status->discreteInputSegments : status->coilSegments;
+	}
+
+	dense->base = 0;
+	dense->count = input ? status->discreteInputCount : status->coilCount;
+	dense->values = input ? status->discreteInputs : status->coils;
+	dense->callback = NULL;
+	dense->context = NULL;
+	*segmentCount = dense->count ? 1 : 0;
+	return dense;
+}
+
+static const ModbusCoilSegment *modbusCoilFind( const ModbusCoilSegment *segments, uint16_t segmentCount, uint16_t index, uint16_t count )
+{
+	//Find segment containing coil index (binary search), and check if the whole range is mapped
+	//Range may continue in following segments, as long as there are no gaps between them
+	const ModbusCoilSegment *segment;
+	uint16_t low = 0, high = segmentCount, mid;
+	uint32_t end;
+
+	while ( low < high )
+	{
+		mid = low + ( ( high - low ) >> 1 );
+		if ( (uint32_t) segments[mid].base + segments[mid].count <= index ) low = mid + 1;
+		else high = mid;
+	}
+
+	if ( low == segmentCount || segments[low].base > index ) return NULL;
+	segment = segments + low;
+	end = (uint32_t) segment->base + segment->count;
+	for ( low++; end < (uint32_t) index + count; low++ )
+	{
+		if ( low == segmentCount || segments[low].base != end ) return NULL;
+		end += segments[low].count;
+	}
+
+	return segment;
+}
+
+static uint8_t modbusCoilCopy( ModbusSlave *status, const ModbusCoilSegment *segment, uint16_t index, uint8_t *values, uint16_t valuesLength, uint16_t count, uint8_t write, uint8_t *code )
+{
+	//Copy between coils and bits in frame (starting at bit 0) - range has to be checked with modbusCoilFind first
+	//Segments with callback are accessed with single call each
+	//Exception code given by callback (or 0) is stored in code, and copying stops there
+	uint8_t buffer[250];
+	uint16_t n, bit = 0;
+
+	*code = 0;
+	while ( count )
+	{
+		n = segment->base + segment->count - index;
+		if ( n > count ) n = count;
+		if ( segment->callback != NULL )
+		{
+			memset( buffer, 0, BITSTOBYTES( n ) );
+			if ( write && modbusMaskCopy( buffer, sizeof( buffer ), 0, values, valuesLength, bit, n ) ) return MODBUS_ERROR_OTHER;
+			if ( ( *code = segment->callback( status, segment, write, index, n, buffer ) ) ) return MODBUS_ERROR_OK;
+			if ( !write && modbusMaskCopy( values, valuesLength, bit, buffer, sizeof( buffer ), 0, n ) ) return MODBUS_ERROR_OTHER;
+		}
+		else if ( write )
+		{
+			if ( modbusMaskCopy( segment->values, BITSTOBYTES( segment->count ), index - segment->base, values, valuesLength, bit, n ) ) return MODBUS_ERROR_OTHER;
+		}
+		else if ( modbusMaskCopy( values, valuesLength, bit, segment->values, BITSTOBYTES( segment->count ), index - segment->base, n ) ) return MODBUS_ERROR_OTHER;
+		bit += n;
+		index += n;
+		count -= n;
+		segment++;
+	}
+
+	return MODBUS_ERROR_OK;
+}
+
 uint8_t modbusParseRequest0102( ModbusSlave *status, union ModbusParser *parser )
 {
 	//Read multiple coils or discrete inputs
@@ -30,15 +109,13 @@ uint8_t modbusParseRequest0102( ModbusSlave *status, union ModbusParser *parser
 
 	//Update frame length
 	uint8_t frameLength = 8;
-	uint8_t coil = 0;
-	uint16_t i = 0;
 
 	//Check if given pointers are valid
 	if ( status == NULL || parser == NULL || ( parser->base.function != 1 && parser->base.function != 2 ) ) return MODBUS_ERROR_OTHER;
 
 	//Don't do anything when frame is broadcasted
 	//Base of the frame can be always safely checked, because main parser function takes care of that
-	if ( parser->base.address == 0 ) return MODBUS_ERROR_OK;
+	if ( parser->base.address == 0 && !status->tcp ) return MODBUS_ERROR_OK;
 
 	//Check if frame length is valid
 	if ( status->request.length != frameLength )
@@ -52,37 +129,37 @@ uint8_t modbusParseRequest0102( ModbusSlave *status, union ModbusParser *parser
 	if ( count == 0 || count > 2000 )
 		return modbusBuildException( status, parser->base.function, MODBUS_EXCEP_ILLEGAL_VAL );
 
-	if ( index >= ( parser->base.function == 1 ? status->coilCount : status->discreteInputCount ) || \
-		(uint32_t) index + (uint32_t) count > (uint32_t) ( parser->base.function == 1 ? status->coilCount : status->discreteInputCount ) )
-			return modbusBuildException( status, parser->base.function, MODBUS_EXCEP_ILLEGAL_ADDR );
+	ModbusCoilSegment dense;
+	uint16_t segmentCount;
+	const ModbusCoilSegment *segment = modbusCoilMap( status, parser->base.function == 2, &dense, &segmentCount );
+	if ( ( segment = modbusCoilFind( segment, segmentCount, index, count ) ) == NULL )
+		return modbusBuildException( status, parser->base.function, MODBUS_EXCEP_ILLEGAL_ADDR );
 
 	//Respond
 	frameLength = 5 + BITSTOBYTES( count );
 
-	status->response.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) ); //Reallocate response frame memory to needed memory
-	if ( status->response.frame == NULL ) return MODBUS_ERROR_ALLOC;
+	if ( modbusSlaveAllocateResponse( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
 	union ModbusParser *builder = (union ModbusParser *) status->response.frame;
 
 	//Set up basic response data
 	builder->base.address = status->address;
 	builder->base.function = parser->base.function;
 	builder->response0102.length = BITSTOBYTES( count );
+	memset( builder->response0102.values, 0, builder->response0102.length );
 
-	//Copy registers to response frame
-	for ( i = 0; i < count; i++ )
-	{
-		if ( ( coil = modbusMaskRead( parser->base.function == 1 ? status->coils : status->discreteInputs, \
-			BITSTOBYTES( parser->base.function == 1 ? status->coilCount : status->discreteInputCount ), i + index ) ) == 255 )
-				return MODBUS_ERROR_OTHER;
-		if ( modbusMaskWrite( builder->response0102.values, builder->response0102.length, i, coil ) == 255 )
-			return MODBUS_ERROR_OTHER;
-	}
+	//Copy coils to response frame
+	uint8_t code;
+	if ( modbusCoilCopy( status, segment, index, builder->response0102.values, builder->response0102.length, count, 0, &code ) ) return MODBUS_ERROR_OTHER;
+	if ( code ) return modbusBuildException( status, parser->base.function, code );
 
-	//Calculate crc
+	//Calculate crc (there's none in Modbus TCP frames)
 	//That could be written as a single line, without the temporary variable, but avr-gcc doesn't like that
 	//warning: dereferencing type-punned pointer will break strict-aliasing rules
-	uint16_t *crc = (uint16_t*)( builder->frame + frameLength - 2 );
-	*crc = modbusCRC( builder->frame, frameLength - 2 );
+	if ( !status->tcp )
+	{
+		uint16_t *crc = (uint16_t*)( builder->frame + frameLength - 2 );
+		*crc = modbusCRC( builder->frame, frameLength - 2 );
+	}
 
 	//Set frame length - frame is ready
 	status->response.length = frameLength;
@@ -103,7 +180,7 @@ uint8_t modbusParseRequest05( ModbusSlave *status, union ModbusParser *parser )
 	//Check if frame length is valid
 	if ( status->request.length != frameLength )
 	{
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 5, MODBUS_EXCEP_ILLEGAL_VAL );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 5, MODBUS_EXCEP_ILLEGAL_VAL );
 		return MODBUS_ERROR_OK;
 	}
 
@@ -115,15 +192,18 @@ uint8_t modbusParseRequest05( ModbusSlave *status, union ModbusParser *parser )
 	if ( value != 0x0000 && value != 0xFF00 )
 	{
 		//Illegal data address error
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 5, MODBUS_EXCEP_ILLEGAL_VAL );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 5, MODBUS_EXCEP_ILLEGAL_VAL );
 		return MODBUS_ERROR_OK;
 	}
 
 	//Check if coil is in valid range
-	if ( index >= status->coilCount )
+	ModbusCoilSegment dense;
+	uint16_t segmentCount;
+	const ModbusCoilSegment *segment = modbusCoilMap( status, 0, &dense, &segmentCount );
+	if ( ( segment = modbusCoilFind( segment, segmentCount, index, 1 ) ) == NULL )
 	{
 		//Illegal data address error
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 5, MODBUS_EXCEP_ILLEGAL_ADDR );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 5, MODBUS_EXCEP_ILLEGAL_ADDR );
 		return MODBUS_ERROR_OK;
 	}
 
@@ -131,32 +211,44 @@ uint8_t modbusParseRequest05( ModbusSlave *status, union ModbusParser *parser )
 	if ( modbusMaskRead( status->coilMask, status->coilMaskLength, index ) == 1 )
 	{
 		//Slave failure exception
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 5, MODBUS_EXCEP_SLAVE_FAIL );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 5, MODBUS_EXCEP_SLAVE_FAIL );
 		return MODBUS_ERROR_OK;
 	}
 
-	//Respond
-	frameLength = 8;
-
-	status->response.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) ); //Reallocate response frame memory to needed memory
-	if ( status->response.frame == NULL ) return MODBUS_ERROR_ALLOC;
-	union ModbusParser *builder = (union ModbusParser *) status->response.frame;
+	//After all possible exceptions, write coil
+	uint8_t bit = value == 0xFF00;
+	uint8_t code;
+	if ( modbusCoilCopy( status, segment, index, &bit, 1, 1, 1, &code ) ) return MODBUS_ERROR_OTHER;
+	if ( code )
+	{
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 5, code );
+		return MODBUS_ERROR_OK;
+	}
 
-	//After all possible exceptions, write coils
-	if ( modbusMaskWrite( status->coils, BITSTOBYTES( status->coilCount ), index, value == 0xFF00 ) == 255 )
-		return MODBUS_ERROR_OTHER;
+	//Record changes
+	if ( status->coilChanges != NULL ) modbusDirtyRecord( status->coilChanges, index, 1 );
 
 	//Do not respond when frame is broadcasted
-	if ( parser->base.address == 0 ) return MODBUS_ERROR_OK;
+	if ( parser->base.address == 0 && !status->tcp ) return MODBUS_ERROR_OK;
 
-	//Set up basic response data
-	builder->base.address = status->address;
-	builder->base.function = parser->base.function;
-	builder->response05.index = parser->request05.index;
-	builder->response05.value = parser->request05.value;
+	//Respond
+	frameLength = 8;
 
-	//Calculate crc
-	builder->response05.crc = modbusCRC( builder->frame, frameLength - 2 );
+	if ( modbusSlaveAllocateResponse( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
+	union ModbusParser *builder = (union ModbusParser *) status->response.frame;
+
+	//When response is built in place of request, echoed frame (with valid crc) is already there
+	if ( builder != parser )
+	{
+		//Set up basic response data
+		builder->base.address = status->address;
+		builder->base.function = parser->base.function;
+		builder->response05.index = parser->request05.index;
+		builder->response05.value = parser->request05.value;
+
+		//Calculate crc
+		if ( !status->tcp ) builder->response05.crc = modbusCRC( builder->frame, frameLength - 2 );
+	}
 
 	//Set frame length - frame is ready
 	status->response.length = frameLength;
@@ -169,9 +261,7 @@ uint8_t modbusParseRequest15( ModbusSlave *status, union ModbusParser *parser )
 	//Using data from union pointer
 
 	//Update frame length
-	uint16_t i = 0;
 	uint8_t frameLength;
-	uint8_t coil = 0;
 
 	//Check if given pointers are valid
 	if ( status == NULL || parser == NULL ) return MODBUS_ERROR_OTHER;
@@ -182,13 +272,13 @@ uint8_t modbusParseRequest15( ModbusSlave *status, union ModbusParser *parser )
 		frameLength = 9 + parser->request15.length;
 		if ( status->request.length != frameLength )
 		{
-			if ( parser->base.address != 0 ) return modbusBuildException( status, 15, MODBUS_EXCEP_ILLEGAL_VAL );
+			if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 15, MODBUS_EXCEP_ILLEGAL_VAL );
 			return MODBUS_ERROR_OK;
 		}
 	}
 	else
 	{
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 15, MODBUS_EXCEP_ILLEGAL_VAL );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 15, MODBUS_EXCEP_ILLEGAL_VAL );
 		return MODBUS_ERROR_OK;
 	}
 
@@ -203,52 +293,60 @@ uint8_t modbusParseRequest15( ModbusSlave *status, union ModbusParser *parser )
 		count > 1968 )
 	{
 		//Illegal data value error
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 15, MODBUS_EXCEP_ILLEGAL_VAL );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 15, MODBUS_EXCEP_ILLEGAL_VAL );
 		return MODBUS_ERROR_OK;
 	}
 
-	if ( index >= status->coilCount || \
-		(uint32_t) index + (uint32_t) count > (uint32_t) status->coilCount )
+	ModbusCoilSegment dense;
+	uint16_t segmentCount;
+	const ModbusCoilSegment *segment = modbusCoilMap( status, 0, &dense, &segmentCount );
+	if ( ( segment = modbusCoilFind( segment, segmentCount, index, count ) ) == NULL )
 	{
 		//Illegal data address error
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 15, MODBUS_EXCEP_ILLEGAL_ADDR );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 15, MODBUS_EXCEP_ILLEGAL_ADDR );
 		return MODBUS_ERROR_OK;
 	}
 
 	//Check for write protection
-	for ( i = 0; i < count; i++ )
-		if ( modbusMaskRead( status->coilMask, status->coilMaskLength, index + i ) == 1 )
-		{
-			//Slave failure exception
-			if ( parser->base.address != 0 ) return modbusBuildException( status, 15, MODBUS_EXCEP_SLAVE_FAIL );
-			return MODBUS_ERROR_OK;
-		}
+	if ( modbusMaskAny( status->coilMask, status->coilMaskLength, index, count ) )
+	{
+		//Slave failure exception
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 15, MODBUS_EXCEP_SLAVE_FAIL );
+		return MODBUS_ERROR_OK;
+	}
+
+	//After all possible exceptions write values to coils
+	uint8_t code;
+	if ( modbusCoilCopy( status, segment, index, parser->request15.values, parser->request15.length, count, 1, &code ) ) return MODBUS_ERROR_OTHER;
+	if ( code )
+	{
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 15, code );
+		return MODBUS_ERROR_OK;
+	}
+
+	//Record changes
+	if ( status->coilChanges != NULL ) modbusDirtyRecord( status->coilChanges, index, count );
+
+	//Do not respond when frame is broadcasted
+	if ( parser->base.address == 0 && !status->tcp ) return MODBUS_ERROR_OK;
 
 	//Respond
 	frameLength = 8;
 
-	status->response.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) ); //Reallocate response frame memory to needed memory
-	if ( status->response.frame == NULL ) return MODBUS_ERROR_ALLOC;
-	union ModbusParser *builder = (union ModbusParser *) status->response.frame; //Allocate memory for builder union
+	if ( modbusSlaveAllocateResponse( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
+	union ModbusParser *builder = (union ModbusParser *) status->response.frame;
 
-	//After all possible exceptions write values to registers
-	for ( i = 0; i < count; i++ )
+	//Set up basic response data (when built in place of request, header is already there)
+	if ( builder != parser )
 	{
-		if ( ( coil = modbusMaskRead( parser->request15.values, parser->request15.length, i ) ) == 255 ) return MODBUS_ERROR_OTHER;
-		if ( modbusMaskWrite( status->coils, BITSTOBYTES( status->coilCount ), index + i, coil ) == 255 ) return MODBUS_ERROR_OTHER;
+		builder->base.address = status->address;
+		builder->base.function = parser->base.function;
+		builder->response15.index = parser->request15.index;
+		builder->response15.count = parser->request15.count;
 	}
 
-	//Do not respond when frame is broadcasted
-	if ( parser->base.address == 0 ) return MODBUS_ERROR_OK;
-
-	//Set up basic response data
-	builder->base.address = status->address;
-	builder->base.function = parser->base.function;
-	builder->response15.index = parser->request15.index;
-	builder->response15.count = parser->request15.count;
-
 	//Calculate crc
-	builder->response15.crc = modbusCRC( builder->frame, frameLength - 2 );
+	if ( !status->tcp ) builder->response15.crc = modbusCRC( builder->frame, frameLength - 2 );
 
 	//Set frame length - frame is ready
 	status->response.length = frameLength;
@@ -18,11 +18,206 @@
 	along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <string.h>
+
 #include <lightmodbus/core.h>
 #include <lightmodbus/parser.h>
+#include <lightmodbus/slave.h>
 #include <lightmodbus/slave/stypes.h>
 #include <lightmodbus/slave/sregs.h>
 
+#if LIGHTMODBUS_SLAVE_SEQLOCK
+//Sequence lock - writers make sequence odd for the time of update, and readers retry if it has changed meanwhile
+//Readers never block writers, and writers are serialized with each other by the sequence itself
+//Register values are copied with plain accesses - fences order them against sequence changes
+
+void modbusSeqlockBegin( ModbusSeqlock *lock )
+{
+	//Start update - wait until no other update is in progress, and make sequence odd
+	uint32_t sequence;
+
+	for ( ;; )
+	{
+		sequence = __atomic_load_n( &lock->sequence, __ATOMIC_RELAXED );
+		if ( !( sequence & 1 ) && __atomic_compare_exchange_n( &lock->sequence, &sequence, sequence + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) ) break;
+	}
+
+	//Register writes can't be done before sequence is changed
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+}
+
+void modbusSeqlockEnd( ModbusSeqlock *lock )
+{
+	//Finish update - make sequence even again
+	__atomic_store_n( &lock->sequence, lock->sequence + 1, __ATOMIC_RELEASE );
+}
+
+uint32_t modbusSeqlockReadBegin( ModbusSeqlock *lock )
+{
+	//Wait until no update is in progress, and return sequence to be checked with modbusSeqlockReadRetry
+	uint32_t sequence;
+
+	while ( ( sequence = __atomic_load_n( &lock->sequence, __ATOMIC_ACQUIRE ) ) & 1 );
+	return sequence;
+}
+
+uint8_t modbusSeqlockReadRetry( ModbusSeqlock *lock, uint32_t sequence )
+{
+	//Register reads can't be done after sequence is checked
+	__atomic_thread_fence( __ATOMIC_ACQUIRE );
+	return __atomic_load_n( &lock->sequence, __ATOMIC_RELAXED ) != sequence;
+}
+
+void modbusPublishRegisters( ModbusSeqlock *lock, uint16_t *registers, uint16_t index, const uint16_t *values, uint16_t count )
+{
+	//Copy values to registers, so readers see either all of them or none
+	modbusSeqlockBegin( lock );
+	memcpy( registers + index, values, count * sizeof( uint16_t ) );
+	modbusSeqlockEnd( lock );
+}
+#endif
+
+static const ModbusRegisterSegment *modbusRegisterMap( ModbusSlave *status, uint8_t input, ModbusRegisterSegment *dense, uint16_t *segmentCount )
+{
+	//Get register map - segment table, or single segment made of dense register array
+	if ( ( input ? status->inputRegisterSegments : status->registerSegments ) != NULL )
+	{
+		*segmentCount = input ? status->inputRegisterSegmentCount : status->registerSegmentCount;
+		return input ? status->inputRegisterSegments : status->registerSegments;
+	}
+
+	dense->base = 0;
+	dense->count = input ? status->inputRegisterCount : status->registerCount;
+	dense->values = input ? status->inputRegisters : status->registers;
+	dense->callback = NULL;
+	dense->context = NULL;
+	*segmentCount = dense->count ? 1 : 0;
+	return dense;
+}
+
+static const ModbusRegisterSegment *modbusRegisterFind( const ModbusRegisterSegment *segments, uint16_t segmentCount, uint16_t index, uint16_t count )
+{
+	//Find segment containing register index (binary search), and check if the whole range is mapped
+	//Range may continue in following segments, as long as there are no gaps between them
+	const ModbusRegisterSegment *segment;
+	uint16_t low = 0, high = segmentCount, mid;
+	uint32_t end;
+
+	while ( low < high )
+	{
+		mid = low + ( ( high - low ) >> 1 );
+		if ( (uint32_t) segments[mid].base + segments[mid].count <= index ) low = mid + 1;
+		else high = mid;
+	}
+
+	if ( low == segmentCount || segments[low].base > index ) return NULL;
+	segment = segments + low;
+	end = (uint32_t) segment->base + segment->count;
+	for ( low++; end < (uint32_t) index + count; low++ )
+	{
+		if ( low == segmentCount || segments[low].base != end ) return NULL;
+		end += segments[low].count;
+	}
+
+	return segment;
+}
+
+static uint8_t modbusRegisterCopy( ModbusSlave *status, const ModbusRegisterSegment *segment, uint16_t index, void *values, uint16_t count, uint8_t write, uint8_t callbacks )
+{
+	//Copy (swapping endianness) between registers and values in frame - range has to be checked with modbusRegisterFind first
+	//Only segments with callback (callbacks = 1) or only plain register arrays (callbacks = 0) are accessed
+	//Segments with callback are accessed with single call each
+	//Returns exception code given by callback (or 0)
+	uint16_t buffer[125];
+	uint16_t n;
+	uint8_t code;
+
+	while ( count )
+	{
+		n = segment->base + segment->count - index;
+		if ( n > count ) n = count;
+		if ( callbacks && segment->callback != NULL )
+		{
+			if ( write ) modbusSwapEndianBlock( buffer, values, n );
+			if ( ( code = segment->callback( status, segment, write, index, n, buffer ) ) ) return code;
+			if ( !write ) modbusSwapEndianBlock( values, buffer, n );
+		}
+		else if ( !callbacks && segment->callback == NULL )
+		{
+			if ( write ) modbusSwapEndianBlock( segment->values + ( index - segment->base ), values, n );
+			else modbusSwapEndianBlock( values, segment->values + ( index - segment->base ), n );
+		}
+		values = (uint16_t *) values + n;
+		index += n;
+		count -= n;
+		segment++;
+	}
+
+	return 0;
+}
+
+static uint8_t modbusRegisterTransfer( ModbusSlave *status, ModbusSeqlock *lock, const ModbusRegisterSegment *segment, uint16_t index, void *values, uint16_t count, uint8_t write )
+{
+	//Read or write range of registers - callbacks are called first, outside of seqlock, so each of them runs once,
+	//doesn't hold up readers and may use the lock itself - only plain register arrays are copied under seqlock
+	uint8_t code;
+
+	if ( ( code = modbusRegisterCopy( status, segment, index, values, count, write, 1 ) ) ) return code;
+
+	#if LIGHTMODBUS_SLAVE_SEQLOCK
+	uint32_t sequence;
+	if ( lock != NULL )
+	{
+		if ( write )
+		{
+			modbusSeqlockBegin( lock );
+			modbusRegisterCopy( status, segment, index, values, count, write, 0 );
+			modbusSeqlockEnd( lock );
+		}
+		else
+		{
+			//Copy again if registers have been updated meanwhile
+			do
+			{
+				sequence = modbusSeqlockReadBegin( lock );
+				modbusRegisterCopy( status, segment, index, values, count, write, 0 );
+			}
+			while ( modbusSeqlockReadRetry( lock, sequence ) );
+		}
+		return 0;
+	}
+	#endif
+
+	return modbusRegisterCopy( status, segment, index, values, count, write, 0 );
+}
+
+static uint8_t modbusRegisterWrite( ModbusSlave *status, ModbusSeqlock *lock, const ModbusRegisterSegment *segment, uint16_t index, uint16_t andmask, uint16_t ormask )
+{
+	//Write single register with ( value & andmask ) | ( ormask & ~andmask ) - andmask of 0 just writes ormask
+	//Callback is asked for current value only if andmask isn't 0, and is called outside of seqlock
+	//Plain register is read and written under seqlock, so no update can come in between
+	uint16_t value = 0;
+	uint8_t code;
+
+	if ( segment->callback != NULL )
+	{
+		if ( andmask && ( code = segment->callback( status, segment, 0, index, 1, &value ) ) ) return code;
+		value = ( value & andmask ) | ( ormask & ~andmask );
+		return segment->callback( status, segment, 1, index, 1, &value );
+	}
+
+	#if LIGHTMODBUS_SLAVE_SEQLOCK
+	if ( lock != NULL ) modbusSeqlockBegin( lock );
+	#endif
+	value = segment->values[index - segment->base];
+	segment->values[index - segment->base] = ( value & andmask ) | ( ormask & ~andmask );
+	#if LIGHTMODBUS_SLAVE_SEQLOCK
+	if ( lock != NULL ) modbusSeqlockEnd( lock );
+	#endif
+
+	return 0;
+}
+
 uint8_t modbusParseRequest0304( ModbusSlave *status, union ModbusParser *parser )
 {
 	//Read multiple holding registers or input registers
@@ -30,14 +225,13 @@ uint8_t modbusParseRequest0304( ModbusSlave *status, union ModbusParser *parser
 
 	//Update frame length
 	uint8_t frameLength = 8;
-	uint8_t i = 0;
 
 	//Check if given pointers are valid
 	if ( status == NULL || parser == NULL || ( parser->base.function != 3 && parser->base.function != 4 ) ) return MODBUS_ERROR_OTHER;
 
 	//Don't do anything when frame is broadcasted
 	//Base of the frame can be always safely checked, because main parser function takes care of that
-	if ( parser->base.address == 0 ) return MODBUS_ERROR_OK;
+	if ( parser->base.address == 0 && !status->tcp ) return MODBUS_ERROR_OK;
 
 	//Check if frame length is valid
 	if ( status->request.length != frameLength )
@@ -56,9 +250,10 @@ uint8_t modbusParseRequest0304( ModbusSlave *status, union ModbusParser *parser
 		return modbusBuildException( status, parser->base.function, MODBUS_EXCEP_ILLEGAL_VAL );
 	}
 
-	if ( index >= ( parser->base.function == 3 ? status->registerCount : status->inputRegisterCount ) || \
-		(uint32_t) index + (uint32_t) count > \
-		(uint32_t) ( parser->base.function == 3 ? status->registerCount : status->inputRegisterCount ) )
+	ModbusRegisterSegment dense;
+	uint16_t segmentCount;
+	const ModbusRegisterSegment *segment = modbusRegisterMap( status, parser->base.function == 4, &dense, &segmentCount );
+	if ( ( segment = modbusRegisterFind( segment, segmentCount, index, count ) ) == NULL )
 	{
 		//Illegal data address exception
 		return modbusBuildException( status, parser->base.function, MODBUS_EXCEP_ILLEGAL_ADDR );
@@ -67,8 +262,7 @@ uint8_t modbusParseRequest0304( ModbusSlave *status, union ModbusParser *parser
 	//Respond
 	frameLength = 5 + ( count << 1 );
 
-	status->response.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) ); //Reallocate response frame memory to needed memory
-	if ( status->response.frame == NULL )return MODBUS_ERROR_ALLOC;
+	if ( modbusSlaveAllocateResponse( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
 	union ModbusParser *builder = (union ModbusParser *) status->response.frame;
 
 	//Set up basic response data
@@ -77,11 +271,14 @@ uint8_t modbusParseRequest0304( ModbusSlave *status, union ModbusParser *parser
 	builder->response0304.length = count << 1;
 
 	//Copy registers to response frame
-	for ( i = 0; i < count; i++ )
-		builder->response0304.values[i] = modbusSwapEndian( ( parser->base.function == 3 ? status->registers : status->inputRegisters )[index + i] );
+	uint8_t code = modbusRegisterTransfer( status, parser->base.function == 3 ? status->registerLock : status->inputRegisterLock, \
+		segment, index, builder->response0304.values, count, 0 );
+
+	//Exception reported by callback
+	if ( code ) return modbusBuildException( status, parser->base.function, code );
 
 	//Calculate crc
-	builder->response0304.values[count] = modbusCRC( builder->frame, frameLength - 2 );
+	if ( !status->tcp ) builder->response0304.values[count] = modbusCRC( builder->frame, frameLength - 2 );
 
 	//Set frame length - frame is ready
 	status->response.length = frameLength;
@@ -102,7 +299,7 @@ uint8_t modbusParseRequest06( ModbusSlave *status, union ModbusParser *parser )
 	//Check if frame length is valid
 	if ( status->request.length != frameLength )
 	{
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 6, MODBUS_EXCEP_ILLEGAL_VAL );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 6, MODBUS_EXCEP_ILLEGAL_VAL );
 		return MODBUS_ERROR_OK;
 	}
 
@@ -111,10 +308,13 @@ uint8_t modbusParseRequest06( ModbusSlave *status, union ModbusParser *parser )
 	uint16_t value = modbusSwapEndian( parser->request06.value );
 
 	//Check if reg is in valid range
-	if ( index >= status->registerCount )
+	ModbusRegisterSegment dense;
+	uint16_t segmentCount;
+	const ModbusRegisterSegment *segment = modbusRegisterMap( status, 0, &dense, &segmentCount );
+	if ( ( segment = modbusRegisterFind( segment, segmentCount, index, 1 ) ) == NULL )
 	{
 		//Illegal data address exception
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 6, MODBUS_EXCEP_ILLEGAL_ADDR );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 6, MODBUS_EXCEP_ILLEGAL_ADDR );
 		return MODBUS_ERROR_OK;
 	}
 
@@ -122,31 +322,44 @@ uint8_t modbusParseRequest06( ModbusSlave *status, union ModbusParser *parser )
 	if ( modbusMaskRead( status->registerMask, status->registerMaskLength, index ) == 1 )
 	{
 		//Slave failure exception
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 6, MODBUS_EXCEP_SLAVE_FAIL );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 6, MODBUS_EXCEP_SLAVE_FAIL );
 		return MODBUS_ERROR_OK;
 	}
 
-	//Respond
-	frameLength = 8;
+	//After all possible exceptions, write reg
+	uint8_t code = modbusRegisterWrite( status, status->registerLock, segment, index, 0, value );
 
-	status->response.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) ); //Reallocate response frame memory to needed memory
-	if ( status->response.frame == NULL ) return MODBUS_ERROR_ALLOC;
-	union ModbusParser *builder = (union ModbusParser *) status->response.frame;
+	//Exception reported by callback
+	if ( code )
+	{
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 6, code );
+		return MODBUS_ERROR_OK;
+	}
 
-	//After all possible exceptions, write reg
-	status->registers[index] = value;
+	//Record changes
+	if ( status->registerChanges != NULL ) modbusDirtyRecord( status->registerChanges, index, 1 );
 
 	//Do not respond when frame is broadcasted
-	if ( parser->base.address == 0 ) return MODBUS_ERROR_OK;
+	if ( parser->base.address == 0 && !status->tcp ) return MODBUS_ERROR_OK;
 
-	//Set up basic response data
-	builder->response06.address = status->address;
-	builder->response06.function = parser->request06.function;
-	builder->response06.index = parser->request06.index;
-	builder->response06.value = modbusSwapEndian( status->registers[index] );
+	//Respond
+	frameLength = 8;
 
-	//Calculate crc
-	builder->response06.crc = modbusCRC( builder->frame, frameLength - 2 );
+	if ( modbusSlaveAllocateResponse( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
+	union ModbusParser *builder = (union ModbusParser *) status->response.frame;
+
+	//When response is built in place of request, echoed frame (with valid crc) is already there
+	if ( builder != parser )
+	{
+		//Set up basic response data
+		builder->response06.address = status->address;
+		builder->response06.function = parser->request06.function;
+		builder->response06.index = parser->request06.index;
+		builder->response06.value = parser->request06.value;
+
+		//Calculate crc
+		if ( !status->tcp ) builder->response06.crc = modbusCRC( builder->frame, frameLength - 2 );
+	}
 
 	//Set frame length - frame is ready
 	status->response.length = frameLength;
@@ -159,7 +372,6 @@ uint8_t modbusParseRequest16( ModbusSlave *status, union ModbusParser *parser )
 	//Using data from union pointer
 
 	//Update frame length
-	uint8_t i = 0;
 	uint8_t frameLength;
 
 	//Check if given pointers are valid
@@ -177,7 +389,7 @@ uint8_t modbusParseRequest16( ModbusSlave *status, union ModbusParser *parser )
 	}
 	else
 	{
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 16, MODBUS_EXCEP_ILLEGAL_VAL );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 16, MODBUS_EXCEP_ILLEGAL_VAL );
 		return MODBUS_ERROR_OK;
 	}
 
@@ -192,50 +404,61 @@ uint8_t modbusParseRequest16( ModbusSlave *status, union ModbusParser *parser )
 		count > 123 )
 	{
 		//Illegal data value error
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 16, MODBUS_EXCEP_ILLEGAL_VAL );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 16, MODBUS_EXCEP_ILLEGAL_VAL );
 		return MODBUS_ERROR_OK;
 	}
 
-	if ( index >= status->registerCount || \
-		(uint32_t) index + (uint32_t) count > (uint32_t) status->registerCount )
+	ModbusRegisterSegment dense;
+	uint16_t segmentCount;
+	const ModbusRegisterSegment *segment = modbusRegisterMap( status, 0, &dense, &segmentCount );
+	if ( ( segment = modbusRegisterFind( segment, segmentCount, index, count ) ) == NULL )
 	{
 		//Illegal data address error
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 16, MODBUS_EXCEP_ILLEGAL_ADDR );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 16, MODBUS_EXCEP_ILLEGAL_ADDR );
 		return MODBUS_ERROR_OK;
 	}
 
 	//Check for write protection
-	for ( i = 0; i < count; i++ )
-		if ( modbusMaskRead( status->registerMask, status->registerMaskLength, index + i ) == 1 )
-		{
-			//Slave failure exception
-			if ( parser->base.address != 0 ) return modbusBuildException( status, 16, MODBUS_EXCEP_SLAVE_FAIL );
-			return MODBUS_ERROR_OK;
-		}
-
-	//Respond
-	frameLength = 8;
+	if ( modbusMaskAny( status->registerMask, status->registerMaskLength, index, count ) )
+	{
+		//Slave failure exception
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 16, MODBUS_EXCEP_SLAVE_FAIL );
+		return MODBUS_ERROR_OK;
+	}
 
-	status->response.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) ); //Reallocate response frame memory to needed memory
-	if ( status->response.frame == NULL ) return MODBUS_ERROR_ALLOC;
-	union ModbusParser *builder = (union ModbusParser *) status->response.frame;
+	//After all possible exceptions, write values to registers
+	uint8_t code = modbusRegisterTransfer( status, status->registerLock, segment, index, parser->request16.values, count, 1 );
 
+	//Exception reported by callback
+	if ( code )
+	{
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 16, code );
+		return MODBUS_ERROR_OK;
+	}
 
-	//After all possible exceptions, write values to registers
-	for ( i = 0; i < count; i++ )
-		status->registers[index + i] = modbusSwapEndian( parser->request16.values[i] );
+	//Record changes
+	if ( status->registerChanges != NULL ) modbusDirtyRecord( status->registerChanges, index, count );
 
 	//Do not respond when frame is broadcasted
-	if ( parser->base.address == 0 ) return MODBUS_ERROR_OK;
+	if ( parser->base.address == 0 && !status->tcp ) return MODBUS_ERROR_OK;
 
-	//Set up basic response data
-	builder->response16.address = status->address;
-	builder->response16.function = parser->request16.function;
-	builder->response16.index = parser->request16.index;
-	builder->response16.count = parser->request16.count;
+	//Respond
+	frameLength = 8;
+
+	if ( modbusSlaveAllocateResponse( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
+	union ModbusParser *builder = (union ModbusParser *) status->response.frame;
+
+	//Set up basic response data (when built in place of request, header is already there)
+	if ( builder != parser )
+	{
+		builder->response16.address = status->address;
+		builder->response16.function = parser->request16.function;
+		builder->response16.index = parser->request16.index;
+		builder->response16.count = parser->request16.count;
+	}
 
 	//Calculate crc
-	builder->response16.crc = modbusCRC( builder->frame, frameLength - 2 );
+	if ( !status->tcp ) builder->response16.crc = modbusCRC( builder->frame, frameLength - 2 );
 
 	//Set frame length - frame is ready
 	status->response.length = frameLength;
@@ -256,23 +479,23 @@ uint8_t modbusParseRequest22( ModbusSlave *status, union ModbusParser *parser )
 	//Check if frame length is valid
 	if ( status->request.length != frameLength )
 	{
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 22, MODBUS_EXCEP_ILLEGAL_VAL );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 22, MODBUS_EXCEP_ILLEGAL_VAL );
 		return MODBUS_ERROR_OK;
 	}
 
-	//Check frame crc
-	if ( modbusCRC( parser->frame, frameLength - 2 ) != parser->request22.crc ) return MODBUS_ERROR_CRC;
-
 	//Swap endianness of longer members (but not crc)
 	uint16_t index = modbusSwapEndian( parser->request22.index );
 	uint16_t andmask = modbusSwapEndian( parser->request22.andmask );
 	uint16_t ormask = modbusSwapEndian( parser->request22.ormask );
 
 	//Check if reg is in valid range
-	if ( index >= status->registerCount )
+	ModbusRegisterSegment dense;
+	uint16_t segmentCount;
+	const ModbusRegisterSegment *segment = modbusRegisterMap( status, 0, &dense, &segmentCount );
+	if ( ( segment = modbusRegisterFind( segment, segmentCount, index, 1 ) ) == NULL )
 	{
 		//Illegal data address exception
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 22, MODBUS_EXCEP_ILLEGAL_ADDR );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 22, MODBUS_EXCEP_ILLEGAL_ADDR );
 		return MODBUS_ERROR_OK;
 	}
 
@@ -280,32 +503,45 @@ uint8_t modbusParseRequest22( ModbusSlave *status, union ModbusParser *parser )
 	if ( modbusMaskRead( status->registerMask, status->registerMaskLength, index ) == 1 )
 	{
 		//Slave failure exception
-		if ( parser->base.address != 0 ) return modbusBuildException( status, 22, MODBUS_EXCEP_SLAVE_FAIL );
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 22, MODBUS_EXCEP_SLAVE_FAIL );
 		return MODBUS_ERROR_OK;
 	}
 
-	//Respond
-	frameLength = 10;
+	//After all possible exceptions, write reg
+	uint8_t code = modbusRegisterWrite( status, status->registerLock, segment, index, andmask, ormask );
 
-	status->response.frame = (uint8_t *) calloc( frameLength, sizeof( uint8_t ) ); //Reallocate response frame memory to needed memory
-	if ( status->response.frame == NULL ) return MODBUS_ERROR_ALLOC;
-	union ModbusParser *builder = (union ModbusParser *) status->response.frame;
+	//Exception reported by callback
+	if ( code )
+	{
+		if ( parser->base.address != 0 || status->tcp ) return modbusBuildException( status, 22, code );
+		return MODBUS_ERROR_OK;
+	}
 
-	//After all possible exceptions, write reg
-	status->registers[index] = ( status->registers[index] & andmask ) | ( ormask & ~andmask );
+	//Record changes
+	if ( status->registerChanges != NULL ) modbusDirtyRecord( status->registerChanges, index, 1 );
 
 	//Do not respond when frame is broadcasted
-	if ( parser->base.address == 0 ) return MODBUS_ERROR_OK;
+	if ( parser->base.address == 0 && !status->tcp ) return MODBUS_ERROR_OK;
 
-	//Set up basic response data
-	builder->response22.address = status->address;
-	builder->response22.function = parser->request22.function;
-	builder->response22.index = parser->request22.index;
-	builder->response22.andmask = parser->request22.andmask;
-	builder->response22.ormask = parser->request22.ormask;
+	//Respond
+	frameLength = 10;
 
-	//Calculate crc
-	builder->response22.crc = modbusCRC( builder->frame, frameLength - 2 );
+	if ( modbusSlaveAllocateResponse( status, frameLength ) ) return MODBUS_ERROR_ALLOC;
+	union ModbusParser *builder = (union ModbusParser *) status->response.frame;
+
+	//When response is built in place of request, echoed frame (with valid crc) is already there
+	if ( builder != parser )
+	{
+		//Set up basic response data
+		builder->response22.address = status->address;
+		builder->response22.function = parser->request22.function;
+		builder->response22.index = parser->request22.index;
+		builder->response22.andmask = parser->request22.andmask;
+		builder->response22.ormask = parser->request22.ormask;
+
+		//Calculate crc
+		if ( !status->tcp ) builder->response22.crc = modbusCRC( builder->frame, frameLength - 2 );
+	}
 
 	//Set frame length - frame is ready
 	status->response.length = frameLength;
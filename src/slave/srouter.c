@@ -0,0 +1,132 @@
+/*
+	liblightmodbus - a lightweight, multiplatform Modbus library
+	Copyright (C) 2016	Jacek Wieczorek <mrjjot@gmail.com>
+
+	This file is part of liblightmodbus.
+
+	Liblightmodbus is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Liblightmodbus is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <lightmodbus/core.h>
+#include <lightmodbus/parser.h>
+#include <lightmodbus/slave.h>
+#include <lightmodbus/slave/stypes.h>
+#include <lightmodbus/slave/srouter.h>
+
+uint8_t modbusRouterInit( ModbusRouter *router, uint8_t tcp )
+{
+	//Set up router with no slaves registered
+
+	//Check if given pointer is valid
+	if ( router == NULL ) return MODBUS_ERROR_OTHER;
+
+	memset( router->units, 0, sizeof( router->units ) );
+	router->unitCount = 0;
+	router->tcp = tcp;
+	router->request.frame = NULL;
+	router->request.length = 0;
+	router->responder = NULL;
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusRouterAdd( ModbusRouter *router, ModbusSlave *slave )
+{
+	//Register slave (already initialized with modbusSlaveInit) under its address
+	//Address can't be taken by other slave, and slave has to use the same framing as router
+
+	//Check if given pointers are valid
+	if ( router == NULL || slave == NULL || slave->address == 0 || !slave->tcp != !router->tcp ) return MODBUS_ERROR_OTHER;
+	if ( router->units[slave->address] != NULL && router->units[slave->address] != slave ) return MODBUS_ERROR_OTHER;
+
+	if ( router->units[slave->address] == NULL ) router->unitCount++;
+	router->units[slave->address] = slave;
+
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t modbusRouterRemove( ModbusRouter *router, uint8_t address )
+{
+	//Check if given pointer is valid
+	if ( router == NULL || router->units[address] == NULL ) return MODBUS_ERROR_OTHER;
+
+	router->units[address] = NULL;
+	router->unitCount--;
+
+	return MODBUS_ERROR_OK;
+}
+
+static uint8_t modbusRouterPass( ModbusRouter *router, ModbusSlave *slave, uint16_t crc )
+{
+	//Let slave parse request put in router
+	slave->request.frame = router->request.frame;
+	slave->request.length = router->request.length;
+	return modbusParseRequestCRC( slave, crc );
+}
+
+uint8_t modbusRouterParseRequestCRC( ModbusRouter *router, uint16_t crc )
+{
+	//Pass request to slave it's addressed to - its response (if any) is pointed by router->responder
+	//Broadcasts are passed to every registered slave, each of them exactly once (CRC is not recalculated)
+	//Requests for unknown addresses are ignored
+	union ModbusParser *parser;
+	ModbusSlave *slave;
+	uint16_t i, done;
+	uint8_t address, err = MODBUS_ERROR_OK, e;
+
+	//Check if given pointer is valid
+	if ( router == NULL ) return MODBUS_ERROR_OTHER;
+	router->responder = NULL;
+
+	//Frame has to contain address (unit identifier) and function code
+	if ( router->request.frame == NULL || router->request.length < ( router->tcp ? MODBUS_TCP_OFFSET + 2 : 4u ) ) return MODBUS_ERROR_OTHER;
+
+	//Check CRC before address is trusted
+	if ( !router->tcp && modbusCRCFinal( crc ) != 0 ) return MODBUS_ERROR_CRC;
+
+	parser = (union ModbusParser *) router->request.frame;
+	address = router->tcp ? parser->mbap.unit : parser->base.address;
+
+	if ( address != 0 )
+	{
+		if ( ( slave = router->units[address] ) == NULL ) return MODBUS_ERROR_OK;
+		err = modbusRouterPass( router, slave, crc );
+		if ( slave->response.length != 0 ) router->responder = slave;
+		return err;
+	}
+
+	//Fan broadcast out - first error is returned
+	for ( i = 1, done = 0; i < 256 && done < router->unitCount; i++ )
+	{
+		if ( ( slave = router->units[i] ) == NULL ) continue;
+		e = modbusRouterPass( router, slave, crc );
+		if ( err == MODBUS_ERROR_OK ) err = e;
+		done++;
+	}
+
+	return err;
+}
+
+uint8_t modbusRouterParseRequest( ModbusRouter *router )
+{
+	//Pass request to slave it's addressed to
+
+	//Check if given pointer is valid
+	if ( router == NULL ) return MODBUS_ERROR_OTHER;
+
+	//There's no CRC in Modbus TCP frames
+	if ( router->tcp ) return modbusRouterParseRequestCRC( router, 0 );
+
+	return modbusRouterParseRequestCRC( router, modbusCRC( router->request.frame, router->request.length ) );
+}
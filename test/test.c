@@ -19,12 +19,1606 @@ uint16_t TestValues[512] = { 0xface, 0xdead, 0xCC, 0xDD, 0xEE, 0xFF, 0xAAFF, 0xB
 uint16_t TestValues2[512] = {0};
 uint8_t TestValues3[512] = { 0b11001100, 0x00 };
 
+#if LIGHTMODBUS_STATIC_MEM_SLAVE
+uint8_t sresponse[260];
+#endif
+
+#if LIGHTMODBUS_STATIC_MEM_MASTER
+uint8_t mrequest[260];
+uint16_t mdata[128];
+#endif
+
 void TermRGB( unsigned char R, unsigned char G, unsigned char B )
 {
     if ( R > 5u || G > 5u || B > 5u ) return;
     printf( "\033[38;5;%dm", 16 + B + G * 6 + R * 36 );
 }
 
+uint16_t crcref( uint8_t *data, uint16_t length )
+{
+	//Bitwise CRC for reference
+	uint16_t crc = 0xFFFF;
+	uint16_t i;
+	uint8_t j;
+
+	for ( i = 0; i < length; i++ )
+	{
+		crc ^= data[i];
+		for ( j = 0; j < 8; j++ )
+			crc = ( crc & 1 ) ? ( crc >> 1 ) ^ 0xA001 : crc >> 1;
+	}
+	return crc;
+}
+
+void crctest( )
+{
+	uint8_t data[1024];
+	uint16_t length, offset;
+	int i, errors = 0;
+
+	printf( "\n-------Checking CRC against reference--------\n" );
+	for ( i = 0; i < 1024; i++ )
+		data[i] = rand( );
+
+	//Random lengths and alignments
+	for ( i = 0; i < 10000; i++ )
+	{
+		length = rand( ) % 769;
+		offset = rand( ) % 256;
+		if ( modbusCRC( data + offset, length ) != crcref( data + offset, length ) ) errors++;
+	}
+
+	printf( errors ? "ERROR!\n" : "OK\n" );
+
+	printf( "\n-------Checking incremental CRC--------\n" );
+	errors = 0;
+	for ( i = 0; i < 1000; i++ )
+	{
+		uint16_t crc = modbusCRCInit( );
+		uint16_t chunk;
+
+		length = rand( ) % 257;
+		for ( offset = 0; offset < length; offset += chunk )
+		{
+			chunk = rand( ) % 17;
+			if ( offset + chunk > length ) chunk = length - offset;
+			crc = modbusCRCUpdate( crc, data + offset, chunk );
+		}
+		if ( modbusCRCFinal( crc ) != crcref( data, length ) ) errors++;
+	}
+	printf( errors ? "ERROR!\n" : "OK\n" );
+
+	//Accumulate CRC byte by byte, just like it would be done during reception
+	uint16_t crc = modbusCRCInit( );
+	uint8_t sec, mec;
+	modbusBuildRequest03( &mstatus, 0x20, 0, 4 );
+	for ( i = 0; i < mstatus.request.length; i++ )
+		crc = modbusCRCUpdate( crc, mstatus.request.frame + i, 1 );
+	sstatus.request.frame = mstatus.request.frame;
+	sstatus.request.length = mstatus.request.length;
+	sec = modbusParseRequestCRC( &sstatus, crc );
+
+	crc = modbusCRCInit( );
+	for ( i = 0; i < sstatus.response.length; i++ )
+		crc = modbusCRCUpdate( crc, sstatus.response.frame + i, 1 );
+	mstatus.response.frame = sstatus.response.frame;
+	mstatus.response.length = sstatus.response.length;
+	mec = modbusParseResponseCRC( &mstatus, crc );
+	printf( "mec=%d, sec=%d\n", mec, sec );
+	printf( mstatus.data.count == 4 && !memcmp( mstatus.data.regs, sstatus.registers, 8 ) ? "OK\n" : "ERROR!\n" );
+
+	sec = modbusParseRequestCRC( &sstatus, crc ^ 1 );
+	printf( "bad CRC - sec=%d\n", sec );
+}
+
+void masktest( )
+{
+	uint8_t src[64], dest[64], ref[64];
+	uint16_t srcBit, destBit, count, j;
+	int i, errors = 0;
+
+	printf( "\n-------Checking bit mask copying--------\n" );
+	for ( i = 0; i < 64; i++ )
+		src[i] = rand( );
+
+	//Compare with bit by bit copy, at random offsets
+	for ( i = 0; i < 10000; i++ )
+	{
+		count = rand( ) % 257;
+		srcBit = rand( ) % ( 512 - count + 1 );
+		destBit = rand( ) % ( 512 - count + 1 );
+		memset( dest, i, 64 );
+		memset( ref, i, 64 );
+		for ( j = 0; j < count; j++ )
+			modbusMaskWrite( ref, 64, destBit + j, modbusMaskRead( src, 64, srcBit + j ) );
+		if ( modbusMaskCopy( dest, 64, destBit, src, 64, srcBit, count ) || memcmp( dest, ref, 64 ) ) errors++;
+	}
+	printf( errors ? "ERROR!\n" : "OK\n" );
+
+	//Out of range
+	printf( "%d %d\n", modbusMaskCopy( dest, 64, 500, src, 64, 0, 13 ), modbusMaskCopy( dest, 64, 0, src, 8, 1, 64 ) );
+
+	//Looking for set bits in sparse mask - bits past the end of the mask count as cleared
+	errors = 0;
+	for ( i = 0; i < 10000; i++ )
+	{
+		uint8_t any = 0;
+
+		if ( i % 100 == 0 )
+		{
+			memset( dest, 0, 64 );
+			modbusMaskWrite( dest, 64, rand( ) % 512, 1 );
+		}
+		count = rand( ) % 300;
+		srcBit = rand( ) % 600;
+		for ( j = 0; j < count; j++ )
+			any |= modbusMaskRead( dest, 48, srcBit + j ) == 1;
+		if ( modbusMaskAny( dest, 48, srcBit, count ) != any ) errors++;
+	}
+	printf( errors ? "ERROR!\n" : "OK\n" );
+}
+
+void swaptest( )
+{
+	uint8_t src[300], dest[300], ref[300];
+	uint16_t count, j, word;
+	int i, errors = 0;
+
+	printf( "\n-------Checking bulk endianness swapping--------\n" );
+	for ( i = 0; i < 300; i++ )
+		src[i] = rand( );
+
+	//Compare with word by word swapping, at any alignment and in place
+	for ( i = 0; i < 1000; i++ )
+	{
+		count = rand( ) % 130;
+		memcpy( ref, src, 300 );
+		for ( j = 0; j < count; j++ )
+		{
+			memcpy( &word, src + ( i & 7 ) + ( j << 1 ), 2 );
+			word = modbusSwapEndian( word );
+			memcpy( ref + ( i & 7 ) + ( j << 1 ), &word, 2 );
+		}
+
+		memcpy( dest, src, 300 );
+		if ( modbusSwapEndianBlock( dest + ( i & 7 ), src + ( i & 7 ), count ) || memcmp( dest, ref, 300 ) ) errors++;
+		memcpy( dest, src, 300 );
+		if ( modbusSwapEndianBlock( dest + ( i & 7 ), dest + ( i & 7 ), count ) || memcmp( dest, ref, 300 ) ) errors++;
+	}
+	printf( errors ? "ERROR!\n" : "OK\n" );
+}
+
+uint8_t customRequest( ModbusSlave *status, union ModbusParser *parser )
+{
+	//Vendor function - respond with number of holding registers
+	if ( status->request.length != 4 ) return modbusBuildException( status, parser->base.function, MODBUS_EXCEP_ILLEGAL_VAL );
+	if ( parser->base.address == 0 ) return MODBUS_ERROR_OK;
+	if ( modbusSlaveAllocateResponse( status, 6 ) ) return MODBUS_ERROR_ALLOC;
+
+	status->response.frame[0] = status->address;
+	status->response.frame[1] = parser->base.function;
+	status->response.frame[2] = status->registerCount >> 8;
+	status->response.frame[3] = status->registerCount & 0xff;
+	uint16_t crc = modbusCRC( status->response.frame, 4 );
+	memcpy( status->response.frame + 4, &crc, 2 );
+	status->response.length = 6;
+	return MODBUS_ERROR_OK;
+}
+
+uint8_t customResponse( ModbusMaster *status, union ModbusParser *parser, union ModbusParser *requestParser )
+{
+	if ( status->response.length != 6 || parser->base.address != requestParser->base.address ) return MODBUS_ERROR_FRAME;
+	status->data.address = parser->base.address;
+	status->data.function = parser->base.function;
+	status->data.count = ( parser->frame[2] << 8 ) | parser->frame[3];
+	return MODBUS_ERROR_OK;
+}
+
+void functiontest( )
+{
+	ModbusSlaveHandler sfunctions[256];
+	ModbusMasterHandler mfunctions[256];
+	ModbusMaster master;
+	uint16_t crc;
+	uint8_t sec, mec;
+
+	printf( "\n-------Checking custom function handlers--------\n" );
+
+	//Init resets handlers of master filled with garbage
+	memset( &master, 0xaa, sizeof( master ) );
+	mec = modbusMasterInit( &master );
+	printf( "garbage master init: %d, default functions: %d, tcp: %d\n", mec, master.functions == NULL, master.tcp );
+	modbusMasterEnd( &master );
+
+	memcpy( sfunctions, modbusSlaveDefaultFunctions, sizeof( sfunctions ) );
+	memcpy( mfunctions, modbusMasterDefaultFunctions, sizeof( mfunctions ) );
+	sfunctions[0x41] = customRequest;
+	sfunctions[3] = NULL;
+	mfunctions[0x41] = customResponse;
+	sstatus.functions = sfunctions;
+	mstatus.functions = mfunctions;
+
+	//Vendor function
+	modbusMasterAllocateRequest( &mstatus, 4 );
+	mstatus.request.frame[0] = 0x20;
+	mstatus.request.frame[1] = 0x41;
+	crc = modbusCRC( mstatus.request.frame, 2 );
+	memcpy( mstatus.request.frame + 2, &crc, 2 );
+	mstatus.request.length = 4;
+	sstatus.request.frame = mstatus.request.frame;
+	sstatus.request.length = mstatus.request.length;
+	sec = modbusParseRequest( &sstatus );
+	mstatus.response.frame = sstatus.response.frame;
+	mstatus.response.length = sstatus.response.length;
+	mec = modbusParseResponse( &mstatus );
+	printf( "sec=%d, mec=%d, function=0x%x, count=%d\n", sec, mec, mstatus.data.function, mstatus.data.count );
+
+	//Disabled function
+	modbusBuildRequest03( &mstatus, 0x20, 0, 4 );
+	sstatus.request.frame = mstatus.request.frame;
+	sstatus.request.length = mstatus.request.length;
+	sec = modbusParseRequest( &sstatus );
+	mstatus.response.frame = sstatus.response.frame;
+	mstatus.response.length = sstatus.response.length;
+	mec = modbusParseResponse( &mstatus );
+	printf( "sec=%d, mec=%d, exception=%d\n", sec, mec, mstatus.exception.code );
+
+	//Built-in handlers again
+	sstatus.functions = NULL;
+	mstatus.functions = NULL;
+	sec = modbusParseRequest( &sstatus );
+	printf( "sec=%d\n", sec );
+}
+
+void inplacetest( )
+{
+	uint8_t frame[256], response[256];
+	uint8_t i, length, sec, iec;
+
+	printf( "\n-------Checking in-place request parsing--------\n" );
+	for ( i = 0; i < 12; i++ )
+	{
+		switch ( i )
+		{
+			case 0: modbusBuildRequest03( &mstatus, 0x20, 1, 4 ); break;
+			case 1: modbusBuildRequest04( &mstatus, 0x20, 0, 4 ); break;
+			case 2: modbusBuildRequest01( &mstatus, 0x20, 3, 20 ); break;
+			case 3: modbusBuildRequest02( &mstatus, 0x20, 0, 16 ); break;
+			case 4: modbusBuildRequest05( &mstatus, 0x20, 7, 1 ); break;
+			case 5: modbusBuildRequest06( &mstatus, 0x20, 2, 0x1234 ); break;
+			case 6: modbusBuildRequest15( &mstatus, 0x20, 4, 12, TestValues3 ); break;
+			case 7: modbusBuildRequest16( &mstatus, 0x20, 1, 5, TestValues ); break;
+			case 8: modbusBuildRequest22( &mstatus, 0x20, 3, 0xf0f0, 0x0ff0 ); break;
+			case 9: modbusBuildRequest06( &mstatus, 0x20, 100, 0x1234 ); break;
+			case 10: modbusBuildRequest06( &mstatus, 0x00, 2, 0x4321 ); break;
+			case 11: modbusBuildRequest03( &mstatus, 0x21, 1, 4 ); break;
+		}
+
+		memcpy( frame, mstatus.request.frame, mstatus.request.length );
+		sstatus.request.frame = frame;
+		sstatus.request.length = mstatus.request.length;
+
+		//Regular parsing
+		sec = modbusParseRequest( &sstatus );
+		length = sstatus.response.length;
+		if ( length ) memcpy( response, sstatus.response.frame, length );
+
+		//Response built over request
+		iec = modbusParseRequestInPlace( &sstatus );
+		printf( "%d: sec=%d, iec=%d, length=%d - ", i, sec, iec, length );
+		printf( sec == iec && sstatus.response.length == length && !memcmp( frame, response, length ) ? "OK\n" : "ERROR!\n" );
+	}
+}
+
+void tcptest( )
+{
+	uint8_t frame[260], response[260];
+	uint8_t i, length, sec, mec, iec;
+
+	printf( "\n-------Checking Modbus TCP framing--------\n" );
+	sstatus.tcp = mstatus.tcp = 1;
+	for ( i = 0; i < 9; i++ )
+	{
+		switch ( i )
+		{
+			case 0: modbusBuildRequest03( &mstatus, 0x20, 1, 4 ); break;
+			case 1: modbusBuildRequest01( &mstatus, 0x20, 3, 20 ); break;
+			case 2: modbusBuildRequest05( &mstatus, 0xff, 7, 1 ); break;
+			case 3: modbusBuildRequest15( &mstatus, 0x20, 4, 12, TestValues3 ); break;
+			case 4: modbusBuildRequest16( &mstatus, 0x20, 1, 5, TestValues ); break;
+			case 5: modbusBuildRequest22( &mstatus, 0x20, 3, 0xf0f0, 0x0ff0 ); break;
+			case 6: modbusBuildRequest06( &mstatus, 0x20, 100, 0x1234 ); break;
+			case 7: modbusBuildRequest03( &mstatus, 0x20, 1, 4 ); break;
+			case 8: modbusBuildRequest04( &mstatus, 0x20, 0, 4 ); break;
+		}
+
+		printf( "%d: request -", i );
+		for ( length = 0; length < mstatus.request.length; length++ )
+			printf( " %.2x", mstatus.request.frame[length] );
+		printf( "\n" );
+
+		memcpy( frame, mstatus.request.frame, mstatus.request.length );
+		sstatus.request.frame = frame;
+		sstatus.request.length = mstatus.request.length;
+		sec = modbusParseRequest( &sstatus );
+		length = sstatus.response.length;
+		if ( length ) memcpy( response, sstatus.response.frame, length );
+
+		//Response built over request has to be the same
+		iec = modbusParseRequestInPlace( &sstatus );
+		if ( iec != sec || sstatus.response.length != length || memcmp( frame, response, length ) ) printf( "in-place ERROR!\n" );
+
+		//Response to other transaction, and damaged MBAP header
+		if ( i == 7 ) response[1]++;
+		if ( i == 8 ) response[5]++;
+
+		mstatus.response.frame = response;
+		mstatus.response.length = length;
+		mec = modbusParseResponse( &mstatus );
+		printf( "%d: sec=%d, mec=%d, length=%d, predicted=%d, exception=%d, count=%d\n", i, sec, mec, length, \
+			mstatus.predictedResponseLength, mstatus.exception.code, mstatus.data.count );
+	}
+
+	//Not a Modbus TCP frame
+	sstatus.request.frame = frame;
+	sstatus.request.length = 7;
+	printf( "short frame - sec=%d\n", modbusParseRequest( &sstatus ) );
+	sstatus.request.length = 12;
+	frame[2] = 1;
+	printf( "bad protocol - sec=%d\n", modbusParseRequest( &sstatus ) );
+
+	//Unit identifier 0 addresses the device directly, so requests are answered rather than treated as broadcasts
+	for ( i = 0; i < 2; i++ )
+	{
+		memcpy( frame, i ? "\x00\x06\x00\x00\x00\x06\x00\x06\x00\x64\x12\x34" : "\x00\x05\x00\x00\x00\x06\x00\x03\x00\x01\x00\x02", 12 );
+		sstatus.request.length = 12;
+		sec = modbusParseRequest( &sstatus );
+		printf( "unit 0 - sec=%d, response:", sec );
+		for ( length = 0; length < sstatus.response.length; length++ )
+			printf( " %.2x", sstatus.response.frame[length] );
+		printf( "\n" );
+	}
+
+	sstatus.tcp = mstatus.tcp = 0;
+}
+
+uint8_t rtufeed( ModbusRTUReceiver *rx, uint8_t *frame, uint16_t length, uint32_t *now )
+{
+	//Feed frame byte by byte, 11 bits at 9600 baud each
+	uint8_t state = MODBUS_RTU_INIT;
+	uint16_t i;
+
+	for ( i = 0; i < length; i++ )
+	{
+		state = modbusRTUReceive( rx, frame[i], *now );
+		*now += 1146;
+	}
+	return state;
+}
+
+void rtutest( )
+{
+	ModbusRTUReceiver rx;
+	uint8_t buffer[MODBUS_RTU_MAX_LENGTH], frame[256];
+	uint32_t now = 0xfffff000; //Timer is about to wrap around
+	uint8_t state, sec, mec, length;
+
+	printf( "\n-------Checking RTU frame assembler--------\n" );
+	printf( "init: %d, ", modbusRTUInit( &rx, buffer, 9600, now ) );
+	printf( "t1.5=%lu, t3.5=%lu\n", (unsigned long) rx.t15, (unsigned long) rx.t35 );
+
+	//Bytes before silent interval are ignored
+	modbusBuildRequest03( &mstatus, 0x20, 1, 4 );
+	state = rtufeed( &rx, mstatus.request.frame, 3, &now );
+	printf( "no silence - state=%d, length=%d\n", state, rx.length );
+
+	//Frame finished after t3.5 of silence
+	now += 4010;
+	state = rtufeed( &rx, mstatus.request.frame, mstatus.request.length, &now );
+	printf( "receiving - state=%d, length=%d\n", state, rx.length );
+	now += 4010 - 1146;
+	state = modbusRTUPoll( &rx, now - 1 );
+	printf( "before t3.5 - state=%d, ", state );
+	state = modbusRTUPoll( &rx, now );
+	sstatus.request.frame = rx.frame;
+	sstatus.request.length = rx.length;
+	sec = modbusParseRequestCRC( &sstatus, rx.crc );
+	printf( "after t3.5 - state=%d, length=%d, sec=%d\n", state, rx.length, sec );
+	length = sstatus.response.length;
+	memcpy( frame, sstatus.response.frame, length );
+
+	//Response finished as soon as predicted length is received
+	rx.expected = mstatus.predictedResponseLength;
+	now += 10000;
+	state = rtufeed( &rx, frame, length, &now );
+	mstatus.response.frame = rx.frame;
+	mstatus.response.length = rx.length;
+	mec = modbusParseResponseCRC( &mstatus, rx.crc );
+	printf( "predicted - state=%d, length=%d, mec=%d, count=%d\n", state, rx.length, mec, mstatus.data.count );
+
+	//Exception response is shorter than predicted
+	modbusBuildRequest06( &mstatus, 0x20, 100, 0x1234 );
+	sstatus.request.frame = mstatus.request.frame;
+	sstatus.request.length = mstatus.request.length;
+	sec = modbusParseRequest( &sstatus );
+	rx.expected = mstatus.predictedResponseLength;
+	now += 10000;
+	state = rtufeed( &rx, sstatus.response.frame, sstatus.response.length, &now );
+	mstatus.response.frame = rx.frame;
+	mstatus.response.length = rx.length;
+	mec = modbusParseResponseCRC( &mstatus, rx.crc );
+	printf( "exception - state=%d, length=%d, sec=%d, mec=%d, exception=%d\n", state, rx.length, sec, mec, mstatus.exception.code );
+
+	//Gap longer than t1.5 breaks the frame
+	now += 10000;
+	state = rtufeed( &rx, frame, 4, &now );
+	now += 1000;
+	state = rtufeed( &rx, frame + 4, length - 4, &now );
+	printf( "gap - state=%d, ", state );
+	state = modbusRTUPoll( &rx, now + 4010 );
+	printf( "state=%d, dropped=%d\n", state, rx.dropped );
+
+	//Back to back frames - first byte of the next frame finishes previous one
+	now += 10000;
+	rtufeed( &rx, frame, length, &now );
+	now += 4010 - 1146;
+	state = rtufeed( &rx, frame, 1, &now );
+	printf( "back to back - state=%d, length=%d, crc=%x, ", state, rx.length, rx.crc );
+	state = rtufeed( &rx, frame + 1, length - 1, &now );
+	state = modbusRTUPoll( &rx, now + 4010 );
+	printf( "state=%d, length=%d, crc=%x, %s\n", state, rx.length, rx.crc, memcmp( rx.frame, frame, length ) ? "ERROR!" : "OK" );
+
+	//Too long frame
+	now += 10000;
+	memset( frame, 0, 256 );
+	rtufeed( &rx, frame, 256, &now );
+	state = rtufeed( &rx, frame, 1, &now );
+	printf( "overflow - state=%d, ", state );
+	state = modbusRTUPoll( &rx, now + 4010 );
+	printf( "state=%d, dropped=%d\n", state, rx.dropped );
+
+	//Fast baudrates use fixed timeouts
+	modbusRTUInit( &rx, buffer, 115200, now );
+	printf( "115200: t1.5=%lu, t3.5=%lu, bad init: %d\n", (unsigned long) rx.t15, (unsigned long) rx.t35, modbusRTUInit( &rx, buffer, 0, now ) );
+}
+
+void servertest( )
+{
+	ModbusServer server;
+	struct sockaddr_in sa;
+	uint8_t requests[1024], responses[1024], burst[340 * 12];
+	uint16_t length = 0, expected = 0;
+	int fd, i, count, received = 0;
+
+	printf( "\n-------Checking Modbus TCP server--------\n" );
+	printf( "init: %d\n", modbusServerInit( &server, &sstatus, "127.0.0.1", 0, 2 ) );
+
+	memset( &sa, 0, sizeof( sa ) );
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons( server.port );
+	inet_pton( AF_INET, "127.0.0.1", &sa.sin_addr );
+	fd = socket( AF_INET, SOCK_STREAM, 0 );
+	printf( "connect: %d\n", connect( fd, (struct sockaddr *) &sa, sizeof( sa ) ) );
+
+	//Several pipelined requests
+	mstatus.tcp = 1;
+	for ( i = 0; i < 4; i++ )
+	{
+		switch ( i )
+		{
+			case 0: modbusBuildRequest03( &mstatus, 0x20, 1, 4 ); break;
+			case 1: modbusBuildRequest16( &mstatus, 0x20, 1, 5, TestValues ); break;
+			case 2: modbusBuildRequest06( &mstatus, 0x20, 100, 0x1234 ); break;
+			case 3: modbusBuildRequest01( &mstatus, 0xff, 3, 20 ); break;
+		}
+		memcpy( requests + length, mstatus.request.frame, mstatus.request.length );
+		length += mstatus.request.length;
+		expected += mstatus.predictedResponseLength;
+	}
+	mstatus.tcp = 0;
+	expected -= 12 - 9; //Exception response
+
+	//Last request is split between two writes
+	count = write( fd, requests, length - 3 );
+	for ( i = 0; i < 10 && received < expected - 12; i++ )
+	{
+		modbusServerRun( &server, 10 );
+		count = recv( fd, responses + received, sizeof( responses ) - received, MSG_DONTWAIT );
+		if ( count > 0 ) received += count;
+	}
+	printf( "partial - connections=%d, requests=%lu, received=%d\n", server.connectionCount, (unsigned long) server.requests, received );
+	count = write( fd, requests + length - 3, 3 );
+	for ( i = 0; i < 10 && received < expected; i++ )
+	{
+		modbusServerRun( &server, 10 );
+		count = recv( fd, responses + received, sizeof( responses ) - received, MSG_DONTWAIT );
+		if ( count > 0 ) received += count;
+	}
+	printf( "complete - requests=%lu, received=%d:", (unsigned long) server.requests, received );
+	for ( i = 0; i < received; i++ )
+		printf( " %.2x", responses[i] );
+	printf( "\n" );
+
+	//Partial frame followed by more data than fits in receive buffer along with it
+	for ( i = 0; i < 91; i++ )
+		memcpy( burst + i * 12, "\x00\x01\x00\x00\x00\x06\x20\x03\x00\x01\x00\x01", 12 );
+	count = write( fd, burst, 5 );
+	for ( i = 0; i < 3; i++ )
+		modbusServerRun( &server, 10 );
+	count = write( fd, burst + 5, 91 * 12 - 5 );
+	for ( i = 0, received = 0; i < 20 && received < 91 * 11; i++ )
+	{
+		modbusServerRun( &server, 10 );
+		count = recv( fd, responses + received, sizeof( responses ) - received, MSG_DONTWAIT );
+		if ( count > 0 ) received += count;
+	}
+	printf( "burst - connections=%d, requests=%lu, received=%d\n", server.connectionCount, (unsigned long) server.requests, received );
+
+	//Client sending requests faster than it reads responses - more than fits in transmit buffer arrives at once
+	for ( i = 0; i < 340; i++ )
+		memcpy( burst + i * 12, "\x00\x01\x00\x00\x00\x06\x20\x03\x00\x00\x00\x08", 12 );
+	count = write( fd, burst, sizeof( burst ) );
+	for ( i = 0, received = 0; i < 50 && received < 340 * 25; i++ )
+	{
+		modbusServerRun( &server, 10 );
+		count = recv( fd, responses, sizeof( responses ), MSG_DONTWAIT );
+		if ( count > 0 ) received += count;
+	}
+	printf( "flood - connections=%d, requests=%lu, received=%d\n", server.connectionCount, (unsigned long) server.requests, received );
+
+	//Garbage closes connection
+	count = write( fd, "\x00\x01\x00\x07\x00\x06garbage", 13 );
+	for ( i = 0; i < 10 && server.connectionCount; i++ )
+		modbusServerRun( &server, 10 );
+	printf( "garbage - connections=%d, recv=%d\n", server.connectionCount, (int) recv( fd, responses, 1, 0 ) );
+	close( fd );
+
+	//Pseudo terminal stands in for serial line
+	struct termios tio;
+	int pty = posix_openpt( O_RDWR | O_NOCTTY );
+	grantpt( pty );
+	unlockpt( pty );
+	fd = open( ptsname( pty ), O_RDWR | O_NOCTTY );
+	tcgetattr( fd, &tio );
+	cfmakeraw( &tio );
+	tcsetattr( fd, TCSANOW, &tio );
+	fcntl( pty, F_SETFL, O_NONBLOCK );
+	printf( "serial: %d\n", modbusServerAddSerial( &server, fd, 115200 ) );
+
+	//Request of known length is answered right away, and other ones after t3.5
+	for ( i = 0; i < 3; i++ )
+	{
+		switch ( i )
+		{
+			case 0: modbusBuildRequest03( &mstatus, 0x20, 1, 4 ); expected = 13; break;
+			case 1: modbusBuildRequest15( &mstatus, 0x20, 4, 12, TestValues3 ); expected = 8; break;
+			case 2:
+				memcpy( mstatus.request.frame, "\x20\x41\x00\x00", 4 );
+				mstatus.request.length = modbusCRC( mstatus.request.frame, 2 );
+				memcpy( mstatus.request.frame + 2, &mstatus.request.length, 2 );
+				mstatus.request.length = 4;
+				expected = 5;
+				break;
+		}
+		usleep( 2000 ); //t3.5 of silence before each request
+		count = write( pty, mstatus.request.frame, mstatus.request.length );
+		for ( received = 0, count = 0; count < 50 && received < expected; count++ )
+		{
+			modbusServerRun( &server, 10 );
+			length = read( pty, responses + received, sizeof( responses ) - received );
+			if ( length > 0 && length < sizeof( responses ) ) received += length;
+		}
+		printf( "%d: connections=%d, requests=%lu, received=%d:", i, server.connectionCount, (unsigned long) server.requests, received );
+		for ( length = 0; length < received; length++ )
+			printf( " %.2x", responses[length] );
+		printf( "\n" );
+	}
+	close( pty );
+
+	printf( "end: %d\n", modbusServerEnd( &server ) );
+	sstatus.tcp = 0;
+}
+
+static int poolexchange( int fd, uint8_t *response )
+{
+	//Send request built by master, and wait for whole response
+	int received = 0, count;
+
+	if ( write( fd, mstatus.request.frame, mstatus.request.length ) != mstatus.request.length ) return -1;
+	while ( received < mstatus.predictedResponseLength )
+	{
+		count = recv( fd, response + received, mstatus.predictedResponseLength - received, 0 );
+		if ( count <= 0 ) return -1;
+		received += count;
+	}
+	return received;
+}
+
+void pooltest( )
+{
+	ModbusServerPool pool;
+	struct sockaddr_in sa;
+	struct timeval tv = { 1, 0 };
+	uint8_t response[256];
+	int fds[4], i, j, count;
+
+	printf( "\n-------Checking Modbus TCP server pool--------\n" );
+	printf( "init: %d\n", modbusServerPoolInit( &pool, &sstatus, "127.0.0.1", 0, 4, 2 ) );
+	printf( "threads=%d, port=%d\n", pool.shardCount, pool.port != 0 );
+
+	memset( &sa, 0, sizeof( sa ) );
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons( pool.port );
+	inet_pton( AF_INET, "127.0.0.1", &sa.sin_addr );
+
+	//Each connection writes one register, and then reads all of them (connections may be served by different threads)
+	mstatus.tcp = 1;
+	for ( i = 0; i < 4; i++ )
+	{
+		fds[i] = socket( AF_INET, SOCK_STREAM, 0 );
+		setsockopt( fds[i], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv ) );
+		modbusBuildRequest06( &mstatus, 0x20, 4 + i, 0x1100 + i );
+		printf( "%d: connect=%d", i, connect( fds[i], (struct sockaddr *) &sa, sizeof( sa ) ) );
+		printf( ", write=%d\n", poolexchange( fds[i], response ) );
+	}
+	for ( i = 0; i < 4; i++ )
+	{
+		modbusBuildRequest03( &mstatus, 0x20, 4, 4 );
+		count = poolexchange( fds[i], response );
+		printf( "%d: read=%d:", i, count );
+		for ( j = MODBUS_TCP_OFFSET; j < count; j++ )
+			printf( " %.2x", response[j] );
+		printf( "\n" );
+		close( fds[i] );
+	}
+	mstatus.tcp = 0;
+
+	printf( "requests=%lu\n", (unsigned long) modbusServerPoolRequests( &pool ) );
+	printf( "end: %d\n", modbusServerPoolEnd( &pool ) );
+	sstatus.tcp = 0;
+}
+
+static ModbusSeqlock seqlock;
+static uint16_t seqregs[16];
+static volatile int seqdone;
+
+static void *seqlockwriter( void *arg )
+{
+	//Publish batches of equal values
+	uint16_t values[8];
+	int i, j;
+
+	for ( i = 0; i < 100000; i++ )
+	{
+		for ( j = 0; j < 8; j++ ) values[j] = i;
+		modbusPublishRegisters( &seqlock, seqregs, 4, values, 8 );
+	}
+	seqdone = 1;
+	return NULL;
+}
+
+void seqlocktest( )
+{
+	ModbusSlave slave;
+	pthread_t thread;
+	uint8_t frame[256], buffer[256];
+	uint16_t values[4] = { 0x1111, 0x2222, 0x3333, 0x4444 };
+	int i, j, reads = 0, torn = 0;
+
+	printf( "\n-------Checking register seqlock--------\n" );
+	memset( &slave, 0, sizeof( slave ) );
+	slave.address = 0x20;
+	slave.registers = seqregs;
+	slave.registerCount = 16;
+	slave.registerLock = &seqlock;
+	slave.response.frame = buffer;
+	printf( "init: %d\n", modbusSlaveInit( &slave ) );
+
+	//Batch update, and Modbus writes
+	modbusPublishRegisters( &seqlock, seqregs, 0, values, 4 );
+	printf( "publish - sequence=%u\n", seqlock.sequence );
+	for ( i = 0; i < 3; i++ )
+	{
+		switch ( i )
+		{
+			case 0: modbusBuildRequest06( &mstatus, 0x20, 1, 0x5555 ); break;
+			case 1: modbusBuildRequest16( &mstatus, 0x20, 2, 2, values ); break;
+			case 2: modbusBuildRequest03( &mstatus, 0x20, 0, 4 ); break;
+		}
+		memcpy( frame, mstatus.request.frame, mstatus.request.length );
+		slave.request.frame = frame;
+		slave.request.length = mstatus.request.length;
+		printf( "%d: sec=%d", i, modbusParseRequestInPlace( &slave ) );
+		printf( ", sequence=%u:", seqlock.sequence );
+		for ( j = 0; j < slave.response.length; j++ )
+			printf( " %.2x", frame[j] );
+		printf( "\n" );
+	}
+
+	//Reads done at the same time as updates have to see all registers equal
+	seqdone = 0;
+	pthread_create( &thread, NULL, seqlockwriter, NULL );
+	modbusBuildRequest03( &mstatus, 0x20, 4, 8 );
+	while ( !seqdone || reads == 0 )
+	{
+		memcpy( frame, mstatus.request.frame, mstatus.request.length );
+		slave.request.frame = frame;
+		slave.request.length = mstatus.request.length;
+		modbusParseRequestInPlace( &slave );
+		for ( j = 1; j < 8; j++ )
+			if ( frame[3 + 2 * j] != frame[3] || frame[4 + 2 * j] != frame[4] ) break;
+		if ( j != 8 ) torn++;
+		reads++;
+	}
+	pthread_join( thread, NULL );
+	printf( "concurrent - torn=%d, sequence=%u, last=%.4x\n", torn, seqlock.sequence, seqregs[4] );
+}
+
+void pipelinetest( )
+{
+	static ModbusPipelineSlot slots[3];
+	ModbusPipelineSlot *slot;
+	ModbusPipeline pipeline;
+	uint8_t responses[3][260];
+	uint16_t lengths[3];
+	void *context;
+	int i, j, order[4] = { 2, 0, 1, 0 };
+
+	printf( "\n-------Checking Modbus TCP pipeline--------\n" );
+	sstatus.tcp = mstatus.tcp = 1;
+	pipeline.slots = slots;
+	printf( "init: %d\n", modbusPipelineInit( &pipeline, &mstatus, 3 ) );
+
+	//Fill the window
+	for ( i = 0; i < 4; i++ )
+	{
+		switch ( i )
+		{
+			case 0: modbusBuildRequest03( &mstatus, 0x20, 1, 4 ); break;
+			case 1: modbusBuildRequest01( &mstatus, 0xff, 3, 20 ); break;
+			case 2: modbusBuildRequest06( &mstatus, 0x20, 100, 0x1234 ); break;
+			case 3: modbusBuildRequest04( &mstatus, 0x20, 0, 4 ); break;
+		}
+		printf( "%d: add=%d", i, modbusPipelineAdd( &pipeline, (void *) (intptr_t) i ) );
+		printf( ", transaction=%d, pending=%d\n", mstatus.transaction, pipeline.pending );
+	}
+
+	//Slave answers requests in flight
+	for ( i = 0; i < 3; i++ )
+	{
+		slot = pipeline.slots + i;
+		memcpy( responses[i], slot->frame, slot->length );
+		sstatus.request.frame = responses[i];
+		sstatus.request.length = slot->length;
+		modbusParseRequestInPlace( &sstatus );
+		lengths[i] = sstatus.response.length;
+		printf( "slot %d: transaction=%d, context=%d, frame length=%d, response length=%d, predicted=%d\n", i, slot->transaction, \
+			(int) (intptr_t) slot->context, modbusPipelineFrameLength( responses[i], 260 ), lengths[i], slot->predictedResponseLength );
+	}
+
+	//Responses come out of order, and the last one is repeated
+	for ( i = 0; i < 4; i++ )
+	{
+		context = NULL;
+		printf( "response %d: mec=%d", order[i], modbusPipelineParse( &pipeline, responses[order[i]], lengths[order[i]], &context ) );
+		printf( ", context=%d, pending=%d, function=%d, exception=%d, count=%d:", (int) (intptr_t) context, pipeline.pending, \
+			mstatus.data.function, mstatus.exception.code, mstatus.data.count );
+		for ( j = 0; j < mstatus.data.length; j++ )
+			printf( " %.2x", mstatus.data.coils[j] );
+		printf( "\n" );
+	}
+
+	//Window has room again
+	printf( "add=%d", modbusPipelineAdd( &pipeline, NULL ) );
+	printf( ", transaction=%d, pending=%d\n", mstatus.transaction, pipeline.pending );
+	printf( "cancel=%d", modbusPipelineCancel( &pipeline, mstatus.transaction ) );
+	printf( ", again=%d, pending=%d\n", modbusPipelineCancel( &pipeline, mstatus.transaction ), pipeline.pending );
+	printf( "incomplete frame length=%d\n", modbusPipelineFrameLength( responses[0], lengths[0] - 1 ) );
+	printf( "end: %d\n", modbusPipelineEnd( &pipeline ) );
+	sstatus.tcp = mstatus.tcp = 0;
+}
+
+void plantest( )
+{
+	static uint16_t planorder[16];
+	static ModbusPlanRead planreads[16];
+	static uint16_t regs[300], inputs[4];
+	static uint8_t bits[40], buffer[256];
+	ModbusTag tags[] =
+	{
+		{ .address = 0x20, .type = MODBUS_HOLDING_REGISTER, .index = 140, .count = 60 },
+		{ .address = 0x20, .type = MODBUS_COIL, .index = 20, .count = 10 },
+		{ .address = 0x20, .type = MODBUS_HOLDING_REGISTER, .index = 10, .count = 2 },
+		{ .address = 0x21, .type = MODBUS_HOLDING_REGISTER, .index = 0, .count = 1 },
+		{ .address = 0x20, .type = MODBUS_HOLDING_REGISTER, .index = 14, .count = 1 },
+		{ .address = 0x20, .type = MODBUS_INPUT_REGISTER, .index = 1, .count = 2 },
+		{ .address = 0x20, .type = MODBUS_HOLDING_REGISTER, .index = 30, .count = 4 },
+		{ .address = 0x20, .type = MODBUS_HOLDING_REGISTER, .index = 100, .count = 50 },
+		{ .address = 0x20, .type = MODBUS_COIL, .index = 5, .count = 3 },
+		{ .address = 0x20, .type = MODBUS_HOLDING_REGISTER, .index = 210, .count = 20 },
+		{ .address = 0x20, .type = MODBUS_INPUT_REGISTER, .index = 0, .count = 1 },
+	};
+	uint16_t count = sizeof( tags ) / sizeof( tags[0] );
+	ModbusSlave slave;
+	ModbusPlan plan;
+	ModbusTag *tag;
+	ModbusPlanRead *read;
+	int i, j, sec, mec;
+
+	printf( "\n-------Checking read planner--------\n" );
+	memset( &slave, 0, sizeof( slave ) );
+	for ( i = 0; i < 300; i++ ) regs[i] = i * 3;
+	for ( i = 0; i < 4; i++ ) inputs[i] = 0x100 + i;
+	for ( i = 0; i < 40; i++ ) bits[i] = i * 7;
+	slave.address = 0x20;
+	slave.registers = regs;
+	slave.registerCount = 300;
+	slave.inputRegisters = inputs;
+	slave.inputRegisterCount = 4;
+	slave.coils = bits;
+	slave.coilCount = 320;
+	slave.response.frame = buffer;
+	modbusSlaveInit( &slave );
+
+	//Invalid tag
+	plan.order = planorder;
+	plan.reads = planreads;
+	tags[3].count = 126;
+	printf( "too long tag: %d\n", modbusPlanInit( &plan, tags, count, 4, 16 ) );
+	tags[3].count = 1;
+
+	plan.order = planorder;
+	plan.reads = planreads;
+	printf( "init: %d", modbusPlanInit( &plan, tags, count, 4, 16 ) );
+	printf( ", reads=%d\n", plan.readCount );
+	for ( i = 0; i < plan.readCount; i++ )
+	{
+		read = plan.reads + i;
+		printf( "read %d: address=%.2x, type=%d, index=%d, count=%d, tags:", i, read->address, read->type, read->index, read->count );
+		for ( j = 0; j < read->tagCount; j++ )
+			printf( " %d", plan.order[read->first + j] );
+		printf( "\n" );
+
+		//Slave 0x21 doesn't exist
+		if ( read->address != slave.address ) continue;
+
+		modbusPlanRequest( &plan, &mstatus, i );
+		slave.request.frame = mstatus.request.frame;
+		slave.request.length = mstatus.request.length;
+		sec = modbusParseRequest( &slave );
+		mstatus.response.frame = slave.response.frame;
+		mstatus.response.length = slave.response.length;
+		mec = modbusParseResponse( &mstatus );
+		printf( "read %d: sec=%d, mec=%d, scatter=%d\n", i, sec, mec, modbusPlanScatter( &plan, &mstatus, i ) );
+
+		//Values of tags are picked from received data
+		for ( j = 0; j < read->tagCount; j++ )
+		{
+			tag = plan.tags + plan.order[read->first + j];
+			printf( "\ttag %d:", plan.order[read->first + j] );
+			if ( tag->type == MODBUS_COIL )
+				for ( sec = 0; sec < tag->count; sec++ ) printf( "%s%d", sec ? "" : " ", modbusMaskRead( tag->coils, 250, tag->coilOffset + sec ) );
+			else printf( " %d %d", tag->regs[0], tag->regs[tag->count - 1] );
+			printf( "\n" );
+		}
+	}
+
+	//Data of other read doesn't match
+	printf( "mismatch: %d\n", modbusPlanScatter( &plan, &mstatus, 0 ) );
+	printf( "tag 3 valid: %d\n", tags[3].valid );
+	printf( "end: %d\n", modbusPlanEnd( &plan ) );
+	modbusSlaveEnd( &slave );
+	mstatus.response.frame = NULL;
+	mstatus.response.length = 0;
+}
+
+void scheduletest( )
+{
+	static uint16_t schedorder[8];
+	ModbusPoll polls[] =
+	{
+		{ .address = 0x20, .type = MODBUS_HOLDING_REGISTER, .index = 0, .count = 10, .period = 100000 },
+		{ .address = 0x20, .type = MODBUS_COIL, .index = 0, .count = 16, .period = 50000 },
+		{ .address = 0x21, .type = MODBUS_INPUT_REGISTER, .index = 0, .count = 125, .period = 200000 },
+		{ .address = 0x20, .type = MODBUS_HOLDING_REGISTER, .index = 100, .count = 2, .period = 30000 },
+	};
+	ModbusPoll single = { .address = 0x20, .type = MODBUS_HOLDING_REGISTER, .index = 0, .count = 1 };
+	ModbusPoll pair[] =
+	{
+		{ .address = 0x20, .type = MODBUS_HOLDING_REGISTER, .index = 0, .count = 10 },
+		{ .address = 0x20, .type = MODBUS_HOLDING_REGISTER, .index = 0, .count = 1 },
+	};
+	uint16_t count = sizeof( polls ) / sizeof( polls[0] );
+	uint16_t runs[4] = { 0 }, poll;
+	uint32_t now, wait;
+	ModbusSchedule schedule;
+	int i;
+
+	printf( "\n-------Checking poll scheduler--------\n" );
+
+	//Invalid poll period
+	polls[0].period = 0;
+	schedule.order = schedorder;
+	printf( "zero period: %d\n", modbusScheduleInit( &schedule, &mstatus, polls, count, 9600, 5000 ) );
+	polls[0].period = 100000;
+
+	//Slow line - long read doesn't fit
+	schedule.order = schedorder;
+	printf( "init 9600: %d", modbusScheduleInit( &schedule, &mstatus, polls, count, 9600, 5000 ) );
+	printf( ", silence=%d, utilization=%d, unschedulable=%d\n", schedule.silence, schedule.utilization, schedule.unschedulable );
+	for ( i = 0; i < count; i++ )
+		printf( "poll %d: order=%d, request=%d, response=%d, cost=%d, responseTime=%d, schedulable=%d\n", i, schedule.order[i], \
+			polls[i].requestLength, polls[i].responseLength, polls[i].cost, polls[i].responseTime, polls[i].schedulable );
+	printf( "end: %d\n", modbusScheduleEnd( &schedule ) );
+
+	//Fast line
+	schedule.order = schedorder;
+	printf( "init 115200: %d", modbusScheduleInit( &schedule, &mstatus, polls, count, 115200, 2000 ) );
+	printf( ", silence=%d, utilization=%d, unschedulable=%d\n", schedule.silence, schedule.utilization, schedule.unschedulable );
+	for ( i = 0; i < count; i++ )
+		printf( "poll %d: cost=%d, responseTime=%d, schedulable=%d\n", i, polls[i].cost, polls[i].responseTime, polls[i].schedulable );
+
+	//Simulate one second of polling - every poll occupies bus for its cost
+	now = 0;
+	modbusScheduleStart( &schedule, now );
+	while ( now < 1000000 )
+	{
+		modbusScheduleNext( &schedule, now, &poll, &wait );
+		if ( poll == count )
+		{
+			now += wait;
+			continue;
+		}
+		modbusScheduleRequest( &schedule, &mstatus, poll );
+		if ( mstatus.request.length != polls[poll].requestLength ) printf( "bad request length\n" );
+		now += polls[poll].cost;
+		modbusScheduleDone( &schedule, poll, now );
+		runs[poll]++;
+	}
+	for ( i = 0; i < count; i++ )
+		printf( "poll %d: runs=%d, missed=%d\n", i, runs[i], polls[i].missed );
+
+	//Single poll alone on the bus - cost = 1433 (15 chars) + 2 * 1750 + 305067 = 310000, response time is its own cost
+	schedule.order = schedorder;
+	single.period = 465000;
+	modbusScheduleInit( &schedule, &mstatus, &single, 1, 115200, 305067 );
+	printf( "single: cost=%d, responseTime=%d, schedulable=%d, unschedulable=%d\n", single.cost, single.responseTime, single.schedulable, schedule.unschedulable );
+	modbusScheduleEnd( &schedule );
+
+	//Two polls - costs are 11219 (33 chars) and 9500 (15 chars)
+	//The first one waits for the second one (9500 + 11219 = 20719), the second one only for the first one (11219 + 9500 = 20719)
+	schedule.order = schedorder;
+	pair[0].period = 21000;
+	pair[1].period = 31000;
+	modbusScheduleInit( &schedule, &mstatus, pair, 2, 115200, 4567 );
+	for ( i = 0; i < 2; i++ )
+		printf( "pair %d: cost=%d, responseTime=%d, schedulable=%d\n", i, pair[i].cost, pair[i].responseTime, pair[i].schedulable );
+	modbusScheduleEnd( &schedule );
+
+	//Late poll skips periods
+	schedule.order = schedorder;
+	modbusScheduleInit( &schedule, &mstatus, polls, count, 115200, 2000 );
+	modbusScheduleStart( &schedule, 0 );
+	modbusScheduleDone( &schedule, 3, 95000 );
+	printf( "late: due=%d, missed=%d\n", polls[3].due, polls[3].missed );
+	modbusScheduleNext( &schedule, 1000, &poll, &wait );
+	printf( "next: %d\n", poll );
+	printf( "end: %d\n", modbusScheduleEnd( &schedule ) );
+}
+
+uint8_t slaveexchange( ModbusSlave *slave )
+{
+	//Send request built by master to slave, and parse its response
+	slave->request.frame = mstatus.request.frame;
+	slave->request.length = mstatus.request.length;
+	modbusParseRequest( slave );
+	mstatus.response.frame = slave->response.frame;
+	mstatus.response.length = slave->response.length;
+	return modbusParseResponse( &mstatus );
+}
+
+void cachetest( )
+{
+	static ModbusCacheEntry cacheentries[3];
+	static uint16_t regs[200];
+	static uint8_t bits[8], buffer[256];
+	static const ModbusCacheRule rules[] =
+	{
+		{ .address = 0x20, .function = 3, .index = 0, .count = 10, .ttl = 1000 },
+		{ .address = 0x20, .function = 3, .index = 100, .count = 50, .ttl = 0 },
+		{ .address = 0, .function = 0, .index = 5, .count = 1, .ttl = 300 },
+	};
+	ModbusCacheEntry *entry, *other;
+	ModbusCache cache;
+	ModbusSlave slave;
+	uint8_t result;
+	int i;
+
+	printf( "\n-------Checking response cache--------\n" );
+	memset( &slave, 0, sizeof( slave ) );
+	for ( i = 0; i < 200; i++ ) regs[i] = i * 5;
+	for ( i = 0; i < 8; i++ ) bits[i] = 0x35 + i;
+	slave.address = 0x20;
+	slave.registers = regs;
+	slave.registerCount = 200;
+	slave.coils = bits;
+	slave.coilCount = 64;
+	slave.response.frame = buffer;
+	modbusSlaveInit( &slave );
+
+	cache.entries = cacheentries;
+	printf( "init: %d\n", modbusCacheInit( &cache, 3, rules, 3, 500 ) );
+	printf( "bad function: %d\n", modbusCacheLookup( &cache, 0x20, 5, 0, 1, 0, &entry, &result ) );
+
+	//The first read is sent, and the same or overlapping ones wait for it
+	modbusCacheLookup( &cache, 0x20, 3, 0, 8, 0, &entry, &result );
+	printf( "read 0-7: result=%d, entry=%d, ttl=%d\n", result, (int)( entry - cache.entries ), entry->ttl );
+	modbusCacheLookup( &cache, 0x20, 3, 2, 4, 1, &other, &result );
+	printf( "read 2-5: result=%d, same=%d\n", result, other == entry );
+	modbusCacheLookup( &cache, 0x21, 3, 2, 4, 1, &other, &result );
+	printf( "other slave: result=%d, entry=%d, ttl=%d\n", result, (int)( other - cache.entries ), other->ttl );
+	modbusCacheCancel( &cache, other );
+
+	modbusBuildRequest03( &mstatus, 0x20, 0, 8 );
+	printf( "exchange: %d\n", slaveexchange( &slave ) );
+	printf( "store: %d\n", modbusCacheStore( &cache, entry, &mstatus, 20 ) );
+	printf( "store again: %d\n", modbusCacheStore( &cache, entry, &mstatus, 20 ) );
+
+	//Served from cache until TTL passes
+	modbusCacheLookup( &cache, 0x20, 3, 2, 4, 300, &other, &result );
+	printf( "read 2-5: result=%d, same=%d, values:", result, other == entry );
+	for ( i = 0; i < 4; i++ ) printf( " %d", other->data.regs[2 - other->index + i] );
+	printf( "\n" );
+	modbusCacheLookup( &cache, 0x20, 3, 4, 8, 300, &other, &result );
+	printf( "read 4-11: result=%d, entry=%d, ttl=%d\n", result, (int)( other - cache.entries ), other->ttl );
+
+	//Response to another request doesn't match
+	printf( "mismatch: %d\n", modbusCacheStore( &cache, other, &mstatus, 300 ) );
+	modbusCacheCancel( &cache, other );
+	modbusCacheLookup( &cache, 0x20, 3, 0, 8, 320, &other, &result );
+	printf( "expired: result=%d\n", result );
+	modbusCacheCancel( &cache, other );
+
+	//TTL of 0 - only in-flight requests are collapsed
+	modbusCacheLookup( &cache, 0x20, 3, 100, 10, 1030, &entry, &result );
+	printf( "uncached: result=%d, ttl=%d\n", result, entry->ttl );
+	modbusBuildRequest03( &mstatus, 0x20, 100, 10 );
+	slaveexchange( &slave );
+	modbusCacheLookup( &cache, 0x20, 3, 100, 2, 1031, &other, &result );
+	printf( "uncached in flight: result=%d, same=%d\n", result, other == entry );
+	printf( "store: %d", modbusCacheStore( &cache, entry, &mstatus, 1040 ) );
+	printf( ", value: %d\n", entry->data.regs[9] );
+	modbusCacheLookup( &cache, 0x20, 3, 100, 10, 1040, &other, &result );
+	printf( "uncached again: result=%d\n", result );
+	modbusCacheCancel( &cache, other );
+
+	//Coils
+	modbusCacheLookup( &cache, 0x20, 1, 3, 20, 2000, &entry, &result );
+	modbusBuildRequest01( &mstatus, 0x20, 3, 20 );
+	slaveexchange( &slave );
+	printf( "coils: result=%d, store=%d", result, modbusCacheStore( &cache, entry, &mstatus, 2000 ) );
+	printf( ", ttl=%d\n", entry->ttl );
+	modbusCacheLookup( &cache, 0x20, 1, 10, 6, 2100, &other, &result );
+	printf( "coils 10-15: result=%d, same=%d, values: ", result, other == entry );
+	for ( i = 0; i < 6; i++ ) printf( "%d", modbusMaskRead( other->data.coils, other->length, 10 - other->index + i ) );
+	printf( ", expected: " );
+	for ( i = 0; i < 6; i++ ) printf( "%d", modbusMaskRead( bits, 8, 10 + i ) );
+	printf( "\n" );
+
+	//Writes drop cached data
+	modbusCacheInvalidate( &cache, 0x20, 1, 0, 4 );
+	modbusCacheLookup( &cache, 0x20, 1, 10, 6, 2200, &other, &result );
+	printf( "invalidated: result=%d\n", result );
+
+	//All entries pending
+	modbusCacheLookup( &cache, 0x20, 4, 0, 1, 2200, &other, &result );
+	modbusCacheLookup( &cache, 0x20, 2, 0, 1, 2200, &other, &result );
+	modbusCacheLookup( &cache, 0x20, 3, 0, 1, 2200, &other, &result );
+	printf( "full: result=%d, entry=%d\n", result, other != NULL );
+	printf( "stats: hits=%d, misses=%d, collapsed=%d\n", cache.hits, cache.misses, cache.collapsed );
+	printf( "end: %d\n", modbusCacheEnd( &cache ) );
+
+	modbusSlaveEnd( &slave );
+	mstatus.response.frame = NULL;
+	mstatus.response.length = 0;
+}
+
+void segmenttest( )
+{
+	static uint16_t low[10], high[10], block[100], inputs[10];
+	static uint8_t buffer[256];
+	static const ModbusRegisterSegment overlapping[] =
+	{
+		{ .base = 0, .count = 10, .values = low },
+		{ .base = 5, .count = 10, .values = high },
+	};
+	const ModbusRegisterSegment segments[] =
+	{
+		{ .base = 0, .count = 10, .values = low },
+		{ .base = 10, .count = 10, .values = high },
+		{ .base = 40000, .count = 100, .values = block },
+	};
+	const ModbusRegisterSegment inputsegments[] =
+	{
+		{ .base = 30000, .count = 10, .values = inputs },
+	};
+	ModbusSlave slave;
+	int i, mec;
+
+	printf( "\n-------Checking segmented register maps--------\n" );
+	for ( i = 0; i < 10; i++ ) low[i] = i;
+	for ( i = 0; i < 10; i++ ) high[i] = 100 + i;
+	for ( i = 0; i < 100; i++ ) block[i] = 40000 + i;
+	for ( i = 0; i < 10; i++ ) inputs[i] = 30000 + i;
+
+	memset( &slave, 0, sizeof( slave ) );
+	slave.address = 0x20;
+	slave.response.frame = buffer;
+	slave.registerSegments = overlapping;
+	slave.registerSegmentCount = 2;
+	printf( "overlapping: %d\n", modbusSlaveInit( &slave ) );
+
+	slave.registerSegments = segments;
+	slave.registerSegmentCount = 3;
+	slave.inputRegisterSegments = inputsegments;
+	slave.inputRegisterSegmentCount = 1;
+	printf( "init: %d\n", modbusSlaveInit( &slave ) );
+
+	//Reads within segments, and across adjacent ones
+	modbusBuildRequest03( &mstatus, 0x20, 5, 10 );
+	printf( "read 5-14: mec=%d, values:", slaveexchange( &slave ) );
+	for ( i = 0; i < 10; i++ ) printf( " %d", mstatus.data.regs[i] );
+	printf( "\n" );
+	modbusBuildRequest03( &mstatus, 0x20, 40000, 100 );
+	mec = slaveexchange( &slave );
+	printf( "read 40000-40099: mec=%d, first=%d, last=%d\n", mec, mstatus.data.regs[0], mstatus.data.regs[99] );
+	modbusBuildRequest04( &mstatus, 0x20, 30005, 5 );
+	mec = slaveexchange( &slave );
+	printf( "read input 30005-30009: mec=%d, first=%d, last=%d\n", mec, mstatus.data.regs[0], mstatus.data.regs[4] );
+
+	//Unmapped registers
+	modbusBuildRequest03( &mstatus, 0x20, 18, 4 );
+	mec = slaveexchange( &slave );
+	printf( "read 18-21: mec=%d, exception=%d\n", mec, mstatus.exception.code );
+	modbusBuildRequest03( &mstatus, 0x20, 39999, 2 );
+	mec = slaveexchange( &slave );
+	printf( "read 39999-40000: mec=%d, exception=%d\n", mec, mstatus.exception.code );
+	modbusBuildRequest03( &mstatus, 0x20, 40099, 2 );
+	mec = slaveexchange( &slave );
+	printf( "read 40099-40100: mec=%d, exception=%d\n", mec, mstatus.exception.code );
+	modbusBuildRequest04( &mstatus, 0x20, 5, 1 );
+	mec = slaveexchange( &slave );
+	printf( "read input 5: mec=%d, exception=%d\n", mec, mstatus.exception.code );
+
+	//Writes
+	modbusBuildRequest16( &mstatus, 0x20, 8, 4, (uint16_t[]){ 1000, 1001, 1002, 1003 } );
+	mec = slaveexchange( &slave );
+	printf( "write 8-11: mec=%d, values: %d %d %d %d\n", mec, low[8], low[9], high[0], high[1] );
+	modbusBuildRequest06( &mstatus, 0x20, 40050, 12345 );
+	mec = slaveexchange( &slave );
+	printf( "write 40050: mec=%d, value=%d\n", mec, block[50] );
+	modbusBuildRequest22( &mstatus, 0x20, 40051, 0x00ff, 0x1200 );
+	mec = slaveexchange( &slave );
+	printf( "mask write 40051: mec=%d, value=%.4x\n", mec, block[51] );
+	modbusBuildRequest06( &mstatus, 0x20, 20, 1 );
+	mec = slaveexchange( &slave );
+	printf( "write 20: mec=%d, exception=%d\n", mec, mstatus.exception.code );
+
+	modbusSlaveEnd( &slave );
+	mstatus.response.frame = NULL;
+	mstatus.response.length = 0;
+}
+
+struct
+{
+	int calls;
+	uint8_t write;
+	uint16_t index, count;
+	uint16_t stored[10];
+	ModbusSeqlock *lock; //Lock taken by callback on write
+} callbackstate;
+
+uint8_t registercallback( ModbusSlave *status, const ModbusRegisterSegment *segment, uint8_t write, uint16_t index, uint16_t count, uint16_t *values )
+{
+	//Virtual registers - value is computed from address, writes are stored
+	int i;
+
+	callbackstate.calls++;
+	callbackstate.write = write;
+	callbackstate.index = index;
+	callbackstate.count = count;
+	if ( write && callbackstate.lock != NULL )
+	{
+		modbusSeqlockBegin( callbackstate.lock );
+		modbusSeqlockEnd( callbackstate.lock );
+	}
+	for ( i = 0; i < count; i++ )
+	{
+		if ( index + i == 1009 ) return MODBUS_EXCEP_SLAVE_FAIL;
+		if ( write ) callbackstate.stored[index - segment->base + i] = values[i];
+		else values[i] = callbackstate.stored[index - segment->base + i] ? callbackstate.stored[index - segment->base + i] : ( index + i ) * 2;
+	}
+	return 0;
+}
+
+uint8_t coilcallback( ModbusSlave *status, const ModbusCoilSegment *segment, uint8_t write, uint16_t index, uint16_t count, uint8_t *values )
+{
+	//Virtual coils - every third one is on, writes are just recorded
+	int i;
+
+	callbackstate.calls++;
+	callbackstate.write = write;
+	callbackstate.index = index;
+	callbackstate.count = count;
+	if ( write ) callbackstate.stored[0] = values[0] | ( count > 8 ? values[1] << 8 : 0 );
+	else for ( i = 0; i < count; i++ ) modbusMaskWrite( values, BITSTOBYTES( count ), i, ( index + i ) % 3 == 0 );
+	return 0;
+}
+
+void callbacktest( )
+{
+	static uint16_t memory[10];
+	static uint8_t bits[2], buffer[256];
+	const ModbusRegisterSegment segments[] =
+	{
+		{ .base = 990, .count = 10, .values = memory },
+		{ .base = 1000, .count = 10, .callback = registercallback },
+	};
+	const ModbusCoilSegment coilsegments[] =
+	{
+		{ .base = 480, .count = 16, .values = bits },
+		{ .base = 496, .count = 40, .callback = coilcallback },
+	};
+	ModbusSeqlock lock = { 0 };
+	ModbusSlave slave;
+	int i, mec;
+
+	printf( "\n-------Checking segment callbacks--------\n" );
+	for ( i = 0; i < 10; i++ ) memory[i] = 990 + i;
+	bits[0] = 0xff;
+	bits[1] = 0x00;
+	memset( &callbackstate, 0, sizeof( callbackstate ) );
+	memset( &slave, 0, sizeof( slave ) );
+	slave.address = 0x20;
+	slave.response.frame = buffer;
+	slave.registerSegments = segments;
+	slave.registerSegmentCount = 2;
+	slave.coilSegments = coilsegments;
+	slave.coilSegmentCount = 2;
+	slave.discreteInputSegments = coilsegments + 1;
+	slave.discreteInputSegmentCount = 1;
+	printf( "init: %d\n", modbusSlaveInit( &slave ) );
+
+	//Whole range is passed to callback at once
+	modbusBuildRequest03( &mstatus, 0x20, 995, 10 );
+	printf( "read 995-1004: mec=%d, values:", slaveexchange( &slave ) );
+	for ( i = 0; i < 10; i++ ) printf( " %d", mstatus.data.regs[i] );
+	printf( "\ncallback: calls=%d, write=%d, index=%d, count=%d\n", callbackstate.calls, callbackstate.write, callbackstate.index, callbackstate.count );
+
+	modbusBuildRequest16( &mstatus, 0x20, 998, 5, (uint16_t[]){ 11, 12, 13, 14, 15 } );
+	mec = slaveexchange( &slave );
+	printf( "write 998-1002: mec=%d, memory: %d %d, stored: %d %d %d\n", mec, memory[8], memory[9], callbackstate.stored[0], callbackstate.stored[1], callbackstate.stored[2] );
+	printf( "callback: calls=%d, write=%d, index=%d, count=%d\n", callbackstate.calls, callbackstate.write, callbackstate.index, callbackstate.count );
+
+	modbusBuildRequest06( &mstatus, 0x20, 1005, 0x1234 );
+	mec = slaveexchange( &slave );
+	printf( "write 1005: mec=%d, stored=%.4x, calls=%d\n", mec, callbackstate.stored[5], callbackstate.calls );
+	modbusBuildRequest22( &mstatus, 0x20, 1005, 0xff00, 0x0056 );
+	mec = slaveexchange( &slave );
+	printf( "mask write 1005: mec=%d, stored=%.4x, calls=%d\n", mec, callbackstate.stored[5], callbackstate.calls );
+
+	//Exception reported by callback
+	modbusBuildRequest03( &mstatus, 0x20, 1008, 2 );
+	mec = slaveexchange( &slave );
+	printf( "read 1008-1009: mec=%d, exception=%d\n", mec, mstatus.exception.code );
+
+	//Coils
+	callbackstate.calls = 0;
+	modbusBuildRequest01( &mstatus, 0x20, 490, 20 );
+	printf( "read coils 490-509: mec=%d, values: ", slaveexchange( &slave ) );
+	for ( i = 0; i < 20; i++ ) printf( "%d", modbusMaskRead( mstatus.data.coils, mstatus.data.length, i ) );
+	printf( "\ncallback: calls=%d, write=%d, index=%d, count=%d\n", callbackstate.calls, callbackstate.write, callbackstate.index, callbackstate.count );
+	modbusBuildRequest02( &mstatus, 0x20, 500, 6 );
+	printf( "read inputs 500-505: mec=%d, values: ", slaveexchange( &slave ) );
+	for ( i = 0; i < 6; i++ ) printf( "%d", modbusMaskRead( mstatus.data.coils, mstatus.data.length, i ) );
+	printf( "\n" );
+	modbusBuildRequest15( &mstatus, 0x20, 494, 12, (uint8_t[]){ 0xa5, 0x0f } );
+	mec = slaveexchange( &slave );
+	printf( "write coils 494-505: mec=%d, memory=%.2x, stored=%.4x, index=%d, count=%d\n", mec, bits[1], callbackstate.stored[0], callbackstate.index, callbackstate.count );
+	modbusBuildRequest05( &mstatus, 0x20, 530, 0xff00 );
+	mec = slaveexchange( &slave );
+	printf( "write coil 530: mec=%d, stored=%.4x, index=%d, count=%d\n", mec, callbackstate.stored[0], callbackstate.index, callbackstate.count );
+	printf( "calls: %d\n", callbackstate.calls );
+
+	//Callbacks run outside of seqlock - once per read, and free to take the lock themselves
+	slave.registerLock = &lock;
+	callbackstate.lock = &lock;
+	callbackstate.calls = 0;
+	modbusBuildRequest03( &mstatus, 0x20, 995, 10 );
+	mec = slaveexchange( &slave );
+	printf( "locked read 995-1004: mec=%d, calls=%d, sequence=%u\n", mec, callbackstate.calls, lock.sequence );
+	modbusBuildRequest16( &mstatus, 0x20, 998, 5, (uint16_t[]){ 21, 22, 23, 24, 25 } );
+	mec = slaveexchange( &slave );
+	printf( "locked write 998-1002: mec=%d, calls=%d, sequence=%u, memory: %d %d\n", mec, callbackstate.calls, lock.sequence, memory[8], memory[9] );
+	modbusBuildRequest06( &mstatus, 0x20, 1001, 7 );
+	mec = slaveexchange( &slave );
+	printf( "locked write 1001: mec=%d, calls=%d, sequence=%u, stored=%d\n", mec, callbackstate.calls, lock.sequence, callbackstate.stored[1] );
+	modbusBuildRequest22( &mstatus, 0x20, 999, 0x00ff, 0x0100 );
+	mec = slaveexchange( &slave );
+	printf( "locked mask write 999: mec=%d, calls=%d, sequence=%u, memory=%d\n", mec, callbackstate.calls, lock.sequence, memory[9] );
+	callbackstate.lock = NULL;
+
+	modbusSlaveEnd( &slave );
+	mstatus.response.frame = NULL;
+	mstatus.response.length = 0;
+}
+
+void routertest( )
+{
+	static uint16_t regs[5][4];
+	static uint8_t buffers[5][MODBUS_TCP_MAX_LENGTH];
+	static const uint8_t addresses[5] = { 1, 2, 17, 100, 247 };
+	uint8_t tcpframe[] = { 0x12, 0x34, 0x00, 0x00, 0x00, 0x06, 100, 0x03, 0x00, 0x01, 0x00, 0x02 };
+	ModbusSlave slaves[5], other;
+	ModbusRouter router;
+	uint8_t frame[8];
+	int i, j, err;
+
+	printf( "\n-------Checking slave router--------\n" );
+	for ( i = 0; i < 5; i++ )
+	{
+		memset( slaves + i, 0, sizeof( ModbusSlave ) );
+		for ( j = 0; j < 4; j++ ) regs[i][j] = addresses[i] * 100 + j;
+		slaves[i].address = addresses[i];
+		slaves[i].registers = regs[i];
+		slaves[i].registerCount = 4;
+		slaves[i].response.frame = buffers[i];
+		modbusSlaveInit( slaves + i );
+	}
+
+	printf( "init: %d\n", modbusRouterInit( &router, 0 ) );
+	for ( i = 0; i < 5; i++ )
+		if ( ( err = modbusRouterAdd( &router, slaves + i ) ) ) printf( "add %d: %d\n", i, err );
+	other = slaves[2];
+	printf( "address taken: %d\n", modbusRouterAdd( &router, &other ) );
+	printf( "add again: %d, units: %d\n", modbusRouterAdd( &router, slaves + 2 ), router.unitCount );
+	other.tcp = 1;
+	other.address = 18;
+	printf( "tcp slave: %d\n", modbusRouterAdd( &router, &other ) );
+
+	//Requests are passed to the right slave
+	modbusBuildRequest03( &mstatus, 17, 1, 3 );
+	router.request.frame = mstatus.request.frame;
+	router.request.length = mstatus.request.length;
+	err = modbusRouterParseRequest( &router );
+	printf( "read unit 17: err=%d, responder=%d", err, router.responder != NULL ? router.responder->address : -1 );
+	mstatus.response.frame = router.responder->response.frame;
+	mstatus.response.length = router.responder->response.length;
+	err = modbusParseResponse( &mstatus );
+	printf( ", mec=%d, values: %d %d %d\n", err, mstatus.data.regs[0], mstatus.data.regs[1], mstatus.data.regs[2] );
+
+	modbusBuildRequest03( &mstatus, 50, 1, 3 );
+	router.request.frame = mstatus.request.frame;
+	router.request.length = mstatus.request.length;
+	err = modbusRouterParseRequest( &router );
+	printf( "read unit 50: err=%d, responder=%d\n", err, router.responder != NULL );
+
+	//Broadcast reaches every slave
+	modbusBuildRequest06( &mstatus, 0, 2, 0x5555 );
+	memcpy( frame, mstatus.request.frame, 8 );
+	router.request.frame = frame;
+	router.request.length = 8;
+	err = modbusRouterParseRequest( &router );
+	printf( "broadcast: err=%d, responder=%d, values:", err, router.responder != NULL );
+	for ( i = 0; i < 5; i++ ) printf( " %.4x", regs[i][2] );
+	printf( "\n" );
+
+	frame[7] ^= 1;
+	printf( "bad crc: %d\n", modbusRouterParseRequest( &router ) );
+
+	//Removed slave doesn't respond
+	printf( "remove: %d", modbusRouterRemove( &router, 17 ) );
+	printf( ", again: %d", modbusRouterRemove( &router, 17 ) );
+	printf( ", units: %d\n", router.unitCount );
+	modbusBuildRequest03( &mstatus, 17, 1, 3 );
+	router.request.frame = mstatus.request.frame;
+	router.request.length = mstatus.request.length;
+	err = modbusRouterParseRequest( &router );
+	printf( "read unit 17: err=%d, responder=%d\n", err, router.responder != NULL );
+
+	//Modbus TCP - unit identifier picks slave
+	modbusRouterInit( &router, 1 );
+	for ( i = 0; i < 5; i++ )
+	{
+		slaves[i].tcp = 1;
+		modbusRouterAdd( &router, slaves + i );
+	}
+	router.request.frame = tcpframe;
+	router.request.length = sizeof( tcpframe );
+	err = modbusRouterParseRequest( &router );
+	printf( "tcp unit 100: err=%d, responder=%d, response:", err, router.responder != NULL ? router.responder->address : -1 );
+	for ( i = 0; i < router.responder->response.length; i++ ) printf( " %.2x", router.responder->response.frame[i] );
+	printf( "\n" );
+	tcpframe[6] = 0xff;
+	err = modbusRouterParseRequest( &router );
+	printf( "tcp unit 255: err=%d, responder=%d\n", err, router.responder != NULL );
+
+	for ( i = 0; i < 5; i++ ) modbusSlaveEnd( slaves + i );
+	mstatus.response.frame = NULL;
+	mstatus.response.length = 0;
+}
+
+void printdirty( const char *label, ModbusDirtyLog *log )
+{
+	int i;
+
+	printf( "%s: generation=%d, ranges:", label, log->generation );
+	for ( i = 0; i < log->count; i++ ) printf( " %d-%d", log->ranges[i].index, log->ranges[i].index + log->ranges[i].count - 1 );
+	printf( "\n" );
+}
+
+void dirtytest( )
+{
+	static uint16_t regs[100];
+	static uint8_t bits[4], buffer[256];
+	ModbusDirtyRange regranges[4], coilranges[4], single[1];
+	ModbusDirtyLog reglog = { .ranges = regranges, .capacity = 4 };
+	ModbusDirtyLog coillog = { .ranges = coilranges, .capacity = 4 };
+	ModbusDirtyLog log = { .ranges = single, .capacity = 1 };
+	ModbusSlave slave;
+	int i;
+
+	printf( "\n-------Checking dirty range tracking--------\n" );
+	memset( &slave, 0, sizeof( slave ) );
+	slave.address = 0x20;
+	slave.registers = regs;
+	slave.registerCount = 100;
+	slave.coils = bits;
+	slave.coilCount = 32;
+	slave.response.frame = buffer;
+	slave.registerChanges = &reglog;
+	slave.coilChanges = &coillog;
+	modbusSlaveInit( &slave );
+
+	//Neighbouring writes are merged
+	modbusBuildRequest06( &mstatus, 0x20, 10, 1 );
+	slaveexchange( &slave );
+	modbusBuildRequest16( &mstatus, 0x20, 11, 3, (uint16_t[]){ 1, 2, 3 } );
+	slaveexchange( &slave );
+	modbusBuildRequest06( &mstatus, 0x20, 50, 1 );
+	slaveexchange( &slave );
+	modbusBuildRequest22( &mstatus, 0x20, 9, 0, 0 );
+	slaveexchange( &slave );
+	printdirty( "registers", &reglog );
+
+	//Reads and rejected writes aren't recorded
+	modbusBuildRequest03( &mstatus, 0x20, 0, 10 );
+	slaveexchange( &slave );
+	modbusBuildRequest06( &mstatus, 0x20, 100, 1 );
+	slaveexchange( &slave );
+	printdirty( "after read", &reglog );
+
+	//Full log - the closest ranges are merged
+	modbusBuildRequest16( &mstatus, 0x20, 30, 2, (uint16_t[]){ 1, 2 } );
+	slaveexchange( &slave );
+	modbusBuildRequest06( &mstatus, 0x20, 70, 1 );
+	slaveexchange( &slave );
+	printdirty( "full", &reglog );
+	modbusBuildRequest06( &mstatus, 0x20, 90, 1 );
+	slaveexchange( &slave );
+	printdirty( "overflow", &reglog );
+	modbusBuildRequest06( &mstatus, 0x20, 72, 1 );
+	slaveexchange( &slave );
+	printdirty( "overflow near", &reglog );
+	modbusBuildRequest16( &mstatus, 0x20, 40, 40, regs );
+	slaveexchange( &slave );
+	printdirty( "overlap", &reglog );
+	printf( "clear: %d", modbusDirtyClear( &reglog ) );
+	printdirty( ", registers", &reglog );
+
+	//Coils
+	modbusBuildRequest05( &mstatus, 0x20, 3, 0xff00 );
+	slaveexchange( &slave );
+	modbusBuildRequest15( &mstatus, 0x20, 4, 7, (uint8_t[]){ 0x7f } );
+	slaveexchange( &slave );
+	modbusBuildRequest15( &mstatus, 0x20, 20, 4, (uint8_t[]){ 0x0f } );
+	slaveexchange( &slave );
+	printdirty( "coils", &coillog );
+
+	//Broadcast writes change registers too
+	modbusBuildRequest06( &mstatus, 0, 5, 1 );
+	slaveexchange( &slave );
+	printdirty( "broadcast", &reglog );
+
+	//Single range log - everything is merged
+	for ( i = 0; i < 3; i++ ) modbusDirtyRecord( &log, 20000 * i, 1 );
+	modbusDirtyRecord( &log, 65535, 1 );
+	printdirty( "single", &log );
+	printf( "no log: %d\n", modbusDirtyRecord( NULL, 0, 1 ) );
+
+	modbusSlaveEnd( &slave );
+	mstatus.response.frame = NULL;
+	mstatus.response.length = 0;
+}
+
+void banktest( )
+{
+	static uint8_t buffer[256];
+	static const ModbusBankSegment layout[] = {
+		{ .type = MODBUS_BANK_HOLDING_REGISTERS, .base = 0, .count = 10 },
+		{ .type = MODBUS_BANK_COILS, .base = 100, .count = 20 },
+		{ .type = MODBUS_BANK_HOLDING_REGISTERS, .base = 1000, .count = 4 },
+		{ .type = MODBUS_BANK_INPUT_REGISTERS, .base = 30000, .count = 8 },
+		{ .type = MODBUS_BANK_DISCRETE_INPUTS, .base = 0, .count = 9 },
+	};
+	static const ModbusBankSegment overlapping[] = {
+		{ .type = MODBUS_BANK_HOLDING_REGISTERS, .base = 0, .count = 10 },
+		{ .type = MODBUS_BANK_HOLDING_REGISTERS, .base = 5, .count = 10 },
+	};
+	ModbusBank bank, producer;
+	ModbusSlave slave;
+	uint16_t values[8];
+	uint8_t bits[2];
+	int i;
+
+	printf( "\n-------Checking shared memory register banks--------\n" );
+	shm_unlink( "/lightmodbus-test" );
+	printf( "create: %d\n", modbusBankCreate( &bank, "/lightmodbus-test", layout, 5 ) );
+	printf( "create again: %d\n", modbusBankCreate( &producer, "/lightmodbus-test", layout, 5 ) );
+	printf( "create overlapping: %d\n", modbusBankCreate( &producer, "/lightmodbus-test-2", overlapping, 2 ) );
+	printf( "open missing: %d\n", modbusBankOpen( &producer, "/lightmodbus-test-2" ) );
+	printf( "open: %d\n", modbusBankOpen( &producer, "/lightmodbus-test" ) );
+	printf( "size=%u, segments: %d %d %d %d\n", producer.size, producer.registerSegmentCount, producer.inputRegisterSegmentCount, \
+		producer.coilSegmentCount, producer.discreteInputSegmentCount );
+
+	//Slave serves bank mapped by server, producer writes to its own mapping
+	memset( &slave, 0, sizeof( slave ) );
+	slave.address = 0x20;
+	slave.response.frame = buffer;
+	printf( "attach: %d\n", modbusBankAttach( &bank, &slave ) );
+	printf( "init: %d\n", modbusSlaveInit( &slave ) );
+
+	for ( i = 0; i < 8; i++ ) values[i] = 100 + i;
+	printf( "write inputs: %d\n", modbusBankWrite( &producer, MODBUS_BANK_INPUT_REGISTERS, 30002, 6, values ) );
+	printf( "write outside: %d\n", modbusBankWrite( &producer, MODBUS_BANK_HOLDING_REGISTERS, 8, 4, values ) );
+	printf( "write discrete inputs: %d\n", modbusBankWrite( &producer, MODBUS_BANK_DISCRETE_INPUTS, 2, 7, (uint8_t[]){ 0x55 } ) );
+	modbusBuildRequest04( &mstatus, 0x20, 30000, 8 );
+	printf( "read inputs 30000-30007: mec=%d, values:", slaveexchange( &slave ) );
+	for ( i = 0; i < 8; i++ ) printf( " %d", mstatus.data.regs[i] );
+	printf( "\n" );
+	modbusBuildRequest02( &mstatus, 0x20, 0, 9 );
+	printf( "read discrete inputs 0-8: mec=%d, values: ", slaveexchange( &slave ) );
+	for ( i = 0; i < 9; i++ ) printf( "%d", modbusMaskRead( mstatus.data.coils, mstatus.data.length, i ) );
+	printf( "\n" );
+
+	//Master writes go straight to the bank
+	modbusBuildRequest16( &mstatus, 0x20, 1000, 4, (uint16_t[]){ 7, 8, 9, 10 } );
+	printf( "write 1000-1003: mec=%d\n", slaveexchange( &slave ) );
+	printf( "producer read: %d, values:", modbusBankRead( &producer, MODBUS_BANK_HOLDING_REGISTERS, 1000, 4, values ) );
+	for ( i = 0; i < 4; i++ ) printf( " %d", values[i] );
+	printf( "\n" );
+	printf( "write coils: %d\n", modbusBankWrite( &producer, MODBUS_BANK_COILS, 108, 10, (uint8_t[]){ 0xff, 0x03 } ) );
+	modbusBuildRequest15( &mstatus, 0x20, 110, 6, (uint8_t[]){ 0x2d } );
+	printf( "write coils 110-115: mec=%d\n", slaveexchange( &slave ) );
+	modbusBuildRequest01( &mstatus, 0x20, 106, 14 );
+	printf( "read coils 106-119: mec=%d, values: ", slaveexchange( &slave ) );
+	for ( i = 0; i < 14; i++ ) printf( "%d", modbusMaskRead( mstatus.data.coils, mstatus.data.length, i ) );
+	printf( "\n" );
+	printf( "producer read: %d, values: ", modbusBankRead( &producer, MODBUS_BANK_COILS, 108, 10, bits ) );
+	for ( i = 0; i < 10; i++ ) printf( "%d", modbusMaskRead( bits, 2, i ) );
+	printf( "\n" );
+	modbusBuildRequest03( &mstatus, 0x20, 8, 4 );
+	printf( "read across segments: mec=%d\n", slaveexchange( &slave ) );
+	printf( "sequence: %u %u\n", producer.header->registerLock.sequence, producer.header->inputRegisterLock.sequence );
+
+	printf( "close: %d %d\n", modbusBankClose( &producer ), modbusBankClose( &bank ) );
+	printf( "write closed: %d\n", modbusBankWrite( &bank, MODBUS_BANK_HOLDING_REGISTERS, 0, 1, values ) );
+	shm_unlink( "/lightmodbus-test" );
+	modbusSlaveEnd( &slave );
+	mstatus.response.frame = NULL;
+	mstatus.response.length = 0;
+}
+
 void maxlentest( )
 {
 	#define CK2( n ) printf( "mec=%d, sec=%d\n", mec, sec ); printf( memcmp( mstatus.data.regs, bak, n ) ? "ERROR!\n" : "OK\n" );
@@ -203,7 +1797,7 @@ void Test( )
 	//Dump parsed data
 	printf( "\tError - %d\n\tFinished - 1\n", MasterError );
 
-	if ( mstatus.data.coils != NULL && mstatus.data.regs != NULL )
+	if ( mstatus.data.length != 0 )
 		for ( i = 0; i < mstatus.data.count; i++ )
 		{
 			printf( "\t - { addr: 0x%x, type: 0x%x, reg: 0x%x, val: 0x%x }\n", mstatus.data.address, mstatus.data.type, mstatus.data.index + i,\
@@ -236,6 +1830,16 @@ void libinit( )
 	sstatus.inputRegisterCount = 4;
 	sstatus.address = 32;
 
+	#if LIGHTMODBUS_STATIC_MEM_SLAVE
+	sstatus.response.frame = sresponse;
+	#endif
+
+	#if LIGHTMODBUS_STATIC_MEM_MASTER
+	mstatus.request.frame = mrequest;
+	mstatus.data.coils = (uint8_t*) mdata;
+	mstatus.data.regs = mdata;
+	#endif
+
 	printf( "slave init - %d\n", modbusSlaveInit( &sstatus ) );
 	printf( "master init - %d\n\n\n", modbusMasterInit( &mstatus ) );
 }
@@ -621,6 +2225,25 @@ int main( )
 	memset( TestValues2, 0xAA, 1024 );
 	libinit( );
 	MainTest( );
+	crctest( );
+	masktest( );
+	swaptest( );
+	functiontest( );
+	inplacetest( );
+	tcptest( );
+	rtutest( );
+	servertest( );
+	pooltest( );
+	seqlocktest( );
+	pipelinetest( );
+	plantest( );
+	scheduletest( );
+	cachetest( );
+	segmenttest( );
+	callbacktest( );
+	routertest( );
+	dirtytest( );
+	banktest( );
 	maxlentest( );
 
 	modbusSlaveEnd( &sstatus );
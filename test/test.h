@@ -1,8 +1,21 @@
+//posix_openpt, cfmakeraw
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <pthread.h>
 #include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include "../include/lightmodbus/core.h"
 #include "../include/lightmodbus/master.h"
 #include "../include/lightmodbus/slave.h"
+#include "../include/lightmodbus/rtu.h"
+#include "../include/lightmodbus/server.h"
+#include "../include/lightmodbus/bank.h"
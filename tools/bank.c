@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "../include/lightmodbus/core.h"
+#include "../include/lightmodbus/slave.h"
+#include "../include/lightmodbus/bank.h"
+
+/*
+Shared memory register bank tool
+Creates banks, shows their layout and contents, and removes them
+
+	bank create NAME SEGMENT...
+	bank inspect NAME [SEGMENT]
+	bank remove NAME
+
+SEGMENT is TYPE:BASE:COUNT, where TYPE is h (holding registers), i (input registers), c (coils) or d (discrete inputs)
+Segments of each type have to be given in ascending order, eg. 'bank create /plc h:0:100 h:1000:16 c:0:64'
+When segment is given to inspect, values of these registers (or coils) are printed
+*/
+
+#define MAX_SEGMENTS 256
+
+static const char types[] = { 'h', 'i', 'c', 'd' };
+
+static int parseSegment( const char *arg, ModbusBankSegment *segment )
+{
+	unsigned int base, count, i;
+	char type;
+
+	if ( sscanf( arg, "%c:%u:%u", &type, &base, &count ) != 3 || base > 65535 || count == 0 || base + count > 65536 ) return 1;
+
+	memset( segment, 0, sizeof( ModbusBankSegment ) );
+	for ( i = 0; i < 4; i++ )
+		if ( type == types[i] ) segment->type = 1 << i;
+
+	segment->base = base;
+	segment->count = count;
+	return segment->type == 0;
+}
+
+static char typeName( uint8_t type )
+{
+	uint8_t i;
+
+	for ( i = 0; i < 4; i++ )
+		if ( type == 1 << i ) return types[i];
+
+	return '?';
+}
+
+static int inspect( const char *name, const char *arg )
+{
+	ModbusBankSegment range;
+	const ModbusBankSegment *table;
+	ModbusBank bank;
+	uint16_t values[125];
+	uint16_t i, n;
+
+	if ( modbusBankOpen( &bank, name ) )
+	{
+		fprintf( stderr, "cannot open bank %s\n", name );
+		return 1;
+	}
+
+	//Header and segment table
+	table = (const ModbusBankSegment *)( bank.header + 1 );
+	printf( "bank %s: version %d, %u bytes, %d segments\n", name, bank.header->version, bank.header->size, bank.header->segmentCount );
+	printf( "sequence: holding registers %u, input registers %u\n", bank.header->registerLock.sequence, bank.header->inputRegisterLock.sequence );
+	for ( i = 0; i < bank.header->segmentCount; i++ )
+		printf( "%c:%u:%u at offset %u\n", typeName( table[i].type ), table[i].base, table[i].count, table[i].offset );
+
+	//Values are read in chunks of up to 125 registers (or 2000 coils)
+	if ( arg != NULL )
+	{
+		if ( parseSegment( arg, &range ) )
+		{
+			fprintf( stderr, "invalid segment %s\n", arg );
+			modbusBankClose( &bank );
+			return 1;
+		}
+
+		while ( range.count )
+		{
+			n = range.type & ( MODBUS_BANK_HOLDING_REGISTERS | MODBUS_BANK_INPUT_REGISTERS ) ? 125 : 2000;
+			if ( n > range.count ) n = range.count;
+
+			if ( modbusBankRead( &bank, range.type, range.base, n, values ) )
+			{
+				fprintf( stderr, "range %s doesn't lie within one segment\n", arg );
+				modbusBankClose( &bank );
+				return 1;
+			}
+
+			for ( i = 0; i < n; i++ )
+			{
+				if ( range.type & ( MODBUS_BANK_HOLDING_REGISTERS | MODBUS_BANK_INPUT_REGISTERS ) )
+					printf( "%c:%u = %u\n", typeName( range.type ), range.base + i, values[i] );
+				else
+					printf( "%c:%u = %d\n", typeName( range.type ), range.base + i, modbusMaskRead( (uint8_t *) values, 250, i ) );
+			}
+
+			range.base += n;
+			range.count -= n;
+		}
+	}
+
+	modbusBankClose( &bank );
+	return 0;
+}
+
+int main( int argc, char **argv )
+{
+	ModbusBankSegment segments[MAX_SEGMENTS];
+	ModbusBank bank;
+	int i;
+
+	if ( argc >= 4 && !strcmp( argv[1], "create" ) && argc - 3 <= MAX_SEGMENTS )
+	{
+		for ( i = 3; i < argc; i++ )
+		{
+			if ( parseSegment( argv[i], segments + i - 3 ) )
+			{
+				fprintf( stderr, "invalid segment %s\n", argv[i] );
+				return 1;
+			}
+		}
+
+		if ( modbusBankCreate( &bank, argv[2], segments, argc - 3 ) )
+		{
+			fprintf( stderr, "cannot create bank %s (does it exist already, or do segments overlap?)\n", argv[2] );
+			return 1;
+		}
+
+		modbusBankClose( &bank );
+		return inspect( argv[2], NULL );
+	}
+
+	if ( ( argc == 3 || argc == 4 ) && !strcmp( argv[1], "inspect" ) )
+		return inspect( argv[2], argc == 4 ? argv[3] : NULL );
+
+	if ( argc == 3 && !strcmp( argv[1], "remove" ) )
+	{
+		if ( shm_unlink( argv[2] ) )
+		{
+			perror( argv[2] );
+			return 1;
+		}
+		return 0;
+	}
+
+	fprintf( stderr, "usage: %s create NAME TYPE:BASE:COUNT...\n       %s inspect NAME [TYPE:BASE:COUNT]\n       %s remove NAME\n", argv[0], argv[0], argv[0] );
+	return 1;
+}